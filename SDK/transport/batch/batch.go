@@ -0,0 +1,294 @@
+// Package batch is the compact binary encoding of the plugin events. A
+// batch carries N events with typed fields, and the strings (both the
+// keys and the values) are interned in a table of the batch, so the
+// repeated comm, exe or nodename are sent once per batch.
+//
+// Layout, all the integers are uvarint unless noted:
+//
+//	magic(1 byte) version(1 byte)
+//	count, the number of events
+//	strings, the number of the table entries
+//	  len bytes       (repeated)
+//	events            (repeated count times)
+//	  type fields
+//	    key kind value (repeated fields times)
+//
+// The value is a table index for KindString, uvarint for KindUint, the
+// zigzag varint for KindInt and one byte for KindBool. Batches are self
+// contained, nothing is shared across batches.
+package batch
+
+import (
+	"encoding/base64"
+	"encoding/binary"
+	"errors"
+)
+
+const (
+	Magic   byte = 'H'
+	Version byte = 1
+)
+
+// Kinds of the field value
+const (
+	KindString byte = iota
+	KindUint
+	KindInt
+	KindBool
+)
+
+var (
+	ErrMagic   = errors.New("batch: invalid magic or version")
+	ErrShort   = errors.New("batch: buffer too short")
+	ErrIndex   = errors.New("batch: string index out of range")
+	ErrKind    = errors.New("batch: unknown kind")
+	ErrOverrun = errors.New("batch: count exceeds the buffer")
+)
+
+// Encoder encodes the events into a batch, it's not thread-safe
+type Encoder struct {
+	events  []byte
+	strings map[string]uint64
+	table   []string
+	count   int
+	out     []byte
+}
+
+func NewEncoder() *Encoder {
+	return &Encoder{
+		events:  make([]byte, 0, 4096),
+		strings: make(map[string]uint64, 256),
+		table:   make([]string, 0, 256),
+	}
+}
+
+// Begin starts a new event with the number of the fields that follows
+func (e *Encoder) Begin(typ uint32, fields int) {
+	e.events = appendUvarint(e.events, uint64(typ))
+	e.events = appendUvarint(e.events, uint64(fields))
+	e.count++
+}
+
+func (e *Encoder) AppendString(key, value string) {
+	e.appendKey(key, KindString)
+	e.events = appendUvarint(e.events, e.intern(value))
+}
+
+func (e *Encoder) AppendUint(key string, value uint64) {
+	e.appendKey(key, KindUint)
+	e.events = appendUvarint(e.events, value)
+}
+
+func (e *Encoder) AppendInt(key string, value int64) {
+	e.appendKey(key, KindInt)
+	e.events = appendVarint(e.events, value)
+}
+
+func (e *Encoder) AppendBool(key string, value bool) {
+	e.appendKey(key, KindBool)
+	if value {
+		e.events = append(e.events, 1)
+	} else {
+		e.events = append(e.events, 0)
+	}
+}
+
+func (e *Encoder) appendKey(key string, kind byte) {
+	e.events = appendUvarint(e.events, e.intern(key))
+	e.events = append(e.events, kind)
+}
+
+func (e *Encoder) intern(s string) uint64 {
+	if index, ok := e.strings[s]; ok {
+		return index
+	}
+	index := uint64(len(e.table))
+	e.strings[s] = index
+	e.table = append(e.table, s)
+	return index
+}
+
+// Len returns the number of the events in the batch
+func (e *Encoder) Len() int {
+	return e.count
+}
+
+// Bytes returns the batch, it's valid until the next Reset
+func (e *Encoder) Bytes() []byte {
+	e.out = append(e.out[:0], Magic, Version)
+	e.out = appendUvarint(e.out, uint64(e.count))
+	e.out = appendUvarint(e.out, uint64(len(e.table)))
+	for _, s := range e.table {
+		e.out = appendUvarint(e.out, uint64(len(s)))
+		e.out = append(e.out, s...)
+	}
+	e.out = append(e.out, e.events...)
+	return e.out
+}
+
+// Text returns the batch in base64, since the string values of the
+// protobuf must be valid UTF-8 in the server side
+func (e *Encoder) Text() string {
+	return base64.StdEncoding.EncodeToString(e.Bytes())
+}
+
+// Reset clears the batch, the strings are released
+func (e *Encoder) Reset() {
+	e.events = e.events[:0]
+	e.table = e.table[:0]
+	e.count = 0
+	for k := range e.strings {
+		delete(e.strings, k)
+	}
+}
+
+// Event is a decoded event of the batch
+type Event struct {
+	Type   uint32
+	Fields map[string]interface{}
+}
+
+// DecodeText decodes the batch from Text
+func DecodeText(text string) ([]Event, error) {
+	data, err := base64.StdEncoding.DecodeString(text)
+	if err != nil {
+		return nil, err
+	}
+	return Decode(data)
+}
+
+// Decode decodes the batch. The values are string, uint64, int64 or bool
+// by the kind.
+func Decode(data []byte) ([]Event, error) {
+	if len(data) < 2 || data[0] != Magic || data[1] != Version {
+		return nil, ErrMagic
+	}
+	r := reader{data: data, off: 2}
+	count := r.uvarint()
+	size := r.uvarint()
+	// every string or event takes one byte at least
+	if r.err == nil && (size > uint64(len(data)) || count > uint64(len(data))) {
+		return nil, ErrOverrun
+	}
+	table := make([]string, 0, size)
+	for i := uint64(0); i < size && r.err == nil; i++ {
+		table = append(table, string(r.bytes(r.uvarint())))
+	}
+	str := func(index uint64) string {
+		if index >= uint64(len(table)) {
+			r.fail(ErrIndex)
+			return ""
+		}
+		return table[index]
+	}
+	events := make([]Event, 0, count)
+	for i := uint64(0); i < count && r.err == nil; i++ {
+		typ := r.uvarint()
+		fields := r.uvarint()
+		if fields > uint64(len(data)) {
+			return nil, ErrOverrun
+		}
+		event := Event{Type: uint32(typ), Fields: make(map[string]interface{}, fields)}
+		for j := uint64(0); j < fields && r.err == nil; j++ {
+			key := str(r.uvarint())
+			switch kind := r.byte(); kind {
+			case KindString:
+				event.Fields[key] = str(r.uvarint())
+			case KindUint:
+				event.Fields[key] = r.uvarint()
+			case KindInt:
+				event.Fields[key] = r.varint()
+			case KindBool:
+				event.Fields[key] = r.byte() != 0
+			default:
+				r.fail(ErrKind)
+			}
+		}
+		events = append(events, event)
+	}
+	if r.err != nil {
+		return nil, r.err
+	}
+	return events, nil
+}
+
+// appendUvarint is binary.AppendUvarint, which is not in go1.17
+func appendUvarint(b []byte, v uint64) []byte {
+	for v >= 0x80 {
+		b = append(b, byte(v)|0x80)
+		v >>= 7
+	}
+	return append(b, byte(v))
+}
+
+func appendVarint(b []byte, v int64) []byte {
+	ux := uint64(v) << 1
+	if v < 0 {
+		ux = ^ux
+	}
+	return appendUvarint(b, ux)
+}
+
+type reader struct {
+	data []byte
+	off  int
+	err  error
+}
+
+func (r *reader) fail(err error) {
+	if r.err == nil {
+		r.err = err
+	}
+}
+
+func (r *reader) uvarint() uint64 {
+	if r.err != nil {
+		return 0
+	}
+	v, n := binary.Uvarint(r.data[r.off:])
+	if n <= 0 {
+		r.fail(ErrShort)
+		return 0
+	}
+	r.off += n
+	return v
+}
+
+func (r *reader) varint() int64 {
+	if r.err != nil {
+		return 0
+	}
+	v, n := binary.Varint(r.data[r.off:])
+	if n <= 0 {
+		r.fail(ErrShort)
+		return 0
+	}
+	r.off += n
+	return v
+}
+
+func (r *reader) byte() byte {
+	if r.err != nil {
+		return 0
+	}
+	if r.off >= len(r.data) {
+		r.fail(ErrShort)
+		return 0
+	}
+	b := r.data[r.off]
+	r.off++
+	return b
+}
+
+func (r *reader) bytes(n uint64) []byte {
+	if r.err != nil {
+		return nil
+	}
+	if n > uint64(len(r.data)-r.off) {
+		r.fail(ErrShort)
+		return nil
+	}
+	b := r.data[r.off : r.off+int(n)]
+	r.off += int(n)
+	return b
+}
@@ -0,0 +1,50 @@
+package batch
+
+import "testing"
+
+func TestEncodeDecode(t *testing.T) {
+	e := NewEncoder()
+	for i := 0; i < 3; i++ {
+		e.Begin(700, 4)
+		e.AppendString("comm", "bash")
+		e.AppendUint("pid", uint64(1<<40+i))
+		e.AppendInt("retval", -5)
+		e.AppendBool("argv_truncated", i == 1)
+	}
+	events, err := DecodeText(e.Text())
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(events) != 3 {
+		t.Fatalf("events: %d", len(events))
+	}
+	for i, event := range events {
+		if event.Type != 700 ||
+			event.Fields["comm"] != "bash" ||
+			event.Fields["pid"] != uint64(1<<40+i) ||
+			event.Fields["retval"] != int64(-5) ||
+			event.Fields["argv_truncated"] != (i == 1) {
+			t.Fatalf("event %d: %+v", i, event)
+		}
+	}
+	// "comm", "bash", "pid", "retval", "argv_truncated"
+	if len(e.table) != 5 {
+		t.Fatalf("strings are not interned: %v", e.table)
+	}
+	e.Reset()
+	if e.Len() != 0 {
+		t.Fatal("reset failed")
+	}
+}
+
+func TestDecodeTruncated(t *testing.T) {
+	e := NewEncoder()
+	e.Begin(1, 1)
+	e.AppendString("exe", "/usr/bin/true")
+	data := e.Bytes()
+	for i := 0; i < len(data); i++ {
+		if _, err := Decode(data[:i]); err == nil {
+			t.Fatalf("truncated at %d is decoded", i)
+		}
+	}
+}
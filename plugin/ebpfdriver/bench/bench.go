@@ -0,0 +1,215 @@
+// Package bench is a local benchmark of the driver with synthetic
+// workloads. It runs every workload without the driver as the baseline,
+// then loads the driver and runs them again, reports:
+//
+//   - events/sec received by the userspace
+//   - drop rate, by the output failures in kernel and the lost in perf
+//   - the events limited in kernel, by the rate limit or the exec windows
+//   - added syscall latency per operation, compared to the baseline
+//   - userspace CPU time per event
+//
+// It must be run as root with the bytecode embedded, see make bench.
+package bench
+
+import (
+	"fmt"
+	"hades-ebpf/user"
+	"hades-ebpf/user/cache"
+	"hades-ebpf/user/decoder"
+	"hades-ebpf/user/filter/window"
+	"strings"
+	"syscall"
+	"time"
+
+	"github.com/chriskaliX/SDK/clock"
+	"github.com/chriskaliX/SDK/util/hash"
+)
+
+// the events are drained until the count is stable for drainStable
+const (
+	drainStable  = 200 * time.Millisecond
+	drainTimeout = 5 * time.Second
+)
+
+// the rootkit scans are heavy, one round for every rootkitDivisor ops
+const rootkitDivisor = 1000
+
+type result struct {
+	workload string
+	ops      int
+	baseline time.Duration
+	elapsed  time.Duration
+	events   uint64
+	emitted  uint64
+	dropped  uint64
+	limited  uint64
+	cpu      time.Duration
+}
+
+// Run runs the workloads and prints the report
+func Run(workloads []string, count int) error {
+	if count <= 0 {
+		return fmt.Errorf("count %d is invalid", count)
+	}
+	for _, workload := range workloads {
+		if _, ok := workloadFuncs[workload]; !ok && workload != WorkloadRootkit {
+			return fmt.Errorf("workload %s is not supported", workload)
+		}
+	}
+	// baseline, without the driver
+	baseline := make(map[string]time.Duration, len(workloads))
+	for _, workload := range workloads {
+		if workload == WorkloadRootkit {
+			continue
+		}
+		elapsed, err := runWorker(workload, count)
+		if err != nil {
+			return err
+		}
+		baseline[workload] = elapsed
+	}
+	cache.DefaultHashCache = cache.NewLockedHashCache(hash.NewWithClock(clock.New(time.Second)))
+	s := newSandbox()
+	d, err := user.NewDriver(s)
+	if err != nil {
+		return err
+	}
+	defer d.Stop()
+	if err = d.Start(); err != nil {
+		return err
+	}
+	if err = d.PostRun(); err != nil {
+		return err
+	}
+	// the workloads repeat the same exec, which would be blocked by the
+	// windows after the quota and never be measured
+	if err = window.Disable(d.Manager); err != nil {
+		return err
+	}
+	results := make([]*result, 0, len(workloads))
+	for _, workload := range workloads {
+		r, err := runWithDriver(d, s, workload, count)
+		if err != nil {
+			return err
+		}
+		r.baseline = baseline[workload]
+		results = append(results, r)
+	}
+	report(results)
+	return nil
+}
+
+func runWithDriver(d *user.Driver, s *sandbox, workload string, count int) (r *result, err error) {
+	r = &result{workload: workload, ops: count}
+	emitted, dropped, limited, err := outputCounters(d)
+	if err != nil {
+		return
+	}
+	events := s.Events()
+	cpu := rusageCPU()
+	if workload == WorkloadRootkit {
+		r.ops = count/rootkitDivisor + 1
+		r.elapsed, err = rootkitScan(d, r.ops)
+	} else {
+		r.elapsed, err = runWorker(workload, count)
+	}
+	if err != nil {
+		return
+	}
+	r.events = drain(s) - events
+	r.cpu = rusageCPU() - cpu
+	e, l, lim, err := outputCounters(d)
+	if err != nil {
+		return
+	}
+	r.emitted, r.dropped, r.limited = e-emitted, l-dropped, lim-limited
+	return
+}
+
+// rootkitScan triggers the anti_rkt scans in the driver process, the
+// uprobes are on the trigger functions of the driver itself
+func rootkitScan(d *user.Driver, rounds int) (time.Duration, error) {
+	start := time.Now()
+	for i := 0; i < rounds; i++ {
+		for _, event := range decoder.Events {
+			if !strings.HasPrefix(event.Name(), "anti_rkt") {
+				continue
+			}
+			_, cronFunc := event.RegistCron()
+			if cronFunc == nil {
+				continue
+			}
+			if err := cronFunc(d.Manager); err != nil {
+				return 0, err
+			}
+		}
+	}
+	return time.Since(start), nil
+}
+
+// outputCounters returns the emitted events in kernel, the drops, which
+// are the output failures in kernel and the lost in perf buffer, and the
+// events limited in kernel, which are not drops
+func outputCounters(d *user.Driver) (emitted, dropped, limited uint64, err error) {
+	stats, err := d.Stats()
+	if err != nil {
+		return
+	}
+	for _, s := range stats {
+		emitted += s.Emitted
+		dropped += s.OutputFailed
+		limited += s.Limited
+	}
+	dropped += d.Lost()
+	return
+}
+
+// drain waits until all the events are handled by the userspace
+func drain(s *sandbox) uint64 {
+	deadline := time.Now().Add(drainTimeout)
+	last := s.Events()
+	stable := time.Now()
+	for time.Now().Before(deadline) {
+		time.Sleep(drainStable / 4)
+		if cur := s.Events(); cur != last {
+			last, stable = cur, time.Now()
+			continue
+		}
+		if time.Since(stable) >= drainStable {
+			break
+		}
+	}
+	return last
+}
+
+func rusageCPU() time.Duration {
+	var ru syscall.Rusage
+	if err := syscall.Getrusage(syscall.RUSAGE_SELF, &ru); err != nil {
+		return 0
+	}
+	return time.Duration(ru.Utime.Nano() + ru.Stime.Nano())
+}
+
+func report(results []*result) {
+	fmt.Printf("%-10s %10s %12s %10s %12s %10s %12s %12s\n",
+		"Workload", "Ops", "Events", "Events/s", "Drop", "Limited", "Latency/op", "CPU/event")
+	for _, r := range results {
+		var eventsPerSec, dropRate float64
+		if r.elapsed > 0 {
+			eventsPerSec = float64(r.events) / r.elapsed.Seconds()
+		}
+		if total := r.emitted + r.dropped; total > 0 {
+			dropRate = float64(r.dropped) / float64(total) * 100
+		}
+		latency := "-"
+		if r.baseline > 0 {
+			latency = ((r.elapsed - r.baseline) / time.Duration(r.ops)).String()
+		}
+		cpu := "-"
+		if r.events > 0 {
+			cpu = (r.cpu / time.Duration(r.events)).String()
+		}
+		fmt.Printf("%-10s %10d %12d %10.0f %11.2f%% %10d %12s %12s\n",
+			r.workload, r.ops, r.events, eventsPerSec, dropRate, r.limited, latency, cpu)
+	}
+}
@@ -0,0 +1,68 @@
+package bench
+
+import (
+	"context"
+	"strconv"
+	"sync/atomic"
+
+	"github.com/chriskaliX/SDK"
+	"github.com/chriskaliX/SDK/transport/client"
+	"github.com/chriskaliX/SDK/transport/protocol"
+)
+
+var _ SDK.ISandbox = (*sandbox)(nil)
+
+// sandbox is a fake SDK.ISandbox which only counts the records, so the
+// benchmark measures the driver instead of the transport to the agent.
+type sandbox struct {
+	ctx    context.Context
+	cancel context.CancelFunc
+	// records of the events, DataType 1000 or the binary batch 997
+	events uint64
+	// records of the lost, DataType 999
+	lost uint64
+}
+
+func newSandbox() *sandbox {
+	s := &sandbox{}
+	s.ctx, s.cancel = context.WithCancel(context.Background())
+	return s
+}
+
+func (s *sandbox) Init(*SDK.SandboxConfig) error { return nil }
+
+func (s *sandbox) Run(mfunc func(SDK.ISandbox) error) error { return mfunc(s) }
+
+func (s *sandbox) Shutdown() { s.cancel() }
+
+func (s *sandbox) Name() string { return "ebpfdriver-bench" }
+
+func (s *sandbox) Context() context.Context { return s.ctx }
+
+func (s *sandbox) Cancel() { s.cancel() }
+
+func (s *sandbox) SendRecord(rec *protocol.Record) error {
+	switch rec.DataType {
+	case 1000:
+		atomic.AddUint64(&s.events, 1)
+	case 997:
+		// binary batch
+		count, _ := strconv.ParseUint(rec.Data.Fields["count"], 10, 64)
+		atomic.AddUint64(&s.events, count)
+	case 999:
+		atomic.AddUint64(&s.lost, 1)
+	}
+	return nil
+}
+
+func (s *sandbox) SetSendHook(client.SendHookFunction) {}
+
+func (s *sandbox) GetHash(string) string { return "" }
+
+// RecvTask blocks forever, no task in benchmark
+func (s *sandbox) RecvTask() *protocol.Task {
+	<-s.ctx.Done()
+	select {}
+}
+
+func (s *sandbox) Events() uint64 { return atomic.LoadUint64(&s.events) }
@@ -0,0 +1,200 @@
+package bench
+
+import (
+	"fmt"
+	"net"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"strconv"
+	"time"
+)
+
+// Workloads run in a child process (bench-worker), or they would be
+// filtered by the pid_filter of the driver. The rootkit scan is the
+// exception, since the scans are triggered by the uprobes in the driver.
+const (
+	WorkloadExec    = "exec"
+	WorkloadConnect = "connect"
+	WorkloadBind    = "bind"
+	WorkloadFile    = "file"
+	WorkloadDNS     = "dns"
+	WorkloadRootkit = "rootkit"
+)
+
+var Workloads = []string{
+	WorkloadExec,
+	WorkloadConnect,
+	WorkloadBind,
+	WorkloadFile,
+	WorkloadDNS,
+	WorkloadRootkit,
+}
+
+// the dns stub listens on another loopback address, so the local resolver
+// on 127.0.0.1:53 or 127.0.0.53:53 is not affected
+const dnsStubAddr = "127.0.0.2:53"
+
+// a query of "hades.local" A
+var dnsQuery = []byte{
+	0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x05, 'h', 'a', 'd', 'e', 's', 0x05, 'l', 'o', 'c', 'a', 'l', 0x00,
+	0x00, 0x01, 0x00, 0x01,
+}
+
+type workloadFunc func(count int) error
+
+var workloadFuncs = map[string]workloadFunc{
+	WorkloadExec:    execStorm,
+	WorkloadConnect: connectStorm,
+	WorkloadBind:    bindStorm,
+	WorkloadFile:    fileStorm,
+	WorkloadDNS:     dnsStorm,
+}
+
+// RunWorker runs the workload and prints the elapsed time in ns, it's the
+// entry of the bench-worker command
+func RunWorker(workload string, count int) error {
+	fn, ok := workloadFuncs[workload]
+	if !ok {
+		return fmt.Errorf("workload %s is not supported in worker", workload)
+	}
+	start := time.Now()
+	if err := fn(count); err != nil {
+		return err
+	}
+	fmt.Println(time.Since(start).Nanoseconds())
+	return nil
+}
+
+// runWorker starts the worker process and returns the elapsed time of the
+// workload, the process creation is not counted
+func runWorker(workload string, count int) (time.Duration, error) {
+	out, err := exec.Command("/proc/self/exe", "bench-worker",
+		"--workload", workload, "--count", strconv.Itoa(count)).Output()
+	if err != nil {
+		return 0, fmt.Errorf("worker %s failed: %w", workload, err)
+	}
+	ns, err := strconv.ParseInt(string(trimNewline(out)), 10, 64)
+	if err != nil {
+		return 0, err
+	}
+	return time.Duration(ns), nil
+}
+
+func trimNewline(b []byte) []byte {
+	for len(b) > 0 && (b[len(b)-1] == '\n' || b[len(b)-1] == '\r') {
+		b = b[:len(b)-1]
+	}
+	return b
+}
+
+func execStorm(count int) error {
+	for i := 0; i < count; i++ {
+		if err := exec.Command("/bin/true").Run(); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+func connectStorm(count int) error {
+	ln, err := net.Listen("tcp", "127.0.0.1:0")
+	if err != nil {
+		return err
+	}
+	defer ln.Close()
+	go func() {
+		for {
+			conn, err := ln.Accept()
+			if err != nil {
+				return
+			}
+			conn.Close()
+		}
+	}()
+	for i := 0; i < count; i++ {
+		conn, err := net.Dial("tcp", ln.Addr().String())
+		if err != nil {
+			return err
+		}
+		conn.Close()
+	}
+	return nil
+}
+
+func bindStorm(count int) error {
+	for i := 0; i < count; i++ {
+		conn, err := net.ListenPacket("udp", "127.0.0.1:0")
+		if err != nil {
+			return err
+		}
+		conn.Close()
+	}
+	return nil
+}
+
+func fileStorm(count int) error {
+	dir, err := os.MkdirTemp("", "hades-bench")
+	if err != nil {
+		return err
+	}
+	defer os.RemoveAll(dir)
+	for i := 0; i < count; i++ {
+		name := filepath.Join(dir, strconv.Itoa(i))
+		f, err := os.Create(name)
+		if err != nil {
+			return err
+		}
+		f.Close()
+		if err = os.Rename(name, name+".renamed"); err != nil {
+			return err
+		}
+		if err = os.Link(name+".renamed", name+".link"); err != nil {
+			return err
+		}
+		os.Remove(name + ".renamed")
+		os.Remove(name + ".link")
+	}
+	return nil
+}
+
+// dnsStorm queries a local stub which answers the query with the QR flag
+// set, the kretprobe of udp_recvmsg only cares about the responses from
+// port 53.
+func dnsStorm(count int) error {
+	stub, err := net.ListenPacket("udp", dnsStubAddr)
+	if err != nil {
+		return err
+	}
+	defer stub.Close()
+	go func() {
+		buf := make([]byte, 512)
+		for {
+			n, addr, err := stub.ReadFrom(buf)
+			if err != nil {
+				return
+			}
+			if n > 2 {
+				buf[2] |= 0x80
+			}
+			stub.WriteTo(buf[:n], addr)
+		}
+	}()
+	conn, err := net.Dial("udp", dnsStubAddr)
+	if err != nil {
+		return err
+	}
+	defer conn.Close()
+	buf := make([]byte, 512)
+	for i := 0; i < count; i++ {
+		if _, err = conn.Write(dnsQuery); err != nil {
+			return err
+		}
+		conn.SetReadDeadline(time.Now().Add(time.Second))
+		if _, err = conn.Read(buf); err != nil {
+			return err
+		}
+	}
+	return nil
+}
@@ -0,0 +1,56 @@
+package cmd
+
+import (
+	"fmt"
+	"hades-ebpf/bench"
+	"hades-ebpf/user/share"
+	"os"
+
+	"github.com/spf13/cobra"
+)
+
+var (
+	benchCount     int
+	benchWorkloads []string
+	benchWorkload  string
+)
+
+var benchCmd = &cobra.Command{
+	Use:   "bench",
+	Short: "run the local benchmark with synthetic workloads",
+	Run: func(cmd *cobra.Command, args []string) {
+		if err := bench.Run(benchWorkloads, benchCount); err != nil {
+			fmt.Println(err)
+			os.Exit(1)
+		}
+	},
+}
+
+// benchWorkerCmd runs the workload in a child process, so the workload is
+// not filtered by the pid_filter of the driver
+var benchWorkerCmd = &cobra.Command{
+	Use:    "bench-worker",
+	Hidden: true,
+	Run: func(cmd *cobra.Command, args []string) {
+		if err := bench.RunWorker(benchWorkload, benchCount); err != nil {
+			fmt.Fprintln(os.Stderr, err)
+			os.Exit(1)
+		}
+	},
+}
+
+func init() {
+	benchCmd.Flags().IntVar(&benchCount, "count", 5000, "operations of every workload")
+	benchCmd.Flags().StringSliceVar(&benchWorkloads, "workload", bench.Workloads, "workloads to run")
+	benchCmd.Flags().BoolVar(&share.RawSyscall, "raw-syscall", false, "hook the syscalls by one raw_tracepoint sys_enter/sys_exit dispatcher")
+	benchCmd.Flags().BoolVar(&share.Latency, "latency", false, "record the latency histograms of the hooks")
+	benchCmd.Flags().IntVar(&share.DecodeWorkers, "decode-workers", 0, "number of the decode workers, 0 for GOMAXPROCS")
+	benchCmd.Flags().BoolVar(&share.ZeroCopy, "zero-copy", true, "decode the events without copying the buffer and the strings")
+	benchCmd.Flags().StringVar(&share.Encoding, "encoding", share.EncodingJson, "encoding of the events, json or binary")
+	benchCmd.Flags().IntVar(&share.BatchSize, "batch-size", 64, "events in one binary batch")
+	benchCmd.Flags().BoolVar(&share.CompactHeader, "compact-header", false, "send the compact header with the changed fields only in place of the full context")
+	benchWorkerCmd.Flags().IntVar(&benchCount, "count", 5000, "operations of the workload")
+	benchWorkerCmd.Flags().StringVar(&benchWorkload, "workload", "", "workload to run")
+	RootCmd.AddCommand(benchCmd)
+	RootCmd.AddCommand(benchWorkerCmd)
+}
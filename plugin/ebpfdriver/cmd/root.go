@@ -26,4 +26,16 @@ func init() {
 	cobra.EnablePrefixMatching = true
 	RootCmd.PersistentFlags().BoolVar(&share.Debug, "debug", false, "set true send output to console")
 	RootCmd.Flags().StringSliceVarP(&share.EventFilter, "filter", "f", []string{}, "set filters, like 1203,1201")
+	RootCmd.Flags().Uint32Var(&share.ArgvBytesBudget, "argv-bytes", 0, "max bytes of argv with bpf_loop capture (kernel 5.17+), up to 8192, 0 for 4096")
+	RootCmd.Flags().Uint32Var(&share.ArgvElemsBudget, "argv-elems", 0, "max elements of argv/envp with bpf_loop capture (kernel 5.17+), up to 127, 0 for 127")
+	RootCmd.Flags().BoolVar(&share.PidTreeCompact, "pidtree-compact", false, "send ancestor pids only and rebuild the pid tree in userspace")
+	RootCmd.Flags().BoolVar(&share.RawSyscall, "raw-syscall", false, "hook the syscalls by one raw_tracepoint sys_enter/sys_exit dispatcher")
+	RootCmd.Flags().BoolVar(&share.Latency, "latency", false, "record the latency histograms of the hooks, it can be switched by task")
+	RootCmd.Flags().IntVar(&share.DecodeWorkers, "decode-workers", 0, "number of the decode workers, events are partitioned by pid, 0 for GOMAXPROCS")
+	RootCmd.Flags().BoolVar(&share.ZeroCopy, "zero-copy", true, "decode the events without copying the buffer and the strings")
+	RootCmd.Flags().StringVar(&share.Encoding, "encoding", share.EncodingJson, "encoding of the events, json or binary (batched, DataType 997)")
+	RootCmd.Flags().IntVar(&share.BatchSize, "batch-size", 64, "events in one binary batch")
+	RootCmd.Flags().BoolVar(&share.CompactHeader, "compact-header", false, "send the compact header with the changed fields only in place of the full context")
+	RootCmd.Flags().Uint32Var(&share.RateLimit, "rate-limit", 0, "events per second of every event type and cgroup, the rest are counted and reported with DataType 996, 0 for off")
+	RootCmd.Flags().Uint32Var(&share.RateBurst, "rate-burst", 0, "burst of the rate limit, 0 for the same as --rate-limit")
 }
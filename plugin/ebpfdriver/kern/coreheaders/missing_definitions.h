@@ -42,6 +42,10 @@
 #define PTRACE_POKETEXT		4
 #define PTRACE_POKEDATA		5
 
+#define S_IFMT              00170000
+#define S_IFDIR             0040000
+#define S_ISDIR(m)          (((m) & S_IFMT) == S_IFDIR)
+
 // according to tracee, it's arch specific
 #if defined(__TARGET_ARCH_x86)
 
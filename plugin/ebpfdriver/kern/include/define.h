@@ -35,7 +35,6 @@
 #include "bpf_helpers.h"
 
 #define TASK_COMM_LEN       16
-#define MAX_STR_FILTER_SIZE 128
 #define MAX_PERCPU_BUFSIZE  (1 << 15)
 #define MAX_STRING_SIZE     256
 #define MAX_STR_ARR_ELEM    32
@@ -78,6 +77,37 @@ enum hades_ebpf_config { CONFIG_HADES_PID, CONFIG_FILTERS };
     BPF_MAP(_name, BPF_MAP_TYPE_PERCPU_HASH, int, int, _max_entries)
 #define BPF_SOCKHASH(_name, _key_type, _value_type, _max_entries)              \
     BPF_MAP(_name, BPF_MAP_TYPE_SOCKHASH, _key_type, _value_type, _max_entries)
+// ringbuf has no key/value, and the max_entries is the size in bytes
+#define BPF_RINGBUF_OUTPUT(_name, _size)                                       \
+    struct {                                                                   \
+        __uint(type, BPF_MAP_TYPE_RINGBUF);                                    \
+        __uint(max_entries, _size);                                            \
+    } _name SEC(".maps");
+
+/*
+ * Load-time constants, the same way as datadog-agent does. The value is
+ * rewritten by the loader (ConstantEditors in ebpfmanager) before the prog
+ * is loaded, so the branch that is not taken is pruned by the verifier and
+ * helpers which are not supported by the running kernel are never checked.
+ */
+#define LOAD_CONSTANT(param, var) asm("%0 = " param " ll" : "=r"(var))
+#define load_constant(param)                                                   \
+    ({                                                                         \
+        __u64 _val = 0;                                                        \
+        LOAD_CONSTANT(param, _val);                                            \
+        _val;                                                                  \
+    })
+#define CONST_RINGBUF "hades_ringbuf"
+// the number of the decode workers, see intern_send and the compact header
+#define CONST_INTERN_PARTS "hades_intern_parts"
+
+/*
+ * BPF_MAP_TYPE_RINGBUF is supported since kernel 5.8. For CO-RE it is always
+ * compiled and the userspace decides whether to use it or not.
+ */
+#if defined(CORE) || (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0))
+#define HAVE_RINGBUF 1
+#endif
 typedef struct simple_buf {
     __u8 buf[MAX_PERCPU_BUFSIZE];
 } buf_t;
@@ -97,11 +127,12 @@ typedef struct data_context {
                 // user space, it's tgid actually
     __u32 pgid; // process group id
     __u32 sessionid;
-    char comm[TASK_COMM_LEN];    // command
-    char pcomm[TASK_COMM_LEN];   // parent command
-    char nodename[MAX_NODENAME]; // uts_name => 64, in tracee, it's 16 here
-    __u64 retval;                // return value(useful when it's exit or kill)
-    __u8 argnum;                 // argnum
+    // comm, pcomm and nodename are interned, see output_context
+    __u64 comm_id;     // command
+    __u64 pcomm_id;    // parent command
+    __u64 nodename_id; // uts_name => 64, in tracee, it's 16 here
+    __u64 retval;      // return value(useful when it's exit or kill)
+    __u8 argnum;       // argnum
 } context_t;
 
 /* general field for event */
@@ -113,10 +144,28 @@ typedef struct event_data {
     void *ctx;
 } event_data_t;
 
-/* general field for filter string */
-typedef struct string {
-    char str[MAX_STR_FILTER_SIZE];
-} string_t;
+/*
+ * Per-cpu statistics of the hooks, keyed by the event type. Every hook
+ * updates it, so we know which hook is hot, and whether the events are
+ * filtered or dropped.
+ */
+typedef struct hook_stats {
+    __u64 entered;       // reached the context_filter
+    __u64 filtered;      // dropped by the context_filter
+    __u64 limited;       // dropped by the rate limit or the exec windows
+    __u64 truncated;     // fields truncated or skipped in save_* helpers
+    __u64 output_failed; // failed to output, the buffer is full mostly
+    __u64 emitted;       // sent to the userspace
+    __u64 bytes;         // bytes sent to the userspace
+} hook_stats_t;
+
+#define MAX_HOOK_STATS 64
+
+// log2 histogram of the latency, slot n is for [2^n, 2^(n+1)) ns
+#define LATENCY_SLOTS 64
+typedef struct latency_hist {
+    __u64 slots[LATENCY_SLOTS];
+} latency_hist_t;
 
 /*
  * mnt_namespace changes since kernel version 5.11
@@ -154,11 +203,47 @@ typedef struct network_connection_v6 {
 /* filters */
 BPF_HASH(config_map, __u32, __u64, 512);
 
+// the keys of the filters, pid_filter is keyed by the tgid
 BPF_HASH(pid_filter, __u32, __u32, 512);
 BPF_HASH(uid_filter, __u32, __u32, 512);
 BPF_HASH(cgroup_id_filter, __u64, __u32, 512);
 BPF_HASH(pns_filter, __u32, __u32, 512);
-BPF_ARRAY(path_filter, string_t, 3);
+// the hashes of the path prefixes, see "path prefix filter" in utils.h
+BPF_HASH(path_filter, __u64, __u32, 512);
+
+/*
+ * The mode of every filter, by the event type. filter_scope overrides the
+ * filter_default for the type. The default is all deny, so the filters are
+ * deny lists unless userspace sets the mode.
+ */
+#define FILTER_DENY  0 // filtered if the key is in the map
+#define FILTER_ALLOW 1 // filtered if the key is not in the map
+#define FILTER_OFF   2
+typedef struct filter_scope {
+    __u8 pid;
+    __u8 uid;
+    __u8 cgroup_id;
+    __u8 pns;
+    __u8 exe;  // the exe of the task by path_filter
+    __u8 file; // the file path of the file events by path_filter
+} filter_scope_t;
+BPF_HASH(filter_scope, __u32, filter_scope_t, 64);
+BPF_ARRAY(filter_default, filter_scope_t, 1);
+// the tgid of the agent itself, always filtered
+#define CONST_SELF_TGID "hades_self_tgid"
+
+// the token buckets of the rate limit, see "rate limit" in utils.h
+typedef struct rate_key {
+    __u64 cgroup_id;
+    __u32 type;
+    __u32 pad;
+} rate_key_t;
+typedef struct rate_bucket {
+    __u64 tokens;     // in 1/NSEC_PER_SEC of an event
+    __u64 ts;         // the last refill
+    __u64 suppressed; // dropped events in total, reported by userspace
+} rate_bucket_t;
+BPF_LRU_HASH(rate_limit, rate_key_t, rate_bucket_t, 10240);
 /*internal maps (caches) */
 
 /*
@@ -169,8 +254,19 @@ BPF_ARRAY(path_filter, string_t, 3);
 BPF_PERF_OUTPUT(exec_events, 1024);
 BPF_PERF_OUTPUT(file_events, 1024);
 BPF_PERF_OUTPUT(net_events, 1024);
+#ifdef HAVE_RINGBUF
+// shared by all cpus and it's in order, 16M by default. In kernel which
+// ringbuf is not supported, the map is changed into a perf_event_array by
+// the loader and never be used.
+BPF_RINGBUF_OUTPUT(exec_events_ringbuf, 1 << 24);
+#endif
 BPF_PERCPU_ARRAY(bufs, buf_t, 3);
 BPF_PERCPU_ARRAY(bufs_off, __u32, MAX_BUFFERS);
+// the event types are sparse, a hash is used instead of an array
+BPF_MAP(hades_stats, BPF_MAP_TYPE_PERCPU_HASH, __u32, hook_stats_t,
+        MAX_HOOK_STATS);
+BPF_MAP(hades_latency, BPF_MAP_TYPE_PERCPU_HASH, __u32, latency_hist_t,
+        MAX_HOOK_STATS);
 
 #ifdef CORE
 #define get_kconfig(x) get_kconfig_val(x)
@@ -198,6 +294,8 @@ BPF_PERCPU_ARRAY(bufs_off, __u32, MAX_BUFFERS);
 
 #define GET_FIELD_ADDR(field) &field
 
+#define FIELD_OFFSET(type, field) __builtin_offsetof(type, field)
+
 #define READ_KERN(ptr)                                                         \
     ({                                                                         \
         typeof(ptr) _val;                                                      \
@@ -218,6 +316,10 @@ BPF_PERCPU_ARRAY(bufs_off, __u32, MAX_BUFFERS);
 
 #define GET_FIELD_ADDR(field) __builtin_preserve_access_index(&field)
 
+// relocated like bpf_core_field_offset of the newer libbpf, for container_of
+#define FIELD_OFFSET(type, field)                                              \
+    __builtin_preserve_field_info(((type *)0)->field, BPF_FIELD_BYTE_OFFSET)
+
 #define READ_KERN(ptr)                                                         \
     ({                                                                         \
         typeof(ptr) _val;                                                      \
@@ -258,6 +360,24 @@ static inline struct mount *real_mount(struct vfsmount *mnt)
     return container_of(mnt, struct mount, mnt);
 }
 
+static __always_inline hook_stats_t *get_hook_stats(__u32 type)
+{
+    hook_stats_t *stats = bpf_map_lookup_elem(&hades_stats, &type);
+    if (stats != NULL)
+        return stats;
+    hook_stats_t zero = {};
+    bpf_map_update_elem(&hades_stats, &type, &zero, BPF_NOEXIST);
+    return bpf_map_lookup_elem(&hades_stats, &type);
+}
+
+// it's per-cpu, no atomic operation is needed
+#define hook_stats_add(type, field, n)                                         \
+    ({                                                                         \
+        hook_stats_t *_stats = get_hook_stats(type);                           \
+        if (_stats != NULL)                                                    \
+            _stats->field += (n);                                              \
+    })
+
 static __always_inline int get_config(__u32 key)
 {
     __u64 *config = bpf_map_lookup_elem(&config_map, &key);
@@ -270,6 +390,27 @@ static __always_inline int get_config(__u32 key)
 #define DENY_BPF                  0
 #define STEXT                     1
 #define ETEXT                     2
+// budgets of the bpf_loop argv/envp capture, 0 for the default
+#define ARGV_BYTES_BUDGET         3
+#define ARGV_ELEMS_BUDGET         4
+// bitmask of the disabled stages in the execve pipeline, (1 << stage)
+#define EXEC_STAGE_DISABLE        5
+// record the latency histograms of the hooks if it's not 0
+#define LATENCY_ENABLE            6
+// the generation of path_filter, bumped on every change and never reused
+#define PATH_FILTER_GEN           7
+// the events per second and the burst of the rate limit, 0 rate for off
+// and 0 burst for the same as the rate
+#define RATE_LIMIT_RATE           8
+#define RATE_LIMIT_BURST          9
+// the quotas of the exe and argv windows of execve, 0 for off
+#define EXE_WINDOW_QUOTA          10
+#define ARGV_WINDOW_QUOTA         11
+// 0 if path_filter is empty
+#define PATH_FILTER_ACTIVE        12
+// the ns to refill an empty bucket of the rate limit, burst * 1e9 / rate,
+// it's set by userspace with the rate so there is no division per event
+#define RATE_LIMIT_REFILL         13
 /* hook point id */
 #define SYS_ENTER_MEMFD_CREATE    614
 #define SYS_ENTER_EXECVEAT        698
@@ -295,4 +436,73 @@ static __always_inline int get_config(__u32 key)
 #define ANTI_RKT_FOPS             1202
 #define ANTI_RKT_MODULE           1203
 #define SYS_BPF                   1204
+// not a hook, the record of an interned string
+#define INTERN_STRING             1300
+// hooks without events, for the stats and the latency only
+#define SECURITY_INODE_UNLINK     1301
+#define SCHED_PROCESS_FORK        1302
+#define SCHED_PROCESS_EXEC        1303
+#define SCHED_PROCESS_EXIT        1304
+#define EXEC_ARGV_STAGING         1305 // sys_enter_execve(at)
+#define RAW_SYS_ENTER             1306 // the dispatch, before the tail call
+#define RAW_SYS_EXIT              1307
+#define SYS_BPF_DENY              1308 // kprobe/bpf
+
+/*
+ * Latency instrumentation. The cost is one config_map lookup when it's
+ * disabled. Wrap the body of the hook in the program like:
+ *
+ *     return TRACE_LATENCY(COMMIT_CREDS, do_commit_creds(ctx, new));
+ */
+static __always_inline __u32 log2_u64(__u64 v)
+{
+    __u32 r, shift;
+    r = (v > 0xFFFFFFFF) << 5;
+    v >>= r;
+    shift = (v > 0xFFFF) << 4;
+    v >>= shift;
+    r |= shift;
+    shift = (v > 0xFF) << 3;
+    v >>= shift;
+    r |= shift;
+    shift = (v > 0xF) << 2;
+    v >>= shift;
+    r |= shift;
+    shift = (v > 0x3) << 1;
+    v >>= shift;
+    r |= shift;
+    r |= (v >> 1);
+    return r;
+}
+
+static __always_inline __u64 latency_start(void)
+{
+    if (get_config(LATENCY_ENABLE) == 0)
+        return 0;
+    return bpf_ktime_get_ns();
+}
+
+static __always_inline void latency_end(__u32 type, __u64 start)
+{
+    if (start == 0)
+        return;
+    __u64 delta = bpf_ktime_get_ns() - start;
+    latency_hist_t *hist = bpf_map_lookup_elem(&hades_latency, &type);
+    if (hist == NULL) {
+        latency_hist_t zero = {};
+        bpf_map_update_elem(&hades_latency, &type, &zero, BPF_NOEXIST);
+        hist = bpf_map_lookup_elem(&hades_latency, &type);
+        if (hist == NULL)
+            return;
+    }
+    hist->slots[log2_u64(delta) & (LATENCY_SLOTS - 1)]++;
+}
+
+#define TRACE_LATENCY(type, call)                                              \
+    ({                                                                         \
+        __u64 _start = latency_start();                                        \
+        int _ret = (call);                                                     \
+        latency_end(type, _start);                                             \
+        _ret;                                                                  \
+    })
 #endif //__DEFINE_H
\ No newline at end of file
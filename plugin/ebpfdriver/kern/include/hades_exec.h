@@ -19,6 +19,7 @@
 #include "define.h"
 #include "utils.h"
 #include "utils_buf.h"
+#include "schema.h"
 
 struct _sys_enter_execve {
     unsigned long long unused;
@@ -70,106 +71,375 @@ struct _sys_enter_execveat {
  * tracepoint.
  */
 
-SEC("tracepoint/syscalls/sys_enter_execve")
-int sys_enter_execve(struct _sys_enter_execve *ctx)
+// stage argv/envp of execve(at) for the exit, shared by all the flavours
+static __always_inline int do_sys_enter_exec(const char *const *argv,
+                                             const char *const *envp)
 {
     __u64 id = bpf_get_current_pid_tgid();
     struct syscall_buffer *buf = reset_syscall_buffer_cache(id);
     if (!buf)
         return 0;
-    save_args_into_buffer(buf, ctx->argv);
-    save_envp_into_buffer(buf, ctx->envp);
+    save_args_into_buffer(buf, argv);
+    save_envp_into_buffer(buf, envp);
     return 1;
 }
 
-SEC("tracepoint/syscalls/sys_exit_execve")
-int sys_exit_execve(void *ctx)
+#ifdef CORE
+struct argv_hash_ctx {
+    struct syscall_buffer *buf;
+    __u32 len;
+    __u64 h;
+};
+
+// a word of the staged argv, see argv_window_key
+static long argv_hash_cb(u32 i, void *_ctx)
+{
+    struct argv_hash_ctx *c = _ctx;
+    __u32 off = i * sizeof(__u64);
+    if (off >= MAX_ARGV_PER_SYSCALL || off >= c->len)
+        return 1;
+    __u64 w = *(__u64 *)&c->buf->args[off];
+    // the bytes after the cursor may be stale
+    if (c->len - off < sizeof(__u64))
+        w &= (1ULL << ((c->len - off) * 8)) - 1;
+    c->h = (c->h ^ w) * INTERN_FNV_PRIME;
+    return 0;
+}
+
+static __always_inline int do_sys_enter_exec_loop(const char *const *argv,
+                                                  const char *const *envp)
 {
-    // here, we remove to head, judge get buf is correct！
     __u64 id = bpf_get_current_pid_tgid();
-    struct syscall_buffer *buf = get_syscall_buffer_cache(id);
-    if (buf == NULL)
+    struct syscall_buffer *buf = reset_syscall_buffer_cache(id);
+    if (!buf)
         return 0;
-
-    event_data_t data = {};
-    if (!init_event_data(&data, ctx))
-        goto delete;
-    if (context_filter(&data.context))
-        goto delete;
-    data.context.type = SYS_ENTER_EXECVE;
-    /* filename
-   * The filename contains dot slash thing. It's not abs path,
-   * but the args[0] of execve(at)
-   * like Elkeid, we should get this in kretprobe/exit from
-   * the get_exe_from_task function. (current->mm->exe_file->f_path)
-   * and it's safe to access path in it's own context
-   */
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 0);
-    // cwd
-    struct fs_struct *file = get_task_fs(data.task);
-    if (file == NULL)
-        goto delete;
-    void *file_path = get_path_str(GET_FIELD_ADDR(file->pwd));
-    save_str_to_buf(&data, file_path, 1);
-    void *ttyname = get_task_tty_str(data.task);
-    save_str_to_buf(&data, ttyname, 2);
-    void *stdin = get_fraw_str(0);
-    save_str_to_buf(&data, stdin, 3);
-    void *stdout = get_fraw_str(1);
-    save_str_to_buf(&data, stdout, 4);
-    __u32 socket_pid = get_socket_info(&data, 5);
-    // save socket_pid
-    // 0 means error, we'll handle that in user space
-    save_to_submit_buf(&data, &socket_pid, sizeof(socket_pid), 6);
-    // pid_tree
-    save_pid_tree_to_buf(&data, 8, 7);
-    // save argv
-    int argv_ret = save_argv_to_buf(&data, buf, 8);
-    if (argv_ret == 0)
-        goto delete;
-    // save envp
-    int envp_ret = save_envp_to_buf(&data, buf, 9);
-    if (envp_ret == 0) {
-        goto delete;
+    save_args_into_buffer_loop(buf, argv);
+    save_envp_into_buffer_loop(buf, envp);
+    // the whole argv is hashed here since the bpf_loop is only in these
+    // programs, it's used by the argv window at the exit
+    if (get_config(ARGV_WINDOW_QUOTA) != 0) {
+        struct argv_hash_ctx c = {};
+        c.buf = buf;
+        c.len = buf->cursor;
+        c.h = (INTERN_FNV_OFFSET ^ c.len) * INTERN_FNV_PRIME;
+        bpf_loop(MAX_ARGV_PER_SYSCALL / sizeof(__u64), argv_hash_cb, &c, 0);
+        buf->argv_hash = c.h ? c.h : 1;
     }
+    return 1;
+}
+#endif
 
-    delete_syscall_buffer_cache(id);
-    return events_perf_submit(&data);
-    delete : delete_syscall_buffer_cache(id);
+SEC("tracepoint/syscalls/sys_enter_execve")
+int sys_enter_execve(struct _sys_enter_execve *ctx)
+{
+    return TRACE_LATENCY(EXEC_ARGV_STAGING, do_sys_enter_exec(ctx->argv, ctx->envp));
+}
+
+/*
+ * sys_exit_execve(at) pipeline
+ *
+ * The exit of execve(at) collects a lot: exe, cwd, tty, stdin, stdout, the
+ * socket peer, pid tree and argv/envp. All in one program is close to the
+ * verifier limits, so it's split into stages chained by tail calls. The
+ * state (context and buf_off) is shared by the per-cpu exec_state, and the
+ * fields are written to the per-cpu submit buffer as before, so the format
+ * of the event is not changed.
+ *
+ * Stages in EXEC_STAGE_DISABLE of config_map are skipped and placeholders
+ * are written instead. Paths and argv can not be disabled.
+ */
+enum exec_stage {
+    EXEC_STAGE_PATHS = 0, // exe, cwd
+    EXEC_STAGE_FDS,       // tty, stdin, stdout
+    EXEC_STAGE_SOCKET,    // socket, socket_pid
+    EXEC_STAGE_PID_TREE,  // pid_tree
+    EXEC_STAGE_ARGV,      // argv, envp and submit
+    EXEC_STAGE_MAX,
+};
+
+struct exec_state {
+    context_t context;
+    __u64 id;
+    __u64 start; // for the latency of the whole pipeline, 0 if disabled
+    __u32 buf_off;
+    __u32 pad;
+};
+
+BPF_PROG_ARRAY(exec_pipeline, EXEC_STAGE_MAX);
+// the same stages of the raw_tracepoint dispatcher, a prog array only holds
+// programs of one type
+BPF_PROG_ARRAY(exec_pipeline_raw, EXEC_STAGE_MAX);
+BPF_PERCPU_ARRAY(exec_state_map, struct exec_state, 1);
+
+static __always_inline struct exec_state *exec_state_get(void)
+{
+    int zero = 0;
+    return bpf_map_lookup_elem(&exec_state_map, &zero);
+}
+
+// restore the event data from the state in a stage
+static __always_inline int exec_stage_restore(event_data_t *data,
+                                              struct exec_state *state,
+                                              void *ctx)
+{
+    data->task = (struct task_struct *)bpf_get_current_task();
+    data->ctx = ctx;
+    __builtin_memcpy(&data->context, &state->context, sizeof(context_t));
+    data->buf_off = state->buf_off;
+    int buf_idx = SUBMIT_BUF_IDX;
+    data->submit_p = bpf_map_lookup_elem(&bufs, &buf_idx);
+    if (data->submit_p == NULL)
+        return 0;
+    return 1;
+}
+
+static __always_inline void exec_stage_skip_fds(event_data_t *data)
+{
+    char nothing[] = "-1";
+    save_str_to_buf(data, nothing, 2);
+    save_str_to_buf(data, nothing, 3);
+    save_str_to_buf(data, nothing, 4);
+}
+
+static __always_inline void exec_stage_skip_socket(event_data_t *data)
+{
+    struct sockaddr_in remote = {};
+    __u32 socket_pid = 0;
+    save_to_submit_buf(data, &remote, sizeof(struct sockaddr_in), 5);
+    save_to_submit_buf(data, &socket_pid, sizeof(socket_pid), 6);
+}
+
+// the end of the pipeline, submitted or not. The latency is recorded on
+// every path, so the dropped ones are in the histogram as well
+static __always_inline int exec_pipeline_end(struct exec_state *state)
+{
+    delete_syscall_buffer_cache(state->id);
+    latency_end(state->context.type, state->start);
     return 0;
 }
 
+// save the state and jump to the next enabled stage
+static __always_inline int exec_stage_next(event_data_t *data,
+                                           struct exec_state *state,
+                                           void *pipeline,
+                                           int stage)
+{
+    int disabled = get_config(EXEC_STAGE_DISABLE);
+    if (stage == EXEC_STAGE_FDS && (disabled & (1 << EXEC_STAGE_FDS))) {
+        exec_stage_skip_fds(data);
+        stage = EXEC_STAGE_SOCKET;
+    }
+    if (stage == EXEC_STAGE_SOCKET && (disabled & (1 << EXEC_STAGE_SOCKET))) {
+        exec_stage_skip_socket(data);
+        stage = EXEC_STAGE_PID_TREE;
+    }
+    if (stage == EXEC_STAGE_PID_TREE &&
+        (disabled & (1 << EXEC_STAGE_PID_TREE))) {
+        save_empty_pid_tree_to_buf(data, 7);
+        stage = EXEC_STAGE_ARGV;
+    }
+    __builtin_memcpy(&state->context, &data->context, sizeof(context_t));
+    state->buf_off = data->buf_off;
+    bpf_tail_call(data->ctx, pipeline, stage);
+    // only if the stage is not loaded
+    return exec_pipeline_end(state);
+}
+
 /*
- * In execveat, an empty argv or envp is always possible
+ * exec windows
+ *
+ * The quota-per-duration windows of execve, checked before the pipeline
+ * starts, so the repeated execs over the quota are never built or sent. A
+ * window is started by the first exec of the key, and a key over the quota
+ * is blocked for EXEC_WINDOW_BLOCK.
+ *
+ * The exe window is keyed by the file of the exe, (ino, dev, mnt, gen) like
+ * the exe path cache but without its ts, so a path resolved again never
+ * resets the count or the block, and the path is not hashed or resolved.
+ * The exes under the prefixes in exe_window_exempt (the system binaries, see
+ * path_prefix_match) are never blocked, and the path is only resolved for
+ * it once the quota is hit. The argv window is keyed by the hash of the
+ * whole staged argv (see argv_window_key), and it's only counted if the exe
+ * window passes.
  */
-SEC("tracepoint/syscalls/sys_enter_execveat")
-int sys_enter_execveat(struct _sys_enter_execveat *ctx)
+#define EXEC_WINDOW_DURATION (60ULL * 1000000000ULL)
+#define EXEC_WINDOW_BLOCK    (3600ULL * 1000000000ULL)
+#define ARGV_WINDOW_SCAN     256
+
+#define WINDOW_OPEN    0
+#define WINDOW_BLOCKED 1 // over the quota
+#define WINDOW_EXEMPT  2 // over the quota, but the exe is exempted
+
+typedef struct exec_window {
+    __u64 start; // of the window, or of the block
+    __u32 count;
+    __u32 state;
+} exec_window_t;
+
+BPF_LRU_HASH(exe_window, __u64, exec_window_t, 1024);
+BPF_LRU_HASH(argv_window, __u64, exec_window_t, 512);
+BPF_HASH(exe_window_exempt, __u64, __u32, 64);
+
+// 0 if the task has no exe
+static __always_inline __u64 exe_window_key(struct task_struct *task)
 {
-    __u64 id = bpf_get_current_pid_tgid();
-    struct syscall_buffer *buf = reset_syscall_buffer_cache(id);
-    if (!buf)
+    struct mm_struct *mm = READ_KERN(task->mm);
+    if (mm == NULL)
         return 0;
-    save_args_into_buffer(buf, ctx->argv);
-    save_envp_into_buffer(buf, ctx->envp);
+    struct file *file = READ_KERN(mm->exe_file);
+    if (file == NULL)
+        return 0;
+    struct vfsmount *mnt = READ_KERN(file->f_path.mnt);
+    struct inode *inode = READ_KERN(file->f_inode);
+    struct super_block *sb = READ_KERN(inode->i_sb);
+    __u64 ino = READ_KERN(inode->i_ino);
+    __u64 dev = READ_KERN(sb->s_dev);
+    __u32 gen = READ_KERN(inode->i_generation);
+    __u64 h = INTERN_FNV_OFFSET;
+    h = (h ^ ino) * INTERN_FNV_PRIME;
+    h = (h ^ (__u64)mnt) * INTERN_FNV_PRIME;
+    h = (h ^ ((dev << 32) | gen)) * INTERN_FNV_PRIME;
+    return h ? h : 1;
+}
+
+// hashes the words of the staged argv from start, up to the cursor
+static __always_inline __u64 argv_hash_scan(struct syscall_buffer *buf,
+                                            __u64 h, __u32 start, __u32 len)
+{
+#pragma unroll
+    for (int i = 0; i <= ARGV_WINDOW_SCAN / sizeof(__u64); i++) {
+        __u32 off = start + i * sizeof(__u64);
+        if (off >= MAX_ARGV_PER_SYSCALL || off >= len)
+            break;
+        __u64 w = *(__u64 *)&buf->args[off];
+        // the bytes after the cursor may be stale
+        if (len - off < sizeof(__u64))
+            w &= (1ULL << ((len - off) * 8)) - 1;
+        h = (h ^ w) * INTERN_FNV_PRIME;
+    }
+    return h;
+}
+
+// The whole argv is hashed at the enter by the bpf_loop flavours. Without
+// bpf_loop, the first and the last ARGV_WINDOW_SCAN bytes are hashed with
+// the length here, which is the whole argv for most of the command lines.
+static __always_inline __u64 argv_window_key(struct syscall_buffer *buf)
+{
+    if (buf->argv_hash != 0)
+        return buf->argv_hash;
+    __u32 len = buf->cursor;
+    __u64 h = (INTERN_FNV_OFFSET ^ len) * INTERN_FNV_PRIME;
+    h = argv_hash_scan(buf, h, 0, len > ARGV_WINDOW_SCAN ? ARGV_WINDOW_SCAN : len);
+    if (len > ARGV_WINDOW_SCAN)
+        h = argv_hash_scan(buf, h, (len - ARGV_WINDOW_SCAN) & ~(sizeof(__u64) - 1), len);
+    return h;
+}
+
+// exec_window_hit counts the key in its window. It returns the window if
+// the key is over the quota or not open, NULL if it passes.
+static __always_inline exec_window_t *exec_window_hit(void *map, __u64 key,
+                                                      __u32 quota, __u64 now)
+{
+    exec_window_t *w = bpf_map_lookup_elem(map, &key);
+    if (w == NULL || now - w->start > (w->state == WINDOW_BLOCKED ?
+                                       EXEC_WINDOW_BLOCK : EXEC_WINDOW_DURATION)) {
+        exec_window_t init = {};
+        init.start = now;
+        init.count = 1;
+        bpf_map_update_elem(map, &key, &init, BPF_ANY);
+        return NULL;
+    }
+    if (w->state == WINDOW_OPEN && w->count < quota) {
+        __sync_fetch_and_add(&w->count, 1);
+        return NULL;
+    }
+    return w;
+}
+
+// 0 on false & 1 on true
+static __always_inline int exec_window_filter(struct task_struct *task,
+                                              struct syscall_buffer *buf,
+                                              __u32 type)
+{
+    __u64 now = bpf_ktime_get_ns();
+    exec_window_t *w;
+    __u32 quota = get_config(EXE_WINDOW_QUOTA);
+    if (quota != 0) {
+        __u64 key = exe_window_key(task);
+        // the task without an exe is never counted
+        w = key != 0 ? exec_window_hit(&exe_window, key, quota, now) : NULL;
+        if (w != NULL) {
+            if (w->state == WINDOW_OPEN) {
+                if (path_prefix_match(&exe_window_exempt, get_exe_from_task(task))) {
+                    w->state = WINDOW_EXEMPT;
+                } else {
+                    w->state = WINDOW_BLOCKED;
+                    w->start = now;
+                }
+            }
+            if (w->state == WINDOW_BLOCKED)
+                goto limited;
+        }
+    }
+    quota = get_config(ARGV_WINDOW_QUOTA);
+    if (quota != 0) {
+        w = exec_window_hit(&argv_window, argv_window_key(buf), quota, now);
+        if (w != NULL) {
+            if (w->state == WINDOW_OPEN) {
+                w->state = WINDOW_BLOCKED;
+                w->start = now;
+            }
+            goto limited;
+        }
+    }
+    return 0;
+limited:
+    hook_stats_add(type, limited, 1);
     return 1;
 }
 
-SEC("tracepoint/syscalls/sys_exit_execveat")
-int sys_exit_execveat(void *ctx)
+static __always_inline int exec_pipeline_start(void *ctx, void *pipeline, __u32 type)
 {
     // here, we remove to head, judge get buf is correct！
+    __u64 start = latency_start();
     __u64 id = bpf_get_current_pid_tgid();
     struct syscall_buffer *buf = get_syscall_buffer_cache(id);
     if (buf == NULL)
-        return 0;
+        goto out;
 
+    if (prefilter(type))
+        goto delete;
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         goto delete;
+    data.context.type = type;
     if (context_filter(&data.context))
         goto delete;
-    data.context.type = SYS_ENTER_EXECVEAT;
+    if (exec_window_filter(data.task, buf, type))
+        goto delete;
+    if (rate_limit_check(type, data.context.cgroup_id))
+        goto delete;
+    struct exec_state *state = exec_state_get();
+    if (state == NULL)
+        goto delete;
+    state->id = id;
+    state->start = start;
+    return exec_stage_next(&data, state, pipeline, EXEC_STAGE_PATHS);
+delete:
+    delete_syscall_buffer_cache(id);
+out:
+    latency_end(type, start);
+    return 0;
+}
+
+static __always_inline int do_exec_stage_paths(void *ctx, void *pipeline)
+{
+    event_data_t data = {};
+    struct exec_state *state = exec_state_get();
+    if (state == NULL)
+        return 0;
+    if (!exec_stage_restore(&data, state, ctx))
+        goto end;
     /* filename
    * The filename contains dot slash thing. It's not abs path,
    * but the args[0] of execve(at)
@@ -177,40 +447,185 @@ int sys_exit_execveat(void *ctx)
    * the get_exe_from_task function. (current->mm->exe_file->f_path)
    * and it's safe to access path in it's own context
    */
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 0);
+    save_exe_to_buf(&data, data.task, 0);
     // cwd
     struct fs_struct *file = get_task_fs(data.task);
     if (file == NULL)
-        goto delete;
+        goto end;
     void *file_path = get_path_str(GET_FIELD_ADDR(file->pwd));
     save_str_to_buf(&data, file_path, 1);
+    return exec_stage_next(&data, state, pipeline, EXEC_STAGE_FDS);
+end:
+    return exec_pipeline_end(state);
+}
+
+SEC("tracepoint/hades/exec_stage_paths")
+int exec_stage_paths(void *ctx)
+{
+    return do_exec_stage_paths(ctx, &exec_pipeline);
+}
+
+SEC("raw_tracepoint/hades/exec_stage_paths")
+int raw_exec_stage_paths(void *ctx)
+{
+    return do_exec_stage_paths(ctx, &exec_pipeline_raw);
+}
+
+static __always_inline int do_exec_stage_fds(void *ctx, void *pipeline)
+{
+    event_data_t data = {};
+    struct exec_state *state = exec_state_get();
+    if (state == NULL)
+        return 0;
+    if (!exec_stage_restore(&data, state, ctx))
+        return exec_pipeline_end(state);
     void *ttyname = get_task_tty_str(data.task);
     save_str_to_buf(&data, ttyname, 2);
     void *stdin = get_fraw_str(0);
     save_str_to_buf(&data, stdin, 3);
     void *stdout = get_fraw_str(1);
     save_str_to_buf(&data, stdout, 4);
+    return exec_stage_next(&data, state, pipeline, EXEC_STAGE_SOCKET);
+}
+
+SEC("tracepoint/hades/exec_stage_fds")
+int exec_stage_fds(void *ctx)
+{
+    return do_exec_stage_fds(ctx, &exec_pipeline);
+}
+
+SEC("raw_tracepoint/hades/exec_stage_fds")
+int raw_exec_stage_fds(void *ctx)
+{
+    return do_exec_stage_fds(ctx, &exec_pipeline_raw);
+}
+
+static __always_inline int do_exec_stage_socket(void *ctx, void *pipeline)
+{
+    event_data_t data = {};
+    struct exec_state *state = exec_state_get();
+    if (state == NULL)
+        return 0;
+    if (!exec_stage_restore(&data, state, ctx))
+        return exec_pipeline_end(state);
     __u32 socket_pid = get_socket_info(&data, 5);
     // save socket_pid
     // 0 means error, we'll handle that in user space
     save_to_submit_buf(&data, &socket_pid, sizeof(socket_pid), 6);
-    // pid_tree
+    return exec_stage_next(&data, state, pipeline, EXEC_STAGE_PID_TREE);
+}
+
+SEC("tracepoint/hades/exec_stage_socket")
+int exec_stage_socket(void *ctx)
+{
+    return do_exec_stage_socket(ctx, &exec_pipeline);
+}
+
+SEC("raw_tracepoint/hades/exec_stage_socket")
+int raw_exec_stage_socket(void *ctx)
+{
+    return do_exec_stage_socket(ctx, &exec_pipeline_raw);
+}
+
+static __always_inline int do_exec_stage_pid_tree(void *ctx, void *pipeline)
+{
+    event_data_t data = {};
+    struct exec_state *state = exec_state_get();
+    if (state == NULL)
+        return 0;
+    if (!exec_stage_restore(&data, state, ctx))
+        return exec_pipeline_end(state);
     save_pid_tree_to_buf(&data, 8, 7);
+    return exec_stage_next(&data, state, pipeline, EXEC_STAGE_ARGV);
+}
+
+SEC("tracepoint/hades/exec_stage_pid_tree")
+int exec_stage_pid_tree(void *ctx)
+{
+    return do_exec_stage_pid_tree(ctx, &exec_pipeline);
+}
+
+SEC("raw_tracepoint/hades/exec_stage_pid_tree")
+int raw_exec_stage_pid_tree(void *ctx)
+{
+    return do_exec_stage_pid_tree(ctx, &exec_pipeline_raw);
+}
+
+static __always_inline int do_exec_stage_argv(void *ctx)
+{
+    event_data_t data = {};
+    struct exec_state *state = exec_state_get();
+    if (state == NULL)
+        return 0;
+    __u64 id = state->id;
+    if (!exec_stage_restore(&data, state, ctx))
+        goto end;
+    struct syscall_buffer *buf = get_syscall_buffer_cache(id);
+    if (buf == NULL)
+        goto end;
     // save argv
     int argv_ret = save_argv_to_buf(&data, buf, 8);
     if (argv_ret == 0)
-        goto delete;
+        goto end;
     // save envp
     int envp_ret = save_envp_to_buf(&data, buf, 9);
-    if (envp_ret == 0) {
-        goto delete;
-    }
-
+    if (envp_ret == 0)
+        goto end;
     delete_syscall_buffer_cache(id);
-    return events_perf_submit(&data);
-    delete : delete_syscall_buffer_cache(id);
-    return 0;
+    int ret = events_perf_submit(&data);
+    latency_end(state->context.type, state->start);
+    return ret;
+end:
+    return exec_pipeline_end(state);
+}
+
+SEC("tracepoint/hades/exec_stage_argv")
+int exec_stage_argv(void *ctx)
+{
+    return do_exec_stage_argv(ctx);
+}
+
+SEC("raw_tracepoint/hades/exec_stage_argv")
+int raw_exec_stage_argv(void *ctx)
+{
+    return do_exec_stage_argv(ctx);
+}
+
+SEC("tracepoint/syscalls/sys_exit_execve")
+int sys_exit_execve(void *ctx)
+{
+    return exec_pipeline_start(ctx, &exec_pipeline, SYS_ENTER_EXECVE);
+}
+
+/*
+ * In execveat, an empty argv or envp is always possible
+ */
+SEC("tracepoint/syscalls/sys_enter_execveat")
+int sys_enter_execveat(struct _sys_enter_execveat *ctx)
+{
+    return TRACE_LATENCY(EXEC_ARGV_STAGING, do_sys_enter_exec(ctx->argv, ctx->envp));
+}
+
+#ifdef CORE
+// bpf_loop flavours of the enter programs, see save_args_into_buffer_loop.
+// Only one of the flavours is loaded and attached by the userspace.
+SEC("tracepoint/syscalls/sys_enter_execve")
+int sys_enter_execve_loop(struct _sys_enter_execve *ctx)
+{
+    return TRACE_LATENCY(EXEC_ARGV_STAGING, do_sys_enter_exec_loop(ctx->argv, ctx->envp));
+}
+
+SEC("tracepoint/syscalls/sys_enter_execveat")
+int sys_enter_execveat_loop(struct _sys_enter_execveat *ctx)
+{
+    return TRACE_LATENCY(EXEC_ARGV_STAGING, do_sys_enter_exec_loop(ctx->argv, ctx->envp));
+}
+#endif
+
+SEC("tracepoint/syscalls/sys_exit_execveat")
+int sys_exit_execveat(void *ctx)
+{
+    return exec_pipeline_start(ctx, &exec_pipeline, SYS_ENTER_EXECVEAT);
 }
 
 struct _sys_enter_prctl {
@@ -233,31 +648,30 @@ struct _sys_enter_prctl {
  * https://stackoverflow.com/questions/57749629/manipulating-process-name-and-arguments-by-way-of-argv
  * https://www.blackhat.com/docs/us-16/materials/us-16-Leibowitz-Horse-Pill-A-New-Type-Of-Linux-Rootkit.pdf
  */
-SEC("tracepoint/syscalls/sys_enter_prctl")
-int sys_enter_prctl(struct _sys_enter_prctl *ctx)
+static __always_inline int do_sys_enter_prctl(void *ctx, int option, unsigned long arg2)
 {
+    if (prefilter(SYS_ENTER_PRCTL))
+        return 0;
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = SYS_ENTER_PRCTL;
     if (context_filter(&data.context))
         return 0;
-    data.context.type = SYS_ENTER_PRCTL;
 
-    int option;
     char *newname = NULL;
-    unsigned long flag2;
 
-    bpf_probe_read(&option, sizeof(option), &ctx->option);
     if (option != PR_SET_NAME && option != PR_SET_MM)
         return 0;
+    if (rate_limit_check(SYS_ENTER_PRCTL, data.context.cgroup_id))
+        return 0;
     save_to_submit_buf(&data, &option, sizeof(int), 0);
 
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 1);
+    save_exe_to_buf(&data, data.task, 1);
 
     switch (option) {
     case PR_SET_NAME:
-        bpf_probe_read_user_str(&newname, TASK_COMM_LEN, (char *)ctx->arg2);
+        bpf_probe_read_user_str(&newname, TASK_COMM_LEN, (char *)arg2);
         save_str_to_buf(&data, &newname, 2);
         break;
         /*
@@ -266,8 +680,7 @@ int sys_enter_prctl(struct _sys_enter_prctl *ctx)
      * https://cloud.tencent.com/developer/article/1040079
      */
     case PR_SET_MM:
-        bpf_probe_read_user(&flag2, sizeof(flag2), &ctx->arg2);
-        save_to_submit_buf(&data, &flag2, sizeof(unsigned long), 2);
+        save_to_submit_buf(&data, &arg2, sizeof(unsigned long), 2);
         break;
     default:
         break;
@@ -275,6 +688,12 @@ int sys_enter_prctl(struct _sys_enter_prctl *ctx)
     return events_perf_submit(&data);
 }
 
+SEC("tracepoint/syscalls/sys_enter_prctl")
+int sys_enter_prctl(struct _sys_enter_prctl *ctx)
+{
+    return TRACE_LATENCY(SYS_ENTER_PRCTL, do_sys_enter_prctl(ctx, ctx->option, ctx->arg2));
+}
+
 struct _sys_enter_ptrace {
     unsigned long long unused;
     long syscall_nr;
@@ -287,29 +706,35 @@ struct _sys_enter_ptrace {
 // https://www.giac.org/paper/gcih/467/tracing-ptrace-case-study-internal-root-compromise-incident-handling/105271
 // @Reference:
 // https://driverxdw.github.io/2020/07/06/Linux-ptrace-so%E5%BA%93%E6%B3%A8%E5%85%A5%E5%88%86%E6%9E%90/
-SEC("tracepoint/syscalls/sys_enter_ptrace")
-int sys_enter_ptrace(struct _sys_enter_ptrace *ctx)
+static __always_inline int do_sys_enter_ptrace(void *ctx, long request, long pid, unsigned long addr)
 {
+    if (prefilter(SYS_ENTER_PTRACE))
+        return 0;
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = SYS_ENTER_PTRACE;
     if (context_filter(&data.context))
         return 0;
-    data.context.type = SYS_ENTER_PTRACE;
-    long request;
-    bpf_probe_read(&request, sizeof(request), &ctx->request);
     if (request != PTRACE_POKETEXT && request != PTRACE_POKEDATA)
         return 0;
+    if (rate_limit_check(SYS_ENTER_PTRACE, data.context.cgroup_id))
+        return 0;
 
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 0);
-    save_to_submit_buf(&data, &request, sizeof(long), 1);
-    save_to_submit_buf(&data, &ctx->pid, sizeof(long), 2);
-    save_to_submit_buf(&data, &ctx->addr, sizeof(unsigned long), 3);
-    save_pid_tree_to_buf(&data, 12, 4);
+    emit_ptrace_exe(&data, data.task);
+    emit_ptrace_request(&data, request);
+    emit_ptrace_pid(&data, pid);
+    emit_ptrace_addr(&data, addr);
+    emit_ptrace_pid_tree(&data, 12);
     return events_perf_submit(&data);
 }
 
+SEC("tracepoint/syscalls/sys_enter_ptrace")
+int sys_enter_ptrace(struct _sys_enter_ptrace *ctx)
+{
+    return TRACE_LATENCY(SYS_ENTER_PTRACE, do_sys_enter_ptrace(ctx, ctx->request, ctx->pid, ctx->addr));
+}
+
 struct _sys_enter_memfd_create {
     unsigned long long unused;
     long syscall_nr;
@@ -318,18 +743,318 @@ struct _sys_enter_memfd_create {
 };
 
 // https://xeldax.top/article/linux_no_file_elf_mem_execute
-SEC("tracepoint/syscalls/sys_enter_memfd_create")
-int sys_enter_memfd_create(struct _sys_enter_memfd_create *ctx)
+static __always_inline int do_sys_enter_memfd_create(void *ctx, const char *uname, unsigned int flags)
 {
+    if (prefilter(SYS_ENTER_MEMFD_CREATE))
+        return 0;
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = SYS_ENTER_MEMFD_CREATE;
     if (context_filter(&data.context))
         return 0;
-    data.context.type = SYS_ENTER_MEMFD_CREATE;
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 0);
-    save_str_to_buf(&data, (char *)ctx->uname, 1);
-    save_to_submit_buf(&data, &ctx->flags, sizeof(unsigned int), 2);
+    if (rate_limit_check(SYS_ENTER_MEMFD_CREATE, data.context.cgroup_id))
+        return 0;
+    emit_memfd_create_exe(&data, data.task);
+    emit_memfd_create_uname(&data, (char *)uname);
+    emit_memfd_create_flags(&data, flags);
     return events_perf_submit(&data);
 }
+
+SEC("tracepoint/syscalls/sys_enter_memfd_create")
+int sys_enter_memfd_create(struct _sys_enter_memfd_create *ctx)
+{
+    return TRACE_LATENCY(SYS_ENTER_MEMFD_CREATE, do_sys_enter_memfd_create(ctx, ctx->uname, ctx->flags));
+}
+
+/*
+ * raw_tracepoint dispatcher
+ *
+ * Every syscall tracepoint above is an attach point of its own. In the
+ * raw mode only raw_tracepoint/sys_enter and raw_tracepoint/sys_exit are
+ * attached, and they jump to the handlers by the syscall number through
+ * the prog arrays below, which are filled by the userspace. The syscalls
+ * not enabled in syscall_bitmap only cost one array lookup. The numbers
+ * are arch-specific, so both the arrays and the bitmap are filled by the
+ * userspace.
+ *
+ * The arguments are read from the user pt_regs in args[0], they are still
+ * valid in sys_enter.
+ */
+#define RAW_SYSCALL_MAX 512
+
+BPF_PROG_ARRAY(sys_enter_tails, RAW_SYSCALL_MAX);
+BPF_PROG_ARRAY(sys_exit_tails, RAW_SYSCALL_MAX);
+BPF_ARRAY(syscall_bitmap, __u64, RAW_SYSCALL_MAX / 64);
+
+static __always_inline int syscall_enabled(long nr)
+{
+    if (nr < 0 || nr >= RAW_SYSCALL_MAX)
+        return 0;
+    __u32 key = nr >> 6;
+    __u64 *bits = bpf_map_lookup_elem(&syscall_bitmap, &key);
+    if (bits == NULL)
+        return 0;
+    return (*bits >> (nr & 63)) & 1;
+}
+
+static __always_inline struct pt_regs *raw_syscall_regs(struct bpf_raw_tracepoint_args *ctx)
+{
+    return (struct pt_regs *)ctx->args[0];
+}
+
+// the syscall number is not passed to sys_exit, get it from the regs
+static __always_inline long raw_syscall_nr(struct pt_regs *regs)
+{
+#if defined(__TARGET_ARCH_x86)
+    return READ_KERN(regs->orig_ax);
+#elif defined(__TARGET_ARCH_arm64)
+    return READ_KERN(regs->syscallno);
+#else
+    return -1;
+#endif
+}
+
+// The compat syscalls have their own numbers (ia32 157 is not prctl), and
+// the tails are for the native ones only. They are not hooked, just like
+// the syscalls tracepoints of the native syscalls.
+#ifndef TS_COMPAT
+#define TS_COMPAT 0x0002
+#endif
+#ifndef TIF_32BIT
+#define TIF_32BIT 22
+#endif
+static __always_inline int raw_syscall_compat(void)
+{
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+#if defined(__TARGET_ARCH_x86)
+    return (READ_KERN(task->thread_info.status) & TS_COMPAT) != 0;
+#elif defined(__TARGET_ARCH_arm64)
+    return (READ_KERN(task->thread_info.flags) & (1UL << TIF_32BIT)) != 0;
+#else
+    return 0;
+#endif
+}
+
+SEC("raw_tracepoint/sys_enter")
+int raw_sys_enter(struct bpf_raw_tracepoint_args *ctx)
+{
+    // the tail call never returns, so it's the cost of the dispatch only
+    __u64 start = latency_start();
+    long nr = ctx->args[1];
+    int skip = !syscall_enabled(nr) || raw_syscall_compat();
+    latency_end(RAW_SYS_ENTER, start);
+    if (skip)
+        return 0;
+    bpf_tail_call(ctx, &sys_enter_tails, nr);
+    return 0;
+}
+
+SEC("raw_tracepoint/sys_exit")
+int raw_sys_exit(struct bpf_raw_tracepoint_args *ctx)
+{
+    __u64 start = latency_start();
+    long nr = raw_syscall_nr(raw_syscall_regs(ctx));
+    int skip = !syscall_enabled(nr) || raw_syscall_compat();
+    latency_end(RAW_SYS_EXIT, start);
+    if (skip)
+        return 0;
+    bpf_tail_call(ctx, &sys_exit_tails, nr);
+    return 0;
+}
+
+// a copy of the user regs, PT_REGS_PARM* can't be used on the pointer.
+// The first argument is read by PT_REGS_PARM1 since it's not clobbered by
+// the return value in sys_enter (orig_x0 is the same as x0 on arm64).
+static __always_inline int raw_syscall_args(struct bpf_raw_tracepoint_args *ctx,
+                                            struct pt_regs *regs)
+{
+    return bpf_probe_read(regs, sizeof(*regs), raw_syscall_regs(ctx)) == 0;
+}
+
+SEC("raw_tracepoint/sys_enter_execve")
+int raw_sys_enter_execve(struct bpf_raw_tracepoint_args *ctx)
+{
+    struct pt_regs regs = {};
+    if (!raw_syscall_args(ctx, &regs))
+        return 0;
+    return TRACE_LATENCY(EXEC_ARGV_STAGING,
+                         do_sys_enter_exec((const char *const *)PT_REGS_PARM2_SYSCALL(&regs),
+                                           (const char *const *)PT_REGS_PARM3_SYSCALL(&regs)));
+}
+
+SEC("raw_tracepoint/sys_enter_execveat")
+int raw_sys_enter_execveat(struct bpf_raw_tracepoint_args *ctx)
+{
+    struct pt_regs regs = {};
+    if (!raw_syscall_args(ctx, &regs))
+        return 0;
+    return TRACE_LATENCY(EXEC_ARGV_STAGING,
+                         do_sys_enter_exec((const char *const *)PT_REGS_PARM3_SYSCALL(&regs),
+                                           (const char *const *)PT_REGS_PARM4_SYSCALL(&regs)));
+}
+
+#ifdef CORE
+SEC("raw_tracepoint/sys_enter_execve")
+int raw_sys_enter_execve_loop(struct bpf_raw_tracepoint_args *ctx)
+{
+    struct pt_regs regs = {};
+    if (!raw_syscall_args(ctx, &regs))
+        return 0;
+    return TRACE_LATENCY(EXEC_ARGV_STAGING,
+                         do_sys_enter_exec_loop((const char *const *)PT_REGS_PARM2_SYSCALL(&regs),
+                                                (const char *const *)PT_REGS_PARM3_SYSCALL(&regs)));
+}
+
+SEC("raw_tracepoint/sys_enter_execveat")
+int raw_sys_enter_execveat_loop(struct bpf_raw_tracepoint_args *ctx)
+{
+    struct pt_regs regs = {};
+    if (!raw_syscall_args(ctx, &regs))
+        return 0;
+    return TRACE_LATENCY(EXEC_ARGV_STAGING,
+                         do_sys_enter_exec_loop((const char *const *)PT_REGS_PARM3_SYSCALL(&regs),
+                                                (const char *const *)PT_REGS_PARM4_SYSCALL(&regs)));
+}
+#endif
+
+SEC("raw_tracepoint/sys_exit_execve")
+int raw_sys_exit_execve(struct bpf_raw_tracepoint_args *ctx)
+{
+    return exec_pipeline_start(ctx, &exec_pipeline_raw, SYS_ENTER_EXECVE);
+}
+
+SEC("raw_tracepoint/sys_exit_execveat")
+int raw_sys_exit_execveat(struct bpf_raw_tracepoint_args *ctx)
+{
+    return exec_pipeline_start(ctx, &exec_pipeline_raw, SYS_ENTER_EXECVEAT);
+}
+
+SEC("raw_tracepoint/sys_enter_prctl")
+int raw_sys_enter_prctl(struct bpf_raw_tracepoint_args *ctx)
+{
+    struct pt_regs regs = {};
+    if (!raw_syscall_args(ctx, &regs))
+        return 0;
+    return TRACE_LATENCY(SYS_ENTER_PRCTL,
+                         do_sys_enter_prctl(ctx, (int)PT_REGS_PARM1(&regs),
+                                            (unsigned long)PT_REGS_PARM2_SYSCALL(&regs)));
+}
+
+SEC("raw_tracepoint/sys_enter_ptrace")
+int raw_sys_enter_ptrace(struct bpf_raw_tracepoint_args *ctx)
+{
+    struct pt_regs regs = {};
+    if (!raw_syscall_args(ctx, &regs))
+        return 0;
+    return TRACE_LATENCY(SYS_ENTER_PTRACE,
+                         do_sys_enter_ptrace(ctx, (long)PT_REGS_PARM1(&regs),
+                                             (long)PT_REGS_PARM2_SYSCALL(&regs),
+                                             (unsigned long)PT_REGS_PARM3_SYSCALL(&regs)));
+}
+
+SEC("raw_tracepoint/sys_enter_memfd_create")
+int raw_sys_enter_memfd_create(struct bpf_raw_tracepoint_args *ctx)
+{
+    struct pt_regs regs = {};
+    if (!raw_syscall_args(ctx, &regs))
+        return 0;
+    return TRACE_LATENCY(SYS_ENTER_MEMFD_CREATE,
+                         do_sys_enter_memfd_create(ctx, (const char *)PT_REGS_PARM1(&regs),
+                                                   (unsigned int)PT_REGS_PARM2_SYSCALL(&regs)));
+}
+
+/*
+ * Process tree maintenance, see proc_tree in utils_buf.h. These are not
+ * filtered and emit nothing.
+ */
+struct _sched_process_fork {
+    unsigned long long unused;
+    char parent_comm[TASK_COMM_LEN];
+    pid_t parent_pid;
+    char child_comm[TASK_COMM_LEN];
+    pid_t child_pid;
+};
+
+// The child task_struct is not available in the tracepoint. A new thread
+// is linked at the tail of the thread group of current before the
+// tracepoint, so it's the newest task there.
+static __always_inline int fork_is_thread(__u32 child)
+{
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+    struct signal_struct *signal = READ_KERN(task->signal);
+    struct list_head *last = READ_KERN(signal->thread_head.prev);
+    struct task_struct *newest = (struct task_struct *)((void *)last -
+            FIELD_OFFSET(struct task_struct, thread_node));
+    return READ_KERN(newest->pid) == child;
+}
+
+// threads are skipped, they are never walked by the tgid chain and would
+// only evict the processes from the LRU
+static __always_inline int do_sched_process_fork(struct _sched_process_fork *ctx)
+{
+    hook_stats_add(SCHED_PROCESS_FORK, entered, 1);
+    __u32 child = ctx->child_pid;
+    if (fork_is_thread(child))
+        return 0;
+    proc_info_t info = {};
+    info.ppid = bpf_get_current_pid_tgid() >> 32;
+    info.start_time = bpf_ktime_get_ns();
+    // comm is inherited from the parent
+    bpf_probe_read_str(info.comm, TASK_COMM_LEN, ctx->child_comm);
+    proc_info_t *parent = bpf_map_lookup_elem(&proc_tree, &info.ppid);
+    if (parent != NULL)
+        info.exec_id = parent->exec_id;
+    bpf_map_update_elem(&proc_tree, &child, &info, BPF_ANY);
+    return 0;
+}
+
+SEC("tracepoint/sched/sched_process_fork")
+int sched_process_fork(struct _sched_process_fork *ctx)
+{
+    return TRACE_LATENCY(SCHED_PROCESS_FORK, do_sched_process_fork(ctx));
+}
+
+struct _sched_process_exec {
+    unsigned long long unused;
+    int data_loc_filename;
+    pid_t pid;
+    pid_t old_pid;
+};
+
+static __always_inline int do_sched_process_exec(void)
+{
+    hook_stats_add(SCHED_PROCESS_EXEC, entered, 1);
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+    __u32 tgid = bpf_get_current_pid_tgid() >> 32;
+    proc_info_t info = {};
+    struct task_struct *parent = READ_KERN(task->real_parent);
+    info.ppid = READ_KERN(parent->tgid);
+    info.exec_id = READ_KERN(task->self_exec_id);
+    info.start_time = READ_KERN(task->start_time);
+    bpf_get_current_comm(&info.comm, sizeof(info.comm));
+    bpf_map_update_elem(&proc_tree, &tgid, &info, BPF_ANY);
+    return 0;
+}
+
+SEC("tracepoint/sched/sched_process_exec")
+int sched_process_exec(struct _sched_process_exec *ctx)
+{
+    return TRACE_LATENCY(SCHED_PROCESS_EXEC, do_sched_process_exec());
+}
+
+static __always_inline int do_sched_process_exit(void)
+{
+    hook_stats_add(SCHED_PROCESS_EXIT, entered, 1);
+    __u32 pid = bpf_get_current_pid_tgid();
+    bpf_map_delete_elem(&proc_tree, &pid);
+    // the tgid when the main thread exits
+    bpf_map_delete_elem(&socket_peer, &pid);
+    return 0;
+}
+
+SEC("tracepoint/sched/sched_process_exit")
+int sched_process_exit(void *ctx)
+{
+    return TRACE_LATENCY(SCHED_PROCESS_EXIT, do_sched_process_exit());
+}
@@ -4,100 +4,199 @@
  */
 #include "define.h"
 #include "utils.h"
+#include "schema.h"
 #include "bpf_helpers.h"
 #include "bpf_core_read.h"
 #include "bpf_tracing.h"
 
-SEC("kprobe/security_inode_create")
-int BPF_KPROBE(kprobe_security_inode_create)
+static __always_inline int do_security_inode_create(void *ctx, struct dentry *dentry)
 {
+    if (prefilter(SECURITY_INODE_CREATE))
+        return 0;
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = SECURITY_INODE_CREATE;
     if (context_filter(&data.context))
         return 0;
-    data.context.type = SECURITY_INODE_CREATE;
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 0);
-    struct dentry *dentry = (struct dentry *)PT_REGS_PARM2(ctx);
+    save_exe_to_buf(&data, data.task, 0);
     void *dentry_path = get_dentry_path_str(dentry);
+    if (file_filter(&data.context, dentry_path))
+        return 0;
+    if (rate_limit_check(SECURITY_INODE_CREATE, data.context.cgroup_id))
+        return 0;
     save_str_to_buf(&data, dentry_path, 1);
     get_socket_info(&data, 2);
     return events_perf_submit(&data);
 }
 
-SEC("kprobe/security_sb_mount")
-int BPF_KPROBE(kprobe_security_sb_mount)
+SEC("kprobe/security_inode_create")
+int BPF_KPROBE(kprobe_security_inode_create)
+{
+    return TRACE_LATENCY(SECURITY_INODE_CREATE, do_security_inode_create(ctx, (struct dentry *)PT_REGS_PARM2(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/security_inode_create")
+int BPF_PROG(fentry_security_inode_create, struct inode *dir, struct dentry *dentry)
 {
+    TRACE_LATENCY(SECURITY_INODE_CREATE, do_security_inode_create(ctx, dentry));
+    return 0;
+}
+#endif
+
+static __always_inline int do_security_sb_mount(void *ctx, const char *dev_name, struct path *path, const char *type, unsigned long flags)
+{
+    if (prefilter(SECURITY_SB_MOUNT))
+        return 0;
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = SECURITY_SB_MOUNT;
     if (context_filter(&data.context))
         return 0;
-    data.context.type = SECURITY_SB_MOUNT;
-    const char *dev_name = (const char *)PT_REGS_PARM1(ctx);
-    struct path *path = (struct path *)PT_REGS_PARM2(ctx);
-    const char *type = (const char *)PT_REGS_PARM3(ctx);
-    unsigned long flags = (unsigned long)PT_REGS_PARM4(ctx);
     void *path_str = get_path_str(path);
-    save_str_to_buf(&data, (void *)dev_name, 0);
-    save_str_to_buf(&data, path_str, 1);
-    save_str_to_buf(&data, (void *)type, 2);
-    save_to_submit_buf(&data, &flags, sizeof(unsigned long), 3);
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 4);
-    save_pid_tree_to_buf(&data, 8, 5);
+    if (file_filter(&data.context, path_str))
+        return 0;
+    if (rate_limit_check(SECURITY_SB_MOUNT, data.context.cgroup_id))
+        return 0;
+    emit_sb_mount_dev_name(&data, (void *)dev_name);
+    emit_sb_mount_path(&data, path_str);
+    emit_sb_mount_type(&data, (void *)type);
+    emit_sb_mount_flags(&data, flags);
+    emit_sb_mount_exe(&data, data.task);
+    emit_sb_mount_pid_tree(&data, 8);
     return events_perf_submit(&data);
 }
 
-SEC("kprobe/security_inode_rename")
-int BPF_KPROBE(kprobe_security_inode_rename)
+SEC("kprobe/security_sb_mount")
+int BPF_KPROBE(kprobe_security_sb_mount)
 {
-        event_data_t data = {};
+    return TRACE_LATENCY(SECURITY_SB_MOUNT,
+                         do_security_sb_mount(ctx, (const char *)PT_REGS_PARM1(ctx), (struct path *)PT_REGS_PARM2(ctx),
+                                              (const char *)PT_REGS_PARM3(ctx), (unsigned long)PT_REGS_PARM4(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/security_sb_mount")
+int BPF_PROG(fentry_security_sb_mount, const char *dev_name, struct path *path, const char *type, unsigned long flags)
+{
+    TRACE_LATENCY(SECURITY_SB_MOUNT, do_security_sb_mount(ctx, dev_name, path, type, flags));
+    return 0;
+}
+#endif
+
+static __always_inline int do_security_inode_rename(void *ctx, struct dentry *from, struct dentry *to)
+{
+    // the exe path cache should be invalidated whether it's filtered or not.
+    // the target is invalidated as well, since it may be replaced
+    exe_path_invalidate(from);
+    exe_path_invalidate(to);
+
+    if (prefilter(SECURITY_INODE_RENAME))
+        return 0;
+    event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = SECURITY_INODE_RENAME;
     if (context_filter(&data.context))
         return 0;
-    data.context.type = SECURITY_INODE_RENAME;
-    
-    struct dentry *from = (struct dentry *) PT_REGS_PARM2(ctx);
-    struct dentry *to = (struct dentry *) PT_REGS_PARM4(ctx);
 
     void *from_ptr = get_dentry_path_str(from);
-    if (from_ptr == NULL)
+    // the file filter is by the old path
+    if (from_ptr == NULL || file_filter(&data.context, from_ptr))
+        return 0;
+    if (rate_limit_check(SECURITY_INODE_RENAME, data.context.cgroup_id))
         return 0;
-    save_str_to_buf(&data, from_ptr, 0);
+    emit_inode_rename_old(&data, from_ptr);
     void *to_ptr = get_dentry_path_str(to);
     if (to_ptr == NULL)
         return 0;
-    save_str_to_buf(&data, to_ptr, 1);
+    emit_inode_rename_new(&data, to_ptr);
     return events_perf_submit(&data);
 }
 
-SEC("kprobe/security_inode_link")
-int BPF_KPROBE(kprobe_security_inode_link)
+SEC("kprobe/security_inode_rename")
+int BPF_KPROBE(kprobe_security_inode_rename)
+{
+    return TRACE_LATENCY(SECURITY_INODE_RENAME, do_security_inode_rename(ctx, (struct dentry *)PT_REGS_PARM2(ctx), (struct dentry *)PT_REGS_PARM4(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/security_inode_rename")
+int BPF_PROG(fentry_security_inode_rename, struct inode *old_dir, struct dentry *old_dentry,
+             struct inode *new_dir, struct dentry *new_dentry)
+{
+    TRACE_LATENCY(SECURITY_INODE_RENAME, do_security_inode_rename(ctx, old_dentry, new_dentry));
+    return 0;
+}
+#endif
+
+// no event for unlink now, only for the exe path cache invalidation
+static __always_inline int do_security_inode_unlink(struct dentry *dentry)
+{
+    hook_stats_add(SECURITY_INODE_UNLINK, entered, 1);
+    exe_path_invalidate(dentry);
+    return 0;
+}
+
+SEC("kprobe/security_inode_unlink")
+int BPF_KPROBE(kprobe_security_inode_unlink)
+{
+    return TRACE_LATENCY(SECURITY_INODE_UNLINK, do_security_inode_unlink((struct dentry *)PT_REGS_PARM2(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/security_inode_unlink")
+int BPF_PROG(fentry_security_inode_unlink, struct inode *dir, struct dentry *dentry)
+{
+    TRACE_LATENCY(SECURITY_INODE_UNLINK, do_security_inode_unlink(dentry));
+    return 0;
+}
+#endif
+
+static __always_inline int do_security_inode_link(void *ctx, struct dentry *from, struct dentry *to)
 {
+    if (prefilter(SECURITY_INODE_LINK))
+        return 0;
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = SECURITY_INODE_LINK;
     if (context_filter(&data.context))
         return 0;
-    data.context.type = SECURITY_INODE_LINK;
-    
-    struct dentry *from = (struct dentry *) PT_REGS_PARM2(ctx);
-    struct dentry *to = (struct dentry *) PT_REGS_PARM4(ctx);
 
     void *from_ptr = get_dentry_path_str(from);
-    if (from_ptr == NULL)
+    // the file filter is by the old path
+    if (from_ptr == NULL || file_filter(&data.context, from_ptr))
+        return 0;
+    if (rate_limit_check(SECURITY_INODE_LINK, data.context.cgroup_id))
         return 0;
-    save_str_to_buf(&data, from_ptr, 0);
+    emit_inode_link_old(&data, from_ptr);
     void *to_ptr = get_dentry_path_str(to);
     if (to_ptr == NULL)
         return 0;
-    save_str_to_buf(&data, to_ptr, 1);
+    emit_inode_link_new(&data, to_ptr);
     return events_perf_submit(&data);
 }
 
+// security_inode_link(struct dentry *old_dentry, struct inode *dir,
+//                     struct dentry *new_dentry)
+SEC("kprobe/security_inode_link")
+int BPF_KPROBE(kprobe_security_inode_link)
+{
+    return TRACE_LATENCY(SECURITY_INODE_LINK, do_security_inode_link(ctx, (struct dentry *)PT_REGS_PARM1(ctx), (struct dentry *)PT_REGS_PARM3(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/security_inode_link")
+int BPF_PROG(fentry_security_inode_link, struct dentry *old_dentry, struct inode *dir, struct dentry *new_dentry)
+{
+    TRACE_LATENCY(SECURITY_INODE_LINK, do_security_inode_link(ctx, old_dentry, new_dentry));
+    return 0;
+}
+#endif
+
 // SEC("kprobe/security_file_open")
 // int BPF_KPROBE(kprobe_security_file_open)
 // {
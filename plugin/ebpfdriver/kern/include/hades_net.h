@@ -14,22 +14,125 @@
 #include "bpf_core_read.h"
 #include "bpf_tracing.h"
 
-SEC("kprobe/security_socket_connect")
-int BPF_KPROBE(kprobe_security_socket_connect)
+#ifdef HAVE_RINGBUF
+// connect & bind are small and frequent, build them in the reserved ringbuf
+// record directly. max size: context(96) + sockaddr_in6(1+28) + exe id(1+8)
+// + exe string if it's not interned(1+4+256) + protocol(1+2), 398 in total
+#define RESERVE_NET_MAX_SIZE                                                   \
+    (sizeof(context_t) + 1 + sizeof(struct sockaddr_in6) + 1 + sizeof(__u64) + \
+     1 + sizeof(int) + MAX_STRING_SIZE + 1 + sizeof(__u16))
+_Static_assert(RESERVE_NET_MAX_SIZE <= RESERVE_BUFSIZE,
+               "connect & bind exceed the reserved record");
+
+static __always_inline int reserve_save_sockaddr(reserve_buf_t *r,
+                                                 event_data_t *data,
+                                                 struct sockaddr *address,
+                                                 sa_family_t sa_fam)
+{
+    switch (sa_fam)
+    {
+    case AF_INET:
+        return reserve_save_to_buf(r, data, (void *)address, sizeof(struct sockaddr_in), 0);
+    case AF_INET6:
+        return reserve_save_to_buf(r, data, (void *)address, sizeof(struct sockaddr_in6), 0);
+    default:
+        return 0;
+    }
+}
+
+static __always_inline int reserve_socket_connect(void *ctx,
+                                                  struct sockaddr *address)
 {
+    if (prefilter(SECURITY_SOCKET_CONNECT))
+        return 0;
     event_data_t data = {};
-    if (!init_event_data(&data, ctx))
+    init_event_context(&data, ctx);
+    data.context.type = SECURITY_SOCKET_CONNECT;
+    if (context_filter(&data.context))
+        return 0;
+
+    if (!address)
+        return 0;
+    sa_family_t sa_fam = READ_KERN(address->sa_family);
+    if ((sa_fam != AF_INET) && (sa_fam != AF_INET6))
+        return 0;
+    if (rate_limit_check(SECURITY_SOCKET_CONNECT, data.context.cgroup_id))
         return 0;
+    void *exe = NULL;
+    __u64 exe_id = intern_exe(&data, data.task, &exe);
+    // reserve after all filters, nothing to discard in most cases
+    reserve_buf_t *r = events_reserve(&data);
+    if (r == NULL)
+        return 0;
+    if (!reserve_save_sockaddr(r, &data, address, sa_fam))
+        return events_reserve_discard(r);
+
+    reserve_save_exe_to_buf(r, &data, exe_id, exe, 1);
+    return events_reserve_submit(r, &data);
+}
+
+static __always_inline int reserve_socket_bind(void *ctx,
+                                               struct socket *sock,
+                                               struct sockaddr *address)
+{
+    if (prefilter(SECURITY_SOCKET_BIND))
+        return 0;
+    event_data_t data = {};
+    init_event_context(&data, ctx);
+    data.context.type = SECURITY_SOCKET_BIND;
     if (context_filter(&data.context))
         return 0;
+
+    struct sock *sk = READ_KERN(sock->sk);
+    __u16 protocol = get_sock_protocol(sk);
+
+    sa_family_t sa_fam = READ_KERN(address->sa_family);
+    if ((sa_fam != AF_INET) && (sa_fam != AF_INET6))
+        return 0;
+    if (rate_limit_check(SECURITY_SOCKET_BIND, data.context.cgroup_id))
+        return 0;
+    void *exe = NULL;
+    __u64 exe_id = intern_exe(&data, data.task, &exe);
+    reserve_buf_t *r = events_reserve(&data);
+    if (r == NULL)
+        return 0;
+    if (!reserve_save_sockaddr(r, &data, address, sa_fam))
+        return events_reserve_discard(r);
+
+    reserve_save_exe_to_buf(r, &data, exe_id, exe, 1);
+    reserve_save_to_buf(r, &data, (void *)&protocol, sizeof(protocol), 2);
+    return events_reserve_submit(r, &data);
+}
+#endif
+
+// The hooks below are shared by the kprobe and the fentry flavours. The
+// body takes the typed arguments so that fentry can pass its BTF arguments
+// straight in, while kprobe reads them from pt_regs. The verifier only
+// accepts 0 as the return value of fentry/fexit, so the wrappers drop it.
+static __always_inline int do_security_socket_connect(void *ctx, struct socket *sock, struct sockaddr *address)
+{
+    // the socket peer index is updated whether it's filtered or not
+    socket_peer_connect(sock, address);
+#ifdef HAVE_RINGBUF
+    if (load_constant(CONST_RINGBUF) && !load_constant(CONST_COMPACT_HEADER))
+        return reserve_socket_connect(ctx, address);
+#endif
+    if (prefilter(SECURITY_SOCKET_CONNECT))
+        return 0;
+    event_data_t data = {};
+    if (!init_event_data(&data, ctx))
+        return 0;
     data.context.type = SECURITY_SOCKET_CONNECT;
+    if (context_filter(&data.context))
+        return 0;
 
-    struct sockaddr *address = (struct sockaddr *)PT_REGS_PARM2(ctx);
     if (!address)
         return 0;
     sa_family_t sa_fam = READ_KERN(address->sa_family);
     if ((sa_fam != AF_INET) && (sa_fam != AF_INET6))
         return 0;
+    if (rate_limit_check(SECURITY_SOCKET_CONNECT, data.context.cgroup_id))
+        return 0;
     switch (sa_fam)
     {
     case AF_INET:
@@ -42,32 +145,61 @@ int BPF_KPROBE(kprobe_security_socket_connect)
         return 0;
     }
 
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 1);
+    save_exe_to_buf(&data, data.task, 1);
     return events_perf_submit(&data);
 }
 
-SEC("kprobe/security_socket_bind")
-int BPF_KPROBE(kprobe_security_socket_bind)
+SEC("kprobe/security_socket_connect")
+int BPF_KPROBE(kprobe_security_socket_connect)
+{
+    return TRACE_LATENCY(SECURITY_SOCKET_CONNECT, do_security_socket_connect(ctx, (struct socket *)PT_REGS_PARM1(ctx), (struct sockaddr *)PT_REGS_PARM2(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/security_socket_connect")
+int BPF_PROG(fentry_security_socket_connect, struct socket *sock, struct sockaddr *address)
+{
+    TRACE_LATENCY(SECURITY_SOCKET_CONNECT, do_security_socket_connect(ctx, sock, address));
+    return 0;
+}
+#endif
+
+// the accepted sock for the socket peer index, no event is sent. The
+// arguments of inet_csk_accept change between versions, so there is no
+// fexit flavour.
+SEC("kretprobe/inet_csk_accept")
+int BPF_KRETPROBE(kretprobe_inet_csk_accept)
+{
+    socket_peer_accept((struct sock *)PT_REGS_RC(ctx));
+    return 0;
+}
+
+static __always_inline int do_security_socket_bind(void *ctx, struct socket *sock, struct sockaddr *address)
 {
+#ifdef HAVE_RINGBUF
+    if (load_constant(CONST_RINGBUF) && !load_constant(CONST_COMPACT_HEADER))
+        return reserve_socket_bind(ctx, sock, address);
+#endif
+    if (prefilter(SECURITY_SOCKET_BIND))
+        return 0;
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = SECURITY_SOCKET_BIND;
     if (context_filter(&data.context))
         return 0;
-    data.context.type = SECURITY_SOCKET_BIND;
 
     // This is for getting protocol
     // In Elkeid, the protocol is not concerned, only sa_family, sip, sport, res
     // Maybe it's useful, so we need to work on this.
-    struct socket *sock = (struct socket *)PT_REGS_PARM1(ctx);
     struct sock *sk = READ_KERN(sock->sk);
     __u16 protocol = get_sock_protocol(sk);
 
-    struct sockaddr *address = (struct sockaddr *)PT_REGS_PARM2(ctx);
     sa_family_t sa_fam = READ_KERN(address->sa_family);
     if ((sa_fam != AF_INET) && (sa_fam != AF_INET6))
         return 0;
+    if (rate_limit_check(SECURITY_SOCKET_BIND, data.context.cgroup_id))
+        return 0;
 
     switch (sa_fam)
     {
@@ -81,13 +213,27 @@ int BPF_KPROBE(kprobe_security_socket_bind)
         return 0;
     }
     // get exe from task_struct
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 1);
+    save_exe_to_buf(&data, data.task, 1);
     save_to_submit_buf(&data, (void *)&protocol, sizeof(protocol), 2);
 
     return events_perf_submit(&data);
 }
 
+SEC("kprobe/security_socket_bind")
+int BPF_KPROBE(kprobe_security_socket_bind)
+{
+    return TRACE_LATENCY(SECURITY_SOCKET_BIND, do_security_socket_bind(ctx, (struct socket *)PT_REGS_PARM1(ctx), (struct sockaddr *)PT_REGS_PARM2(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/security_socket_bind")
+int BPF_PROG(fentry_security_socket_bind, struct socket *sock, struct sockaddr *address)
+{
+    TRACE_LATENCY(SECURITY_SOCKET_BIND, do_security_socket_bind(ctx, sock, address));
+    return 0;
+}
+#endif
+
 /* For DNS */
 BPF_LRU_HASH(udpmsg, u64, struct msghdr *, 1024);
 // kprobe/kretprobe are used for get dns data. Proper way to get udp data,
@@ -95,11 +241,8 @@ BPF_LRU_HASH(udpmsg, u64, struct msghdr *, 1024);
 // still, a uprobe of udp (like getaddrinfo and gethostbyname) to get this
 // all.
 // @Reference: https://www.nlnetlabs.nl/downloads/publications/DNS-augmentation-with-eBPF.pdf
-SEC("kprobe/udp_recvmsg")
-int BPF_KPROBE(kprobe_udp_recvmsg)
+static __always_inline bool udp_recvmsg_interested(struct sock *sk, struct msghdr *msg)
 {
-    // get the sock
-    struct sock *sk = (struct sock *)PT_REGS_PARM1(ctx);
     struct inet_sock *inet = (struct inet_sock *)sk;
     // only port 53 and 5353 is considered useful here. Port 53 is well
     // known for dns while 5353 is the mDNS
@@ -110,24 +253,32 @@ int BPF_KPROBE(kprobe_udp_recvmsg)
     // if all udp traffic is required, remove the dport thing.
     // By the way, I capture the Query part of dns structure and ignore TC flag,
     // which is somehow inaccurate though, but I'll do a uprobe hook for this all.
-    if (dport == 13568 || dport == 59668)
-    {
-        struct msghdr *msg = (struct msghdr *)PT_REGS_PARM2(ctx);
-        // in msghdr->iov_iter. There are different way to filter. What we need
-        // is iovec. In Elkeid, they judge by the iov_len. In ehids-agent or
-        // https://github.com/trichimtrich/dns-tcp-ebpf, they judge by the
-        // (type != ITER_IOVEC). But just as I said, be careful about the name of
-        // `type` or `iter_type`
-        struct iovec *iov = (struct iovec *)READ_KERN(msg->msg_iter.iov);
-        if (iov == NULL)
-            return 0;
-        unsigned long iov_len = READ_KERN(iov->iov_len);
-        if (iov_len == 0)
-            return 0;
-        // maybe bpf_get_prandom_u32() as a key...
-        u64 pid_tgid = bpf_get_current_pid_tgid();
-        bpf_map_update_elem(&udpmsg, &pid_tgid, &msg, BPF_ANY);
-    }
+    if (dport != 13568 && dport != 59668)
+        return false;
+    // in msghdr->iov_iter. There are different way to filter. What we need
+    // is iovec. In Elkeid, they judge by the iov_len. In ehids-agent or
+    // https://github.com/trichimtrich/dns-tcp-ebpf, they judge by the
+    // (type != ITER_IOVEC). But just as I said, be careful about the name of
+    // `type` or `iter_type`
+    struct iovec *iov = (struct iovec *)READ_KERN(msg->msg_iter.iov);
+    if (iov == NULL)
+        return false;
+    unsigned long iov_len = READ_KERN(iov->iov_len);
+    if (iov_len == 0)
+        return false;
+    return true;
+}
+
+SEC("kprobe/udp_recvmsg")
+int BPF_KPROBE(kprobe_udp_recvmsg)
+{
+    struct sock *sk = (struct sock *)PT_REGS_PARM1(ctx);
+    struct msghdr *msg = (struct msghdr *)PT_REGS_PARM2(ctx);
+    if (!udp_recvmsg_interested(sk, msg))
+        return 0;
+    // maybe bpf_get_prandom_u32() as a key...
+    u64 pid_tgid = bpf_get_current_pid_tgid();
+    bpf_map_update_elem(&udpmsg, &pid_tgid, &msg, BPF_ANY);
     return 0;
 }
 
@@ -141,13 +292,8 @@ struct udpdata
 };
 
 // @Reference: https://en.wikipedia.org/wiki/Domain_Name_System
-SEC("kretprobe/udp_recvmsg")
-int BPF_KRETPROBE(kretprobe_udp_recvmsg)
+static __always_inline int do_udp_recvmsg_ret(void *ctx, struct msghdr *msg)
 {
-    u64 pid_tgid = bpf_get_current_pid_tgid();
-    struct msghdr **msgpp = bpf_map_lookup_elem(&udpmsg, &pid_tgid);
-    if (msgpp == 0)
-        return 0;
     // Here are some information about msghdr:
     // @Reference: https://www.cnblogs.com/wanpengcoder/p/11749287.html
     // Shortly, the information that we need is in msghdr->msg_iter which
@@ -161,10 +307,11 @@ int BPF_KRETPROBE(kretprobe_udp_recvmsg)
     // @Reference: https://github.com/iovisor/bcc/issues/3859
     //
     // By the way this struct(msghdr) is defined in socket.h
-    struct msghdr *msg = (struct msghdr *)*msgpp;
     // Check the msghdr length
     // issue #39 BUG fix:
     // due to wrong usage of READ_KERN
+    // the dns sockets only, see udp_recvmsg_interested
+    hook_stats_add(UDP_RECVMSG, entered, 1);
     int ret = 0;
     struct iov_iter msg_iter = {};
     struct iovec iov;
@@ -172,10 +319,10 @@ int BPF_KRETPROBE(kretprobe_udp_recvmsg)
     msg_iter = READ_KERN(msg->msg_iter);
     ret = bpf_probe_read(&iov, sizeof(iov), msg_iter.iov);
     if (ret != 0)
-        goto delete;
+        return 0;
     unsigned long iov_len = iov.iov_len;
     if (iov_len < 20)
-        goto delete;
+        return 0;
     // truncated here, do not drop, as in dns
     if (iov_len > 512)
         iov_len = 512;
@@ -185,7 +332,7 @@ int BPF_KRETPROBE(kretprobe_udp_recvmsg)
     // QR equals 1 means is a response, so it's what we need
     buf_t *string_p = get_buf(STRING_BUF_IDX);
     if (string_p == NULL)
-        goto delete;
+        return 0;
     bpf_probe_read_user(&(string_p->buf[0]), iov_len & (512), iov.iov_base);
     // The data structure of dns is here...
     // |SessionID(2 bytes)|Flags(2 bytes)|Data(8 bytes)|Querys...|
@@ -193,12 +340,16 @@ int BPF_KRETPROBE(kretprobe_udp_recvmsg)
     int qr = (string_p->buf[2] & 0x80) ? 1 : 0;
     if (qr == 1)
     {
+        if (prefilter_counted(UDP_RECVMSG))
+            return 0;
         event_data_t data = {};
         if (!init_event_data(&data, ctx))
             return 0;
+        data.context.type = UDP_RECVMSG;
         if (context_filter(&data.context))
             return 0;
-        data.context.type = UDP_RECVMSG;
+        if (rate_limit_check(UDP_RECVMSG, data.context.cgroup_id))
+            return 0;
 
         int opcode = (string_p->buf[2] >> 3) & 0x0f;
         int rcode = string_p->buf[3] & 0x0f;
@@ -248,10 +399,32 @@ int BPF_KRETPROBE(kretprobe_udp_recvmsg)
 
         save_str_to_buf(&data, (void *)&string_p->buf[13], 1);
         // get exe from task
-        void *exe = get_exe_from_task(data.task);
-        save_str_to_buf(&data, exe, 1);
+        save_exe_to_buf(&data, data.task, 1);
         events_perf_submit(&data);
     }
-    delete : bpf_map_delete_elem(&udpmsg, &pid_tgid);
     return 0;
 }
+
+SEC("kretprobe/udp_recvmsg")
+int BPF_KRETPROBE(kretprobe_udp_recvmsg)
+{
+    u64 pid_tgid = bpf_get_current_pid_tgid();
+    struct msghdr **msgpp = bpf_map_lookup_elem(&udpmsg, &pid_tgid);
+    if (msgpp == 0)
+        return 0;
+    TRACE_LATENCY(UDP_RECVMSG, do_udp_recvmsg_ret(ctx, *msgpp));
+    bpf_map_delete_elem(&udpmsg, &pid_tgid);
+    return 0;
+}
+
+#ifdef CORE
+// fexit sees the arguments along with the return, the msghdr is still
+// valid here, so there is no need for the udpmsg handoff.
+SEC("fexit/udp_recvmsg")
+int BPF_PROG(fexit_udp_recvmsg, struct sock *sk, struct msghdr *msg)
+{
+    if (udp_recvmsg_interested(sk, msg))
+        TRACE_LATENCY(UDP_RECVMSG, do_udp_recvmsg_ret(ctx, msg));
+    return 0;
+}
+#endif
@@ -9,22 +9,23 @@
 #include "define.h"
 #include "utils_buf.h"
 #include "utils.h"
+#include "schema.h"
 #include "bpf_helpers.h"
 #include "bpf_core_read.h"
 #include "bpf_tracing.h"
 
 // Detection of privilege escalation
-SEC("kprobe/commit_creds")
-int BPF_KPROBE(kprobe_commit_creds)
+static __always_inline int do_commit_creds(void *ctx, struct cred *new)
 {
+    if (prefilter(COMMIT_CREDS))
+        return 0;
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = COMMIT_CREDS;
     if (context_filter(&data.context))
         return 0;
-    data.context.type = COMMIT_CREDS;
 
-    struct cred *new = (struct cred *)PT_REGS_PARM1(ctx);
     struct cred *old = (struct cred *)get_task_real_cred(data.task);
 
     unsigned int new_uid = READ_KERN(new->uid.val);
@@ -34,13 +35,29 @@ int BPF_KPROBE(kprobe_commit_creds)
     // But in tracee, any uid changes will lead to detection of this
     if (new_uid == 0 && old_uid != 0)
     {
-        save_to_submit_buf(&data, &new_uid, sizeof(unsigned int), 0);
-        save_to_submit_buf(&data, &old_uid, sizeof(unsigned int), 1);
-        void *exe = get_exe_from_task(data.task);
-        save_str_to_buf(&data, exe, 2);
-        save_pid_tree_to_buf(&data, 12, 3);
+        if (rate_limit_check(COMMIT_CREDS, data.context.cgroup_id))
+            return 0;
+        emit_commit_creds_new_uid(&data, new_uid);
+        emit_commit_creds_old_uid(&data, old_uid);
+        emit_commit_creds_exe(&data, data.task);
+        emit_commit_creds_pid_tree(&data, 12);
         events_perf_submit(&data);
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
+
+SEC("kprobe/commit_creds")
+int BPF_KPROBE(kprobe_commit_creds)
+{
+    return TRACE_LATENCY(COMMIT_CREDS, do_commit_creds(ctx, (struct cred *)PT_REGS_PARM1(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/commit_creds")
+int BPF_PROG(fentry_commit_creds, struct cred *new)
+{
+    TRACE_LATENCY(COMMIT_CREDS, do_commit_creds(ctx, new));
+    return 0;
+}
+#endif
@@ -20,6 +20,7 @@
 #include "define.h"
 #include "utils_buf.h"
 #include "utils.h"
+#include "schema.h"
 #include "bpf_helpers.h"
 #include "bpf_core_read.h"
 #include "bpf_tracing.h"
@@ -44,32 +45,48 @@
 // Firstly, do_init_module is the thing that we need. Any mod that loaded should
 // be monitored.
 // Reptile captured, "modname":"reptile"
-SEC("kprobe/do_init_module")
-int BPF_KPROBE(kprobe_do_init_module)
+static __always_inline int do_do_init_module(void *ctx, struct module *mod)
 {
+    // not filtered, the rootkit hooks are rare and never be missed
+    hook_stats_add(DO_INIT_MODULE, entered, 1);
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
     data.context.type = DO_INIT_MODULE;
 
-    struct module *mod = (struct module *)PT_REGS_PARM1(ctx);
-    char *modname = NULL;
-    bpf_probe_read_str(&modname, 64 - sizeof(unsigned long), &mod->name);
-    save_str_to_buf(&data, &modname, 0);
+    // mod->name is MODULE_NAME_LEN, read it onto the stack rather than
+    // into a pointer
+    char modname[64 - sizeof(unsigned long)] = {};
+    bpf_probe_read_str(&modname, sizeof(modname), &mod->name);
+    emit_do_init_module_modname(&data, modname);
 
     // get exe from task
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 1);
-    save_pid_tree_to_buf(&data, 12, 2);
+    emit_do_init_module_exe(&data, data.task);
+    emit_do_init_module_pid_tree(&data, 12);
     // save file from current task->fs->pwd
     struct fs_struct *file = get_task_fs(data.task);
     if (file == NULL)
         return 0;
     void *file_path = get_path_str(GET_FIELD_ADDR(file->pwd));
-    save_str_to_buf(&data, file_path, 1);
+    emit_do_init_module_cwd(&data, file_path);
     return events_perf_submit(&data);
 }
 
+SEC("kprobe/do_init_module")
+int BPF_KPROBE(kprobe_do_init_module)
+{
+    return TRACE_LATENCY(DO_INIT_MODULE, do_do_init_module(ctx, (struct module *)PT_REGS_PARM1(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/do_init_module")
+int BPF_PROG(fentry_do_init_module, struct module *mod)
+{
+    TRACE_LATENCY(DO_INIT_MODULE, do_do_init_module(ctx, mod));
+    return 0;
+}
+#endif
+
 /*
  * @kernel_read_file:
  *	Read a file specified by userspace.
@@ -82,52 +99,75 @@ int BPF_KPROBE(kprobe_do_init_module)
 // In datadog, security_kernel_module_from_file is hooked. But it seems not
 // work since it's been removed in kernel version 4.6...
 // security_kernel_read_file seems stable and is used by tracee
-SEC("kprobe/security_kernel_read_file")
-int BPF_KPROBE(kprobe_security_kernel_read_file)
+static __always_inline int do_security_kernel_read_file(void *ctx, struct file *file, enum kernel_read_file_id type_id)
 {
+    hook_stats_add(SECURITY_KERNEL_READ_FILE, entered, 1);
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
     data.context.type = SECURITY_KERNEL_READ_FILE;
     // get the file
-    struct file *file = (struct file *)PT_REGS_PARM1(ctx);
     void *file_path = get_path_str(GET_FIELD_ADDR(file->f_path));
-    save_str_to_buf(&data, file_path, 0);
+    emit_kernel_read_file_filename(&data, file_path);
 
     // get the id
-    enum kernel_read_file_id type_id = (enum kernel_read_file_id)PT_REGS_PARM2(ctx);
-    save_to_submit_buf(&data, &type_id, sizeof(int), 1);
+    emit_kernel_read_file_type_id(&data, type_id);
     return events_perf_submit(&data);
 }
 
+SEC("kprobe/security_kernel_read_file")
+int BPF_KPROBE(kprobe_security_kernel_read_file)
+{
+    return TRACE_LATENCY(SECURITY_KERNEL_READ_FILE, do_security_kernel_read_file(ctx, (struct file *)PT_REGS_PARM1(ctx), (enum kernel_read_file_id)PT_REGS_PARM2(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/security_kernel_read_file")
+int BPF_PROG(fentry_security_kernel_read_file, struct file *file, enum kernel_read_file_id type_id)
+{
+    TRACE_LATENCY(SECURITY_KERNEL_READ_FILE, do_security_kernel_read_file(ctx, file, type_id));
+    return 0;
+}
+#endif
+
 // Add rootkit detection just like in Elkeid.
 // Reptile captured when loaded
 // "path":"/bin/bash","argv":"/bin/bash -c /reptile/reptile_start"
-SEC("kprobe/call_usermodehelper")
-int BPF_KPROBE(kprobe_call_usermodehelper)
+static __always_inline int do_call_usermodehelper(void *ctx, const char *path, char **argv, char **envp, int wait)
 {
+    hook_stats_add(CALL_USERMODEHELPER, entered, 1);
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
     data.context.type = CALL_USERMODEHELPER;
-    void *path = (void *)PT_REGS_PARM1(ctx);
-    save_str_to_buf(&data, path, 0);
-    unsigned long argv = PT_REGS_PARM2(ctx);
-    save_str_arr_to_buf(&data, (const char *const *)argv, 1);
-    unsigned long envp = PT_REGS_PARM3(ctx);
+    emit_call_usermodehelper_path(&data, (void *)path);
+    emit_call_usermodehelper_argv(&data, (const char *const *)argv);
     // Think twice about this.
     // I do not use `save_envp_to_buf` here, since there is not that much
     // call_usermodehelper called... And since it's very important, it's
     // good to just get them all.
-    save_str_arr_to_buf(&data, (const char *const *)envp, 2);
-    int wait = PT_REGS_PARM4(ctx);
-    save_to_submit_buf(&data, (void *)&wait, sizeof(int), 3);
+    emit_call_usermodehelper_envp(&data, (const char *const *)envp);
+    emit_call_usermodehelper_wait(&data, wait);
     // Think twice
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 4);
+    emit_call_usermodehelper_exe(&data, data.task);
     return events_perf_submit(&data);
 }
 
+SEC("kprobe/call_usermodehelper")
+int BPF_KPROBE(kprobe_call_usermodehelper)
+{
+    return TRACE_LATENCY(CALL_USERMODEHELPER, do_call_usermodehelper(ctx, (const char *)PT_REGS_PARM1(ctx), (char **)PT_REGS_PARM2(ctx), (char **)PT_REGS_PARM3(ctx), (int)PT_REGS_PARM4(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/call_usermodehelper")
+int BPF_PROG(fentry_call_usermodehelper, const char *path, char **argv, char **envp, int wait)
+{
+    TRACE_LATENCY(CALL_USERMODEHELPER, do_call_usermodehelper(ctx, path, argv, envp, wait));
+    return 0;
+}
+#endif
+
 // For Hidden Rootkit. It's interestring in Elkeid, let's learn firstly.
 // In Elkeid, it's in anti_rootkit file, function `find_hidden_module`
 // This reference: (https://www.cnblogs.com/LoyenWang/p/13334196.html)
@@ -359,8 +399,8 @@ int trigger_module_scan(struct pt_regs *ctx)
         count++;
     }
     
-    save_to_submit_buf(&data, &out, sizeof(u32), 0);
-    save_to_submit_buf(&data, &count, sizeof(u32), 1);
+    emit_anti_rkt_module_iter_count(&data, out);
+    emit_anti_rkt_module_kernel_count(&data, count);
     return events_perf_submit(&data);
 }
 
@@ -463,10 +503,11 @@ int trigger_module_scan(struct pt_regs *ctx)
  * Warning: This function is under full test, PERFORMANCE IS UNKNOWN
  * from tracee. filldir
  */
-SEC("kprobe/security_file_permission")
-int BPF_KPROBE(kprobe_security_file_permission)
+static __always_inline int do_security_file_permission(void *ctx, struct file *file)
 {
-    struct file *file = (struct file *) PT_REGS_PARM1(ctx);
+    // it's one of the hottest hooks, every read/write on the host. The
+    // magic test is the cheapest way out, so it's before the prefilter and
+    // the entered of ANTI_RKT_FOPS counts the procfs files only
     if (file == NULL)
         return 0;
     struct inode *f_inode = READ_KERN(file->f_inode);
@@ -476,13 +517,15 @@ int BPF_KPROBE(kprobe_security_file_permission)
     if (s_magic != PROC_SUPER_MAGIC) {
         return 0;
     }
+    if (prefilter(ANTI_RKT_FOPS))
+        return 0;
 
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = ANTI_RKT_FOPS;
     if (context_filter(&data.context))
         return 0;
-    data.context.type = ANTI_RKT_FOPS;
 
     struct file_operations *fops = (struct file_operations *) READ_KERN(f_inode->i_fop);
     if (fops == NULL)
@@ -521,10 +564,29 @@ int BPF_KPROBE(kprobe_security_file_permission)
         }
     }
 
+    if (rate_limit_check(ANTI_RKT_FOPS, data.context.cgroup_id))
+        return 0;
     save_to_submit_buf(&data, &iterate_shared_addr, sizeof(u64), 0);
     save_to_submit_buf(&data, &iterate_addr, sizeof(u64), 1);
     return events_perf_submit(&data);
 }
+
+SEC("kprobe/security_file_permission")
+int BPF_KPROBE(kprobe_security_file_permission)
+{
+    return TRACE_LATENCY(ANTI_RKT_FOPS, do_security_file_permission(ctx, (struct file *)PT_REGS_PARM1(ctx)));
+}
+
+#ifdef CORE
+// security_file_permission is one of the hottest hooks, the trampoline
+// saves the int3 and pt_regs setup of the kprobe in every read/write
+SEC("fentry/security_file_permission")
+int BPF_PROG(fentry_security_file_permission, struct file *file)
+{
+    TRACE_LATENCY(ANTI_RKT_FOPS, do_security_file_permission(ctx, file));
+    return 0;
+}
+#endif
 // 4. net check
 
 // 5. eBPF backdoor(behavior) detection
@@ -552,13 +614,16 @@ int BPF_KPROBE(kprobe_security_file_permission)
 // https://i.blackhat.com/USA21/Wednesday-Handouts/us-21-With-Friends-Like-EBPF-Who-Needs-Enemies.pdf
 // TODO: in ubuntu, sometimes hook failed
 #define EPERM 1
-SEC("kprobe/bpf")
-int BPF_KPROBE(kprobe_sys_bpf)
+static __always_inline int do_sys_bpf(struct pt_regs *ctx)
 {
     // Be careful about access to bpf_map and change value directly
+    // never rate limited, it's the enforcement but not an event
+    if (prefilter(SYS_BPF_DENY))
+        return 0;
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = SYS_BPF_DENY;
     if (context_filter(&data.context))
         return 0;
     if (get_config(DENY_BPF) == 0)
@@ -566,29 +631,35 @@ int BPF_KPROBE(kprobe_sys_bpf)
     return bpf_override_return(ctx, -EPERM);
 }
 
-SEC("kprobe/security_bpf")
-int BPF_KPROBE(kprobe_security_bpf)
+SEC("kprobe/bpf")
+int BPF_KPROBE(kprobe_sys_bpf)
+{
+    return TRACE_LATENCY(SYS_BPF_DENY, do_sys_bpf(ctx));
+}
+
+static __always_inline int do_security_bpf(void *ctx, int cmd, union bpf_attr *attr)
 {
+    if (prefilter(SYS_BPF))
+        return 0;
     event_data_t data = {};
     if (!init_event_data(&data, ctx))
         return 0;
+    data.context.type = SYS_BPF;
     if (context_filter(&data.context))
         return 0;
-    data.context.type = SYS_BPF;
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 0);
+    emit_security_bpf_exe(&data, data.task);
     // command
-    int cmd = PT_REGS_PARM1(ctx);
-    save_to_submit_buf(&data, &cmd, sizeof(int), 1);
+    emit_security_bpf_cmd(&data, cmd);
     switch (cmd) {
     case BPF_PROG_LOAD: {
-        union bpf_attr *attr = (union bpf_attr *)PT_REGS_PARM2(ctx);
         if (attr == NULL)
             return 0;
+        if (rate_limit_check(SYS_BPF, data.context.cgroup_id))
+            return 0;
         char *name = READ_KERN(attr->prog_name);
-        save_str_to_buf(&data, name, 2);
+        emit_security_bpf_prog_name(&data, name);
         u32 type = READ_KERN(attr->prog_type);
-        save_to_submit_buf(&data, &type, sizeof(u32), 3);
+        emit_security_bpf_prog_type(&data, type);
         return events_perf_submit(&data);
     }
     default:
@@ -596,6 +667,21 @@ int BPF_KPROBE(kprobe_security_bpf)
     }
 }
 
+SEC("kprobe/security_bpf")
+int BPF_KPROBE(kprobe_security_bpf)
+{
+    return TRACE_LATENCY(SYS_BPF, do_security_bpf(ctx, (int)PT_REGS_PARM1(ctx), (union bpf_attr *)PT_REGS_PARM2(ctx)));
+}
+
+#ifdef CORE
+SEC("fentry/security_bpf")
+int BPF_PROG(fentry_security_bpf, int cmd, union bpf_attr *attr)
+{
+    TRACE_LATENCY(SYS_BPF, do_security_bpf(ctx, cmd, attr));
+    return 0;
+}
+#endif
+
 // https://blog.csdn.net/dog250/article/details/105465553
 /* Hardcode memory scan
  * How this works? Scan the whole .text section, find anything that
@@ -16,8 +16,7 @@ int uretprobe_bash_readline(struct pt_regs *ctx)
         return 0;
     data.context.type = BASH_READLINE;
     // exe
-    void *exe = get_exe_from_task(data.task);
-    save_str_to_buf(&data, exe, 0);
+    save_exe_to_buf(&data, data.task, 0);
     // line
     void *line = (void *)PT_REGS_RC(ctx);
     save_str_to_buf(&data, line, 1);
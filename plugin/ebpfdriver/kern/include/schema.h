@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * The shared event schema between the kern structs and the Go decoders.
+ *
+ * Both sides are generated from the lists below. The C side gets the field
+ * indexes, one typed emitter per field and the layout asserts of context_t.
+ * The Go side (tools/schemagen, run by go generate in user/decoder and
+ * user/event) gets the context decoder with the same offsets and the field
+ * decoders, which read the fixed-size runs at fixed offsets and skip the
+ * index bytes.
+ *
+ * SCHEMA_CONTEXT(F) => F(kind, field, GoField, offset, size)
+ *     kind is U8, U32, U64 or CHAR, the offset and the size are asserted
+ *     against context_t, so a layout change fails the build here instead
+ *     of being misread in userspace.
+ * SCHEMA_EVENTS(X)  => X(event, GoType), and SCHEMA_<event>(F) for each
+ * SCHEMA_<event>(F) => F(event, kind, field, GoField)
+ *     the index of the field is its position in the list. The event names
+ *     are lower case on purpose, the event types in define.h are macros
+ *     and would be expanded.
+ *
+ * Kinds of the event fields:
+ *     U8 U16 U32 U64 S32 S64 save_to_submit_buf, the value is copied
+ *     STR                    save_str_to_buf, the pointer to the string
+ *     STR_ARR                save_str_arr_to_buf, joined by " " in Go
+ *     EXE                    save_exe_to_buf, the value is the task
+ *     PID_TREE               save_pid_tree_to_buf, the value is the limit
+ *
+ * Run `make generate` after any change of this file.
+ */
+#ifndef __SCHEMA_H
+#define __SCHEMA_H
+
+#include "define.h"
+#include "utils_buf.h"
+#include "utils.h"
+
+#define SCHEMA_CONTEXT_SIZE 96
+
+#define SCHEMA_CONTEXT(F)                                                      \
+    F(U64, ts, Starttime, 0, 8)                                                \
+    F(U64, cgroup_id, CgroupID, 8, 8)                                          \
+    F(U32, pns, Pns, 16, 4)                                                    \
+    F(U32, type, Type, 20, 4)                                                  \
+    F(U32, pid, Pid, 24, 4)                                                    \
+    F(U32, tid, Tid, 28, 4)                                                    \
+    F(U32, uid, Uid, 32, 4)                                                    \
+    F(U32, gid, Gid, 36, 4)                                                    \
+    F(U32, ppid, Ppid, 40, 4)                                                  \
+    F(U32, pgid, Pgid, 44, 4)                                                  \
+    F(U32, sessionid, SessionID, 48, 4)                                        \
+    F(U64, comm_id, CommID, 56, 8)                                             \
+    F(U64, pcomm_id, PCommID, 64, 8)                                           \
+    F(U64, nodename_id, NodenameID, 72, 8)                                     \
+    F(U64, retval, RetVal, 80, 8)                                              \
+    F(U8, argnum, Argnum, 88, 1)
+
+#define SCHEMA_EVENTS(X)                                                       \
+    X(commit_creds, CommitCreds)                                               \
+    X(do_init_module, DoInitModule)                                            \
+    X(kernel_read_file, KernelReadFile)                                        \
+    X(call_usermodehelper, CallUsermodeHelper)                                 \
+    X(security_bpf, SecurityBpf)                                               \
+    X(anti_rkt_module, ModuleScan)                                             \
+    X(sb_mount, SbMount)                                                       \
+    X(inode_rename, InodeRename)                                               \
+    X(inode_link, InodeLink)                                                   \
+    X(ptrace, Ptrace)                                                          \
+    X(memfd_create, MemfdCreate)
+
+#define SCHEMA_commit_creds(F)                                                 \
+    F(commit_creds, U32, new_uid, NewUid)                                      \
+    F(commit_creds, U32, old_uid, OldUid)                                      \
+    F(commit_creds, EXE, exe, Exe)                                             \
+    F(commit_creds, PID_TREE, pid_tree, PidTree)
+
+#define SCHEMA_do_init_module(F)                                               \
+    F(do_init_module, STR, modname, Modname)                                   \
+    F(do_init_module, EXE, exe, Exe)                                           \
+    F(do_init_module, PID_TREE, pid_tree, Pidtree)                             \
+    F(do_init_module, STR, cwd, Cwd)
+
+#define SCHEMA_kernel_read_file(F)                                             \
+    F(kernel_read_file, STR, filename, Filename)                               \
+    F(kernel_read_file, S32, type_id, TypeId)
+
+#define SCHEMA_call_usermodehelper(F)                                          \
+    F(call_usermodehelper, STR, path, Path)                                    \
+    F(call_usermodehelper, STR_ARR, argv, Argv)                                \
+    F(call_usermodehelper, STR_ARR, envp, Envp)                                \
+    F(call_usermodehelper, S32, wait, Wait)                                    \
+    F(call_usermodehelper, EXE, exe, Exe)
+
+#define SCHEMA_security_bpf(F)                                                 \
+    F(security_bpf, EXE, exe, Exe)                                             \
+    F(security_bpf, S32, cmd, Cmd)                                             \
+    F(security_bpf, STR, prog_name, ProgName)                                  \
+    F(security_bpf, U32, prog_type, Type)
+
+#define SCHEMA_anti_rkt_module(F)                                              \
+    F(anti_rkt_module, U32, iter_count, IterCount)                             \
+    F(anti_rkt_module, U32, kernel_count, KernelCount)
+
+#define SCHEMA_sb_mount(F)                                                     \
+    F(sb_mount, STR, dev_name, DevName)                                        \
+    F(sb_mount, STR, path, Path)                                               \
+    F(sb_mount, STR, type, Type)                                               \
+    F(sb_mount, U64, flags, Flags)                                             \
+    F(sb_mount, EXE, exe, Exe)                                                 \
+    F(sb_mount, PID_TREE, pid_tree, PidTree)
+
+#define SCHEMA_inode_rename(F)                                                 \
+    F(inode_rename, STR, old, Old)                                             \
+    F(inode_rename, STR, new, New)
+
+#define SCHEMA_inode_link(F)                                                   \
+    F(inode_link, STR, old, Old)                                               \
+    F(inode_link, STR, new, New)
+
+#define SCHEMA_ptrace(F)                                                       \
+    F(ptrace, EXE, exe, Exe)                                                   \
+    F(ptrace, S64, request, Requests)                                          \
+    F(ptrace, S64, pid, TargetPid)                                             \
+    F(ptrace, U64, addr, Addr)                                                 \
+    F(ptrace, PID_TREE, pid_tree, PidTree)
+
+#define SCHEMA_memfd_create(F)                                                 \
+    F(memfd_create, EXE, exe, Exe)                                             \
+    F(memfd_create, STR, uname, Uname)                                         \
+    F(memfd_create, U32, flags, Flags)
+
+/* context_t layout, the same offsets are used by the Go decoder */
+#define __SCHEMA_CONTEXT_ASSERT(kind, field, gofield, offset, size)            \
+    _Static_assert(__builtin_offsetof(context_t, field) == offset,             \
+                   "context_t." #field " offset");                             \
+    _Static_assert(sizeof(((context_t *)0)->field) == size,                    \
+                   "context_t." #field " size");
+SCHEMA_CONTEXT(__SCHEMA_CONTEXT_ASSERT)
+_Static_assert(sizeof(context_t) == SCHEMA_CONTEXT_SIZE, "context_t size");
+
+/* argument types of the emitters */
+#define __SCHEMA_ARG_U8       __u8
+#define __SCHEMA_ARG_U16      __u16
+#define __SCHEMA_ARG_U32      __u32
+#define __SCHEMA_ARG_U64      __u64
+#define __SCHEMA_ARG_S32      __s32
+#define __SCHEMA_ARG_S64      __s64
+#define __SCHEMA_ARG_STR      void *
+#define __SCHEMA_ARG_STR_ARR  const char *const *
+#define __SCHEMA_ARG_PID_TREE int
+#define __SCHEMA_ARG_EXE      struct task_struct *
+
+#define __SCHEMA_SAVE_VALUE(data, value, index)                                \
+    save_to_submit_buf(data, &value, sizeof(value), index)
+#define __SCHEMA_SAVE_U8       __SCHEMA_SAVE_VALUE
+#define __SCHEMA_SAVE_U16      __SCHEMA_SAVE_VALUE
+#define __SCHEMA_SAVE_U32      __SCHEMA_SAVE_VALUE
+#define __SCHEMA_SAVE_U64      __SCHEMA_SAVE_VALUE
+#define __SCHEMA_SAVE_S32      __SCHEMA_SAVE_VALUE
+#define __SCHEMA_SAVE_S64      __SCHEMA_SAVE_VALUE
+#define __SCHEMA_SAVE_STR      save_str_to_buf
+#define __SCHEMA_SAVE_STR_ARR  save_str_arr_to_buf
+#define __SCHEMA_SAVE_PID_TREE(data, limit, index)                             \
+    save_pid_tree_to_buf(data, limit, index)
+#define __SCHEMA_SAVE_EXE      save_exe_to_buf
+
+/* schema_<event>_<field> is the index of the field */
+#define __SCHEMA_INDEX(event, kind, field, gofield) schema_##event##_##field,
+
+/* emit_<event>_<field>(data, value) saves the field with its index */
+#define __SCHEMA_EMITTER(event, kind, field, gofield)                          \
+    static __always_inline int emit_##event##_##field(                         \
+        event_data_t *data, __SCHEMA_ARG_##kind value)                         \
+    {                                                                          \
+        return __SCHEMA_SAVE_##kind(data, value, schema_##event##_##field);    \
+    }
+
+#define __SCHEMA_DEFINE(event, gotype)                                         \
+    enum { SCHEMA_##event(__SCHEMA_INDEX) };                                   \
+    SCHEMA_##event(__SCHEMA_EMITTER)
+SCHEMA_EVENTS(__SCHEMA_DEFINE)
+
+#endif
@@ -63,19 +63,15 @@ static __always_inline int init_context(context_t *context,
     context->uid = id;
     context->gid = id >> 32;
     id = bpf_get_current_pid_tgid();
-    context->pid = id;
-    context->tid = id >> 32;
+    // the tgid is the pid in userspace
+    context->pid = id >> 32;
+    context->tid = id;
     context->cgroup_id = bpf_get_current_cgroup_id();
-    context->pgid = get_task_pgid(task);
     // namespace information
     // Elkeid - ROOT_PID_NS_INUM = task->nsproxy->pid_ns_for_children->ns.inum;
     // namespace: https://zhuanlan.zhihu.com/p/307864233
     struct nsproxy *nsp = READ_KERN(task->nsproxy);
-    struct uts_namespace *uts_ns = READ_KERN(nsp->uts_ns);
     struct pid_namespace *pid_ns = READ_KERN(nsp->pid_ns_for_children);
-    // nodename
-    bpf_probe_read_str(&context->nodename, sizeof(context->nodename),
-                       &uts_ns->name.nodename);
     // pid_namespace
     context->pns = READ_KERN(pid_ns->ns.inum);
     // For root pid_namespace, it's not that easy in eBPF. The way that we can get pid=1 task
@@ -84,30 +80,130 @@ static __always_inline int init_context(context_t *context,
     // since we used a bounded loop to get the root pid (The NUM 1 pid)
     // Still, I think it's fine if we just get the root pid_namespace from usersapce. I do not
     // catch the reason that Elkeid get this in root.
-    // sessionid
-    bpf_probe_read(&context->sessionid, sizeof(context->sessionid),
-                   &task->sessionid);
-    // This may changed since
-    bpf_probe_read_str(&context->pcomm, sizeof(context->pcomm),
-                       &realparent->comm);
-    bpf_get_current_comm(&context->comm, sizeof(context->comm));
+    // pgid, sessionid, comm, pcomm and nodename are read on output, after
+    // the filters, see output_context
     context->argnum = 0;
     return 0;
 }
 
-// this is kernel space simple filter, also userspace filter will be supported
-// 0 on false & 1 on true
-static __always_inline int context_filter(context_t *context)
+static __always_inline filter_scope_t *get_filter_scope(__u32 type)
 {
-    // ID filter for all
-    if (bpf_map_lookup_elem(&pid_filter, &context->tid) != 0)
-        return 1;
-    if (bpf_map_lookup_elem(&uid_filter, &context->uid) != 0)
+    filter_scope_t *scope = bpf_map_lookup_elem(&filter_scope, &type);
+    if (scope != NULL)
+        return scope;
+    int zero = 0;
+    return bpf_map_lookup_elem(&filter_default, &zero);
+}
+
+// 1 if it's filtered out by the filter in the mode, found is whether the
+// key matches the filter
+#define __filter_match(mode, found)                                            \
+    ((mode) != FILTER_OFF && (!!(found) != ((mode) == FILTER_ALLOW)))
+#define __filter_out(mode, map, key)                                           \
+    __filter_match(mode, bpf_map_lookup_elem(&(map), (key)) != NULL)
+
+/*
+ * rate limit
+ *
+ * A token bucket for every (event type, cgroup), so a container in a tight
+ * exec or connect loop can't flood the buffer and make the events of the
+ * others dropped. The tokens are in 1/NSEC_PER_SEC of an event, so the
+ * refill is elapsed ns * rate without a division in the hot path. The
+ * elapsed is capped by RATE_LIMIT_REFILL, which is computed by userspace. The
+ * buckets are shared by the cpus and updated without a lock, it's only
+ * approximate under contention. The dropped events are counted in the
+ * bucket, and userspace reports them as a summary periodically.
+ */
+#ifndef NSEC_PER_SEC
+#define NSEC_PER_SEC 1000000000ULL
+#endif
+
+static __always_inline int rate_limited(__u32 type, __u64 cgroup_id)
+{
+    __u64 rate = get_config(RATE_LIMIT_RATE);
+    if (rate == 0)
+        return 0;
+    __u64 burst = get_config(RATE_LIMIT_BURST);
+    if (burst == 0)
+        burst = rate;
+    __u64 full = burst * NSEC_PER_SEC;
+    __u64 now = bpf_ktime_get_ns();
+    rate_key_t key = {};
+    key.cgroup_id = cgroup_id;
+    key.type = type;
+    rate_bucket_t *bucket = bpf_map_lookup_elem(&rate_limit, &key);
+    if (bucket == NULL) {
+        rate_bucket_t init = {};
+        init.tokens = full - NSEC_PER_SEC;
+        init.ts = now;
+        bpf_map_update_elem(&rate_limit, &key, &init, BPF_NOEXIST);
+        return 0;
+    }
+    // the ts may be newer if it's refilled by another cpu
+    __u64 elapsed = now > bucket->ts ? now - bucket->ts : 0;
+    // a full refill at most, so it never overflows. It's only divided here
+    // if the userspace hasn't set it yet
+    __u64 refill = get_config(RATE_LIMIT_REFILL);
+    if (refill == 0)
+        refill = full / rate;
+    if (elapsed > refill)
+        elapsed = refill;
+    __u64 tokens = bucket->tokens + elapsed * rate;
+    if (tokens > full)
+        tokens = full;
+    bucket->ts = now;
+    if (tokens < NSEC_PER_SEC) {
+        bucket->tokens = tokens;
+        __sync_fetch_and_add(&bucket->suppressed, 1);
         return 1;
-    if (bpf_map_lookup_elem(&cgroup_id_filter, &context->cgroup_id) != 0)
+    }
+    bucket->tokens = tokens - NSEC_PER_SEC;
+    return 0;
+}
+
+/*
+ * prefilter is the cheap stage of the kernel space filter, it runs before
+ * the context is built and filters by the values from the helpers only, so
+ * the filtered events never pay for the probe reads. The stats of entered
+ * and filtered are counted here. The hooks with their own early returns before the prefilter
+ * count entered by themselves at the entry, and call prefilter_counted.
+ * 0 on false & 1 on true
+ */
+static __always_inline int prefilter_counted(__u32 type)
+{
+    __u32 tgid = bpf_get_current_pid_tgid() >> 32;
+    __u32 uid = bpf_get_current_uid_gid();
+    __u64 cgroup_id = bpf_get_current_cgroup_id();
+    filter_scope_t *scope = get_filter_scope(type);
+    if (tgid == load_constant(CONST_SELF_TGID) ||
+        (scope != NULL && (__filter_out(scope->pid, pid_filter, &tgid) ||
+                           __filter_out(scope->uid, uid_filter, &uid) ||
+                           __filter_out(scope->cgroup_id, cgroup_id_filter, &cgroup_id)))) {
+        hook_stats_add(type, filtered, 1);
         return 1;
-    if (bpf_map_lookup_elem(&cgroup_id_filter, &context->pns) != 0)
+    }
+    return 0;
+}
+
+static __always_inline int prefilter(__u32 type)
+{
+    hook_stats_add(type, entered, 1);
+    return prefilter_counted(type);
+}
+
+/*
+ * rate_limit_check takes the token of the event, and it's called by the hooks
+ * after all of their own filters, right before the record is built. So the
+ * events dropped by the context, path or hook filters never take the tokens
+ * of the real ones, and never show up in the summaries of the suppressed.
+ * 0 on false & 1 on true
+ */
+static __always_inline int rate_limit_check(__u32 type, __u64 cgroup_id)
+{
+    if (rate_limited(type, cgroup_id)) {
+        hook_stats_add(type, limited, 1);
         return 1;
+    }
     return 0;
 }
 
@@ -562,131 +658,456 @@ static __always_inline void *get_fraw_str(u64 num)
     return path;
 }
 
-/* Reference: http://jinke.me/2018-08-23-socket-and-linux-file-system/ */
-static __always_inline int get_socket_info_sub(event_data_t *data,
-                                               struct fdtable *fdt, u8 index)
-{
-    struct socket *socket;
+/*
+ * socket peer index
+ *
+ * The most recent connected remote peer of every process, by the tgid. It's
+ * updated by security_socket_connect and the return of inet_csk_accept for
+ * the stream sockets, so get_socket_info is a lookup for the process and
+ * its ancestors instead of the scans of their fd tables, and the sockets
+ * after the first fds are not missed. The sock is kept with the peer, and
+ * the peer is used only if the sock is still connected to the same port,
+ * so a closed socket is not reported even if its entry is there.
+ * The entries are deleted in sched_process_exit.
+ *
+ * A listener like sshd or nginx accepts the sockets of every session, and
+ * its latest one is not the peer of its descendants. So an accepted peer is
+ * used only if its sock is behind fd 0-2 of the process. And a socket which
+ * is inherited after the connecting process exits has no entry at all, so
+ * the fd 0-2 of every process are checked as the fallback, it's where a
+ * reverse shell puts its socket.
+ */
+typedef struct socket_peer {
     struct sock *sk;
-    struct file **fd;
-    struct file *file;
-    struct path f_path;
-    struct dentry *dentry;
+    __u32 accepted;
+    __u32 pad;
+    union {
+        struct sockaddr_in v4;
+        struct sockaddr_in6 v6;
+    };
+} socket_peer_t;
 
-    u16 family;
-    int state;
-    // 跨 bpf program 做 read 数据传输
-    buf_t *string_p = get_buf(STRING_BUF_IDX);
-    if (string_p == NULL)
-        return -1;
-    // get max fds, but max_fds seems to be way too large than 8
-    unsigned long max_fds;
-    bpf_probe_read(&max_fds, sizeof(max_fds), &fdt->max_fds);
-    fd = (struct file **)READ_KERN(fdt->fd);
-    if (fd == NULL)
+BPF_LRU_HASH(socket_peer, __u32, socket_peer_t, 10240);
+
+// sk is connecting to the address in security_socket_connect
+static __always_inline void socket_peer_connect(struct socket *sock,
+                                                struct sockaddr *address)
+{
+    if (sock == NULL || address == NULL)
+        return;
+    short type = READ_KERN(sock->type);
+    if (type != SOCK_STREAM)
+        return;
+    socket_peer_t peer = {};
+    peer.sk = READ_KERN(sock->sk);
+    sa_family_t family = READ_KERN(address->sa_family);
+    if (family == AF_INET)
+        bpf_probe_read(&peer.v4, sizeof(peer.v4), address);
+    else if (family == AF_INET6)
+        bpf_probe_read(&peer.v6, sizeof(peer.v6), address);
+    else
+        return;
+    __u32 tgid = bpf_get_current_pid_tgid() >> 32;
+    bpf_map_update_elem(&socket_peer, &tgid, &peer, BPF_ANY);
+}
+
+// sk is accepted, the peer is the remote of the sock
+static __always_inline void socket_peer_accept(struct sock *sk)
+{
+    if (sk == NULL)
+        return;
+    socket_peer_t peer = {};
+    peer.sk = sk;
+    peer.accepted = 1;
+    u16 family = READ_KERN(sk->sk_family);
+    if (family == AF_INET) {
+        net_conn_v4_t net_details = {};
+        get_network_details_from_sock_v4(sk, &net_details, 0);
+        get_remote_sockaddr_in_from_network_details(&peer.v4, &net_details, family);
+    } else if (family == AF_INET6) {
+        net_conn_v6_t net_details = {};
+        get_network_details_from_sock_v6(sk, &net_details, 0);
+        get_remote_sockaddr_in6_from_network_details(&peer.v6, &net_details, family);
+    } else {
+        return;
+    }
+    __u32 tgid = bpf_get_current_pid_tgid() >> 32;
+    bpf_map_update_elem(&socket_peer, &tgid, &peer, BPF_ANY);
+}
+
+// the same states as SS_CONNECTING/SS_CONNECTED/SS_DISCONNECTING of the
+// socket, and the port is checked in case the sock is reused
+static __always_inline int socket_peer_valid(socket_peer_t *peer)
+{
+    struct sock *sk = peer->sk;
+    unsigned char state = get_sock_state(sk);
+    if (state != TCP_ESTABLISHED && state != TCP_SYN_SENT &&
+        state != TCP_CLOSE_WAIT)
         return 0;
-// unroll since unbounded loop is not supported < kernel version 5.3
+    struct inet_sock *inet = (struct inet_sock *)sk;
+    // sin6_port is at the same offset
+    return READ_KERN(inet->inet_dport) == peer->v4.sin_port;
+}
+
+// the sock of the first connected socket behind fd 0-2 of the task, NULL
+// if there is none
+static __always_inline struct sock *get_std_sock(struct task_struct *task)
+{
+    struct files_struct *files = READ_KERN(task->files);
+    if (files == NULL)
+        return NULL;
+    struct fdtable *fdt = READ_KERN(files->fdt);
+    if (fdt == NULL)
+        return NULL;
+    struct file **fd = (struct file **)READ_KERN(fdt->fd);
+    if (fd == NULL)
+        return NULL;
 #pragma unroll
-    for (int i = 0; i < 8; i++) {
-        if (i == max_fds)
-            break;
-        file = (struct file *)READ_KERN(fd[i]);
-        if (!file)
+    for (int i = 0; i < 3; i++) {
+        struct file *file = (struct file *)READ_KERN(fd[i]);
+        if (file == NULL)
             continue;
-        bpf_probe_read(&f_path, sizeof(struct path), &file->f_path);
-        dentry = f_path.dentry;
-        // change to magic, maybe better since their is no string comparison
-        struct super_block *d_sb = READ_KERN(dentry->d_sb);
-        if (d_sb != 0) {
-            unsigned long s_magic = READ_KERN(d_sb->s_magic);
-            if (s_magic == SOCKFS_MAGIC) {
-                socket = READ_KERN(file->private_data);
-                if (socket == NULL)
-                    continue;
-                state = READ_KERN(socket->state);
-                if (state != SS_CONNECTING && state != SS_CONNECTED &&
-                    state != SS_DISCONNECTING)
-                    continue;
-                sk = READ_KERN(socket->sk);
-                if (!sk)
-                    continue;
-                family = READ_KERN(sk->sk_family);
-                if (family == AF_INET) {
-                    net_conn_v4_t net_details = {};
-                    struct sockaddr_in remote;
-                    get_network_details_from_sock_v4(sk, &net_details, 0);
-                    get_remote_sockaddr_in_from_network_details(
-                            &remote, (void *)&net_details, family);
-                    save_to_submit_buf(data, &remote,
-                                       sizeof(struct sockaddr_in), index);
-                    return 1;
-                } else if (family == AF_INET6) {
-                    net_conn_v6_t net_details = {};
-                    struct sockaddr_in6 remote;
-                    get_network_details_from_sock_v6(sk, &net_details, 0);
-                    get_remote_sockaddr_in6_from_network_details(
-                            &remote, &net_details, family);
-                    save_to_submit_buf(data, &remote,
-                                       sizeof(struct sockaddr_in6), index);
-                    return 1;
-                }
-            }
-        }
+        struct inode *f_inode = READ_KERN(file->f_inode);
+        struct super_block *i_sb = READ_KERN(f_inode->i_sb);
+        if (READ_KERN(i_sb->s_magic) != SOCKFS_MAGIC)
+            continue;
+        struct socket *socket = READ_KERN(file->private_data);
+        if (socket == NULL)
+            continue;
+        int state = READ_KERN(socket->state);
+        if (state != SS_CONNECTING && state != SS_CONNECTED &&
+            state != SS_DISCONNECTING)
+            continue;
+        struct sock *sk = READ_KERN(socket->sk);
+        if (sk != NULL)
+            return sk;
+    }
+    return NULL;
+}
+
+// 1 if the remote peer of sk is saved
+static __always_inline int save_sock_peer(event_data_t *data, struct sock *sk,
+                                          u8 index)
+{
+    u16 family = READ_KERN(sk->sk_family);
+    if (family == AF_INET) {
+        net_conn_v4_t net_details = {};
+        struct sockaddr_in remote = {};
+        get_network_details_from_sock_v4(sk, &net_details, 0);
+        get_remote_sockaddr_in_from_network_details(&remote, &net_details, family);
+        save_to_submit_buf(data, &remote, sizeof(struct sockaddr_in), index);
+        return 1;
+    } else if (family == AF_INET6) {
+        net_conn_v6_t net_details = {};
+        struct sockaddr_in6 remote = {};
+        get_network_details_from_sock_v6(sk, &net_details, 0);
+        get_remote_sockaddr_in6_from_network_details(&remote, &net_details, family);
+        save_to_submit_buf(data, &remote, sizeof(struct sockaddr_in6), index);
+        return 1;
     }
     return 0;
 }
 
-/* get socket information by going though the process tree
- * only process known states: SS_CONNECTING/SS_CONNECTED/SS_DISCONNECTING,
- * SS_FREE/SS_UNCONNECTED or any possible new states are to be skipped */
+/* get socket information by going though the process tree. For every
+ * process, the peer in the socket peer index is saved if it's still valid,
+ * an accepted one only if its sock is behind fd 0-2. Or the peer of the
+ * socket behind fd 0-2 is saved. The tgid of the process is returned, 0 if
+ * it's not found */
 static __always_inline __u32 get_socket_info(event_data_t *data, u8 index)
 {
-    struct sockaddr_in remote;
-    struct files_struct *files = NULL;
-    struct fdtable *fdt = NULL;
-
+    struct sockaddr_in remote = {};
     struct task_struct *task = (struct task_struct *)bpf_get_current_task();
     if (task == NULL)
         goto exit;
-    __u32 pid;
-    int flag;
+    __u32 tgid;
 #pragma unroll
     for (int i = 0; i < 4; i++) {
-        pid = READ_KERN(task->pid);
+        tgid = READ_KERN(task->tgid);
         // 0 for failed...
-        if (pid == 1)
+        if (tgid == 0 || tgid == 1)
             break;
-        // get files
-        files = (struct files_struct *)READ_KERN(task->files);
-        if (files == NULL)
-            goto next_task;
-        // get fdtable
-        fdt = (struct fdtable *)READ_KERN(files->fdt);
-        if (fdt == NULL)
-            goto next_task;
-        // find out
-        flag = get_socket_info_sub(data, fdt, index);
-        if (flag == 1)
-            return pid;
-    next_task:
+        struct sock *sk = get_std_sock(task);
+        socket_peer_t *peer = bpf_map_lookup_elem(&socket_peer, &tgid);
+        if (peer != NULL && (!peer->accepted || peer->sk == sk) &&
+            socket_peer_valid(peer)) {
+            if (peer->v4.sin_family == AF_INET6)
+                save_to_submit_buf(data, &peer->v6, sizeof(struct sockaddr_in6), index);
+            else
+                save_to_submit_buf(data, &peer->v4, sizeof(struct sockaddr_in), index);
+            return tgid;
+        }
+        if (sk != NULL && save_sock_peer(data, sk, index))
+            return tgid;
         task = READ_KERN(task->real_parent);
     }
 exit:
-    remote.sin_family = 0;
-    remote.sin_port = 0;
-    remote.sin_addr.s_addr = 0;
     save_to_submit_buf(data, &remote, sizeof(struct sockaddr_in), index);
     return 0;
 }
 
+/*
+ * exe path cache
+ *
+ * get_path_str walks up to 16 dentries with dozens of probe reads, and it's
+ * done in almost every hook by get_exe_from_task. Since most of the events
+ * come from the same few hundred binaries, the resolved path is cached by
+ * the inode of mm->exe_file. The vfsmount and the dentry are kept in the
+ * value, an entry resolved by another mount or another hard link is not
+ * valid and it's resolved again.
+ *
+ * The inode is known in the rename/unlink hooks, so the entry is deleted
+ * right there and nothing can evict the invalidation. A rename of a
+ * directory changes the path of everything below it, but the entries below
+ * it can't be found from the directory. The ancestors of the cached exes are
+ * marked in exe_path_dirs instead, and only the rename of a marked directory
+ * invalidates all entries by the epoch. If exe_path_dirs is full, every
+ * directory rename does.
+ */
+struct exe_path_key {
+    __u64 ino;
+    __u32 dev;
+    __u32 gen;
+};
+
+struct exe_path_value {
+    __u64 ts;
+    __u64 mnt;
+    __u64 dentry;
+    // the verdict of path_filter, valid if filter_gen is PATH_FILTER_GEN
+    __u32 filter_gen;
+    __u32 filtered;
+    char path[MAX_STRING_SIZE];
+};
+
+struct exe_dir_key {
+    __u64 ino;
+    __u32 dev;
+    __u32 pad;
+};
+
+#ifndef EEXIST
+#define EEXIST 17
+#endif
+
+struct exe_path_state {
+    __u64 epoch;
+    __u32 dirs_full;
+    __u32 pad;
+};
+
+BPF_LRU_HASH(exe_path_cache, struct exe_path_key, struct exe_path_value, 4096);
+BPF_HASH(exe_path_dirs, struct exe_dir_key, __u32, 4096);
+BPF_ARRAY(exe_path_state, struct exe_path_state, 1);
+BPF_PERCPU_ARRAY(exe_path_scratch, struct exe_path_value, 1);
+
+static __always_inline int exe_path_valid(struct exe_path_value *value,
+                                          struct path *p)
+{
+    if (value->mnt != (__u64)p->mnt || value->dentry != (__u64)p->dentry)
+        return 0;
+    int zero = 0;
+    struct exe_path_state *state = bpf_map_lookup_elem(&exe_path_state, &zero);
+    if (state != NULL && state->epoch >= value->ts)
+        return 0;
+    return 1;
+}
+
+// mark the ancestors of the exe, crossing the mounts like get_path_str
+static __always_inline void exe_path_mark_dirs(struct path *p)
+{
+    struct dentry *dentry = p->dentry;
+    struct vfsmount *vfsmnt = p->mnt;
+    struct mount *mnt_p = real_mount(vfsmnt);
+    struct mount *mnt_parent_p;
+    bpf_probe_read(&mnt_parent_p, sizeof(struct mount *), &mnt_p->mnt_parent);
+    struct dentry *mnt_root;
+    struct dentry *d_parent;
+    struct exe_dir_key dkey = {};
+    __u32 one = 1;
+    int zero = 0;
+
+#pragma unroll
+    for (int i = 0; i < MAX_PATH_COMPONENTS; i++) {
+        mnt_root = READ_KERN(vfsmnt->mnt_root);
+        d_parent = READ_KERN(dentry->d_parent);
+        if (dentry == mnt_root || dentry == d_parent) {
+            if (dentry != mnt_root || mnt_p == mnt_parent_p)
+                break;
+            bpf_probe_read(&dentry, sizeof(struct dentry *),
+                           &mnt_p->mnt_mountpoint);
+            bpf_probe_read(&mnt_p, sizeof(struct mount *),
+                           &mnt_p->mnt_parent);
+            bpf_probe_read(&mnt_parent_p, sizeof(struct mount *),
+                           &mnt_p->mnt_parent);
+            vfsmnt = &mnt_p->mnt;
+            continue;
+        }
+        struct inode *inode = READ_KERN(d_parent->d_inode);
+        struct super_block *sb = READ_KERN(inode->i_sb);
+        dkey.ino = READ_KERN(inode->i_ino);
+        dkey.dev = READ_KERN(sb->s_dev);
+        // -EEXIST if it's marked already, anything else means it's full
+        int ret = bpf_map_update_elem(&exe_path_dirs, &dkey, &one, BPF_NOEXIST);
+        if (ret != 0 && ret != -EEXIST) {
+            struct exe_path_state *state =
+                    bpf_map_lookup_elem(&exe_path_state, &zero);
+            if (state != NULL)
+                state->dirs_full = 1;
+            break;
+        }
+        dentry = d_parent;
+    }
+}
+
+/*
+ * path prefix filter
+ *
+ * path_filter is keyed by the FNV-1a hash of the path prefixes, and a prefix
+ * always ends at a component: "/opt/agent" matches "/opt/agent" and
+ * "/opt/agent/bin/x", but not "/opt/agentx". The hash is updated byte by
+ * byte and looked up at every '/' and at the end, so it's one lookup for
+ * each component instead of a string compare for each prefix. Only the
+ * first PATH_FILTER_SCAN bytes are scanned, and userspace rejects the
+ * longer prefixes.
+ *
+ * The exe of the task is checked by context_filter, with the verdict cached
+ * in the exe path cache, so it's hashed once for every resolved exe and
+ * again only after path_filter changes. The file paths of the file events
+ * are checked by file_filter after get_path_str.
+ */
+#define PATH_FILTER_SCAN 64
+
+// FNV-1a, for the intern ids and path_filter
+#define INTERN_FNV_OFFSET 0xcbf29ce484222325ULL
+#define INTERN_FNV_PRIME  0x100000001b3ULL
+
+// map is path_filter, or a map of the same scheme
+static __always_inline int path_prefix_match(void *map, void *path)
+{
+    char buf[PATH_FILTER_SCAN];
+    int sz = bpf_probe_read_str(buf, sizeof(buf), path);
+    if (sz <= 1)
+        return 0;
+    __u64 h = INTERN_FNV_OFFSET;
+#pragma unroll
+    for (int i = 0; i < PATH_FILTER_SCAN; i++) {
+        char c = buf[i];
+        if (c == '\0') {
+            // a truncated path doesn't end at a component
+            return sz < PATH_FILTER_SCAN &&
+                   bpf_map_lookup_elem(map, &h) != NULL;
+        }
+        if (c == '/' && i > 0 && bpf_map_lookup_elem(map, &h) != NULL)
+            return 1;
+        h = (h ^ (__u8)c) * INTERN_FNV_PRIME;
+    }
+    return 0;
+}
+
+// whether the filter in the mode needs the verdict of path_filter. An empty
+// path_filter never matches, so only the allow mode needs it then
+static __always_inline int path_filter_active(__u8 mode)
+{
+    if (mode == FILTER_OFF)
+        return 0;
+    return mode == FILTER_ALLOW || get_config(PATH_FILTER_ACTIVE) != 0;
+}
+
+static __always_inline int exe_path_match(struct exe_path_value *value)
+{
+    __u32 gen = get_config(PATH_FILTER_GEN);
+    if (value->filter_gen != gen) {
+        value->filtered = path_prefix_match(&path_filter, value->path);
+        value->filter_gen = gen;
+    }
+    return value->filtered;
+}
+
+// The intern id of the exe is from the cache entry instead of the path, so
+// the path is not hashed in every event. It changes when the path is
+// resolved again, a renamed exe never shares the id of the old path.
+static __always_inline __u64 exe_path_id(struct exe_path_key *key,
+                                         struct exe_path_value *value)
+{
+    __u64 h = INTERN_FNV_OFFSET;
+    h = (h ^ key->ino) * INTERN_FNV_PRIME;
+    h = (h ^ value->mnt) * INTERN_FNV_PRIME;
+    h = (h ^ (((__u64)key->dev << 32) | key->gen)) * INTERN_FNV_PRIME;
+    h = (h ^ value->ts) * INTERN_FNV_PRIME;
+    // 0 is for the strings that are not interned
+    return h ? h : 1;
+}
+
+// ts should be taken before the path is resolved, so a directory rename in
+// between always invalidates this entry. id is set to the intern id of the
+// entry. The verdict of path_filter is set only if it's asked for, and it's
+// returned.
+static __always_inline int exe_path_update(struct exe_path_key *key,
+                                           struct path *p, void *path,
+                                           __u64 ts, __u64 *id, int match)
+{
+    int zero = 0;
+    struct exe_path_value *value =
+            bpf_map_lookup_elem(&exe_path_scratch, &zero);
+    if (value == NULL)
+        return 0;
+    value->ts = ts;
+    value->mnt = (__u64)p->mnt;
+    value->dentry = (__u64)p->dentry;
+    value->filter_gen = 0;
+    value->filtered = 0;
+    if (bpf_probe_read_str(value->path, MAX_STRING_SIZE, path) <= 1)
+        return 0;
+    if (match)
+        exe_path_match(value);
+    exe_path_mark_dirs(p);
+    bpf_map_update_elem(&exe_path_cache, key, value, BPF_ANY);
+    *id = exe_path_id(key, value);
+    return value->filtered;
+}
+
+// called by the rename/unlink hooks, before any filter
+static __always_inline void exe_path_invalidate(struct dentry *dentry)
+{
+    struct inode *inode = READ_KERN(dentry->d_inode);
+    if (inode == NULL)
+        return;
+    struct super_block *sb = READ_KERN(inode->i_sb);
+    umode_t mode = READ_KERN(inode->i_mode);
+    if (S_ISDIR(mode)) {
+        int zero = 0;
+        struct exe_path_state *state =
+                bpf_map_lookup_elem(&exe_path_state, &zero);
+        if (state == NULL)
+            return;
+        struct exe_dir_key dkey = {};
+        dkey.ino = READ_KERN(inode->i_ino);
+        dkey.dev = READ_KERN(sb->s_dev);
+        if (state->dirs_full || bpf_map_lookup_elem(&exe_path_dirs, &dkey) != NULL)
+            state->epoch = bpf_ktime_get_ns();
+        return;
+    }
+    struct exe_path_key key = {};
+    key.ino = READ_KERN(inode->i_ino);
+    key.dev = READ_KERN(sb->s_dev);
+    key.gen = READ_KERN(inode->i_generation);
+    bpf_map_delete_elem(&exe_path_cache, &key);
+}
+
 // it's somehow interesting in Elkeid code(by the good way). it changes from versions
 // to versions. Firstly, kernel version range from 4.1.0 - 5.15.0, `get_mm_exe_file`
 // is used. internal thing about `rcu` will be introduced in my repo(which I would learn)
 // but in bpf, unfortunately, there is no lock we can operate, and no external function
 // we can use as well. So I assume that we can only get the exe from task_struct by no
 // lock, which may be inaccurate in some situtation.
-static __always_inline void *get_exe_from_task(struct task_struct *task)
+// the exe path, and the intern id of the path if it's resolved (0 if not).
+// matched is set to the verdict of path_filter if it's not NULL.
+static __always_inline void *get_exe_path(struct task_struct *task, __u64 *id,
+                                          int *matched)
 {
+    *id = 0;
+    if (matched != NULL)
+        *matched = 0;
     buf_t *string_p = get_buf(STRING_BUF_IDX);
     if (string_p == NULL)
         return NULL;
@@ -701,12 +1122,80 @@ static __always_inline void *get_exe_from_task(struct task_struct *task)
     if (file == NULL)
         return &string_p->buf[0];
     struct path p = READ_KERN(file->f_path);
+    // lookup the cache before walking the dentries
+    struct inode *inode = READ_KERN(file->f_inode);
+    struct super_block *sb = READ_KERN(inode->i_sb);
+    struct exe_path_key key = {};
+    key.ino = READ_KERN(inode->i_ino);
+    key.dev = READ_KERN(sb->s_dev);
+    key.gen = READ_KERN(inode->i_generation);
+    struct exe_path_value *cached = bpf_map_lookup_elem(&exe_path_cache, &key);
+    if (cached != NULL && exe_path_valid(cached, &p)) {
+        *id = exe_path_id(&key, cached);
+        if (matched != NULL)
+            *matched = exe_path_match(cached);
+        return cached->path;
+    }
+    __u64 ts = bpf_ktime_get_ns();
     void *path = get_path_str(GET_FIELD_ADDR(p));
     if (path == NULL)
         return &string_p->buf[0];
+    if (key.ino != 0) {
+        int filtered = exe_path_update(&key, &p, path, ts, id, matched != NULL);
+        if (matched != NULL)
+            *matched = filtered;
+    } else if (matched != NULL) {
+        *matched = path_prefix_match(&path_filter, path);
+    }
     return path;
 }
 
+static __always_inline void *get_exe_from_task(struct task_struct *task)
+{
+    __u64 id;
+    return get_exe_path(task, &id, NULL);
+}
+
+// The rest of the filter which needs the context, it must be after the
+// prefilter of the same type. The exe is resolved for path_filter here, it's
+// from the cache in most cases and it's reused by the exe field.
+// 0 on false & 1 on true
+static __always_inline int context_filter(context_t *context)
+{
+    filter_scope_t *scope = get_filter_scope(context->type);
+    if (scope == NULL)
+        return 0;
+    if (__filter_out(scope->pns, pns_filter, &context->pns))
+        goto filtered;
+    if (path_filter_active(scope->exe)) {
+        __u64 id;
+        int matched;
+        struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+        get_exe_path(task, &id, &matched);
+        if (__filter_match(scope->exe, matched))
+            goto filtered;
+    }
+    return 0;
+filtered:
+    hook_stats_add(context->type, filtered, 1);
+    return 1;
+}
+
+// file_filter checks the file path of the file events by path_filter, the
+// path is from get_path_str or get_dentry_path_str.
+// 0 on false & 1 on true
+static __always_inline int file_filter(context_t *context, void *path)
+{
+    filter_scope_t *scope = get_filter_scope(context->type);
+    if (scope == NULL || path == NULL || !path_filter_active(scope->file))
+        return 0;
+    if (__filter_match(scope->file, path_prefix_match(&path_filter, path))) {
+        hook_stats_add(context->type, filtered, 1);
+        return 1;
+    }
+    return 0;
+}
+
 // In tracee, the field protocol is generate by the function `get_sock_protocol`
 // which differ from kernel version, kinda interestring, let's find out.
 // the sock struct is defined in `net/sock.h`. It's a massive struct, but what
@@ -748,12 +1237,393 @@ static __always_inline u16 get_sock_protocol(struct sock *sock)
     return protocol;
 }
 
-static __always_inline int init_event_data(event_data_t *data, void *ctx)
+// output the record to the ringbuf or the perf_event_array
+static __always_inline int events_output(void *ctx, void *output_data,
+                                         __u32 size)
+{
+#ifdef HAVE_RINGBUF
+    if (load_constant(CONST_RINGBUF))
+        return bpf_ringbuf_output(&exec_events_ringbuf, output_data, size, 0);
+#endif
+    return bpf_perf_event_output(ctx, &exec_events, BPF_F_CURRENT_CPU,
+                                 output_data, size);
+}
+
+/*
+ * compact context header
+ *
+ * Enabled by CONST_COMPACT_HEADER. The header replaces context_t, it's put
+ * at the tail of the context_t slot, right before the fields, so the fields
+ * are written at the same offsets and nothing is moved. It starts with a
+ * fixed prefix, followed by the fields marked in the bitmap in bit order:
+ *
+ *     [u16 present][u16 type][u32 pid][u16 cpu][ ... fields ... ]
+ *
+ * The fields are sent only if they differ from the previous record of the
+ * same stream, and ts is a 32-bit delta to the last full ts of the stream.
+ * A stream is the records of one cpu to one decode worker (pid % the
+ * CONST_INTERN_PARTS), the records of a stream are always in order, and
+ * the worker keeps the state of the stream for every cpu. The state is
+ * updated after the record is output, so a lost record does not break the
+ * stream. nodename and pns are per namespace, they are sent once when the
+ * stream moves to another namespace.
+ */
+#define CONST_COMPACT_HEADER "hades_compact_header"
+
+#define HDR_TS_FULL     (1 << 0)  // u64 ts, a u32 delta if not set
+#define HDR_TID         (1 << 1)  // u32, the same as pid if not set
+#define HDR_CGROUP_ID   (1 << 2)  // u64
+#define HDR_PNS         (1 << 3)  // u32
+#define HDR_UID         (1 << 4)  // u32
+#define HDR_GID         (1 << 5)  // u32
+#define HDR_PPID        (1 << 6)  // u32
+#define HDR_PGID        (1 << 7)  // u32
+#define HDR_SESSIONID   (1 << 8)  // u32
+#define HDR_COMM_ID     (1 << 9)  // u64
+#define HDR_PCOMM_ID    (1 << 10) // u64
+#define HDR_NODENAME_ID (1 << 11) // u64
+#define HDR_RETVAL      (1 << 12) // u64, 0 if not set
+#define HDR_NOSTATE     (1 << 15) // the prefix only, not of any stream
+
+#define HDR_PREFIX_SIZE 10
+// the max of the decode workers in compact mode
+#define HDR_STREAMS     256
+
+typedef struct header_state {
+    __u64 ts; // the last full ts
+    __u64 cgroup_id;
+    __u64 comm_id;
+    __u64 pcomm_id;
+    __u64 nodename_id;
+    __u32 pns;
+    __u32 uid;
+    __u32 gid;
+    __u32 ppid;
+    __u32 pgid;
+    __u32 sessionid;
+} header_state_t;
+
+// the offsets are masked by 127, so the buffer is 256
+typedef struct header_scratch {
+    __u8 buf[256];
+    __u16 present;
+} header_scratch_t;
+
+BPF_PERCPU_ARRAY(header_state, header_state_t, HDR_STREAMS);
+BPF_PERCPU_ARRAY(header_scratch, header_scratch_t, 1);
+
+// the prefix of the header, present is HDR_NOSTATE for the records which
+// are not of any stream
+static __always_inline void compact_prefix(__u8 *dst, __u16 present,
+                                           __u16 type, __u32 pid)
+{
+    __u16 cpu = bpf_get_smp_processor_id();
+    __builtin_memcpy(&dst[0], &present, sizeof(__u16));
+    __builtin_memcpy(&dst[2], &type, sizeof(__u16));
+    __builtin_memcpy(&dst[4], &pid, sizeof(__u32));
+    __builtin_memcpy(&dst[8], &cpu, sizeof(__u16));
+}
+
+#define __HDR_PUT(h, off, value)                                               \
+    do {                                                                       \
+        __builtin_memcpy(&(h)->buf[(off) & 127], &(value), sizeof(value));     \
+        (off) += sizeof(value);                                                \
+    } while (0)
+
+#define __HDR_STATE_FIELD(h, off, c, s, flag, field)                           \
+    do {                                                                       \
+        if ((c)->field != (s)->field) {                                        \
+            (h)->present |= flag;                                              \
+            __HDR_PUT(h, off, (c)->field);                                     \
+        }                                                                      \
+    } while (0)
+
+// compact_header builds the header in h, and returns the size
+static __always_inline __u32 compact_header(context_t *c, header_state_t *s,
+                                            header_scratch_t *h)
+{
+    __u32 off = HDR_PREFIX_SIZE;
+    __u64 delta = c->ts - s->ts;
+    h->present = 0;
+    if (s->ts == 0 || c->ts < s->ts || delta > 0xffffffff) {
+        h->present |= HDR_TS_FULL;
+        __HDR_PUT(h, off, c->ts);
+    } else {
+        __u32 d = delta;
+        __HDR_PUT(h, off, d);
+    }
+    if (c->tid != c->pid) {
+        h->present |= HDR_TID;
+        __HDR_PUT(h, off, c->tid);
+    }
+    __HDR_STATE_FIELD(h, off, c, s, HDR_CGROUP_ID, cgroup_id);
+    __HDR_STATE_FIELD(h, off, c, s, HDR_PNS, pns);
+    __HDR_STATE_FIELD(h, off, c, s, HDR_UID, uid);
+    __HDR_STATE_FIELD(h, off, c, s, HDR_GID, gid);
+    __HDR_STATE_FIELD(h, off, c, s, HDR_PPID, ppid);
+    __HDR_STATE_FIELD(h, off, c, s, HDR_PGID, pgid);
+    __HDR_STATE_FIELD(h, off, c, s, HDR_SESSIONID, sessionid);
+    __HDR_STATE_FIELD(h, off, c, s, HDR_COMM_ID, comm_id);
+    __HDR_STATE_FIELD(h, off, c, s, HDR_PCOMM_ID, pcomm_id);
+    __HDR_STATE_FIELD(h, off, c, s, HDR_NODENAME_ID, nodename_id);
+    if (c->retval != 0) {
+        h->present |= HDR_RETVAL;
+        __HDR_PUT(h, off, c->retval);
+    }
+    compact_prefix(h->buf, h->present, c->type, c->pid);
+    return off;
+}
+
+// the stream is updated only if the record is output
+static __always_inline void compact_header_commit(context_t *c,
+                                                  header_state_t *s,
+                                                  __u16 present)
+{
+    if (present & HDR_TS_FULL)
+        s->ts = c->ts;
+    s->cgroup_id = c->cgroup_id;
+    s->comm_id = c->comm_id;
+    s->pcomm_id = c->pcomm_id;
+    s->nodename_id = c->nodename_id;
+    s->pns = c->pns;
+    s->uid = c->uid;
+    s->gid = c->gid;
+    s->ppid = c->ppid;
+    s->pgid = c->pgid;
+    s->sessionid = c->sessionid;
+}
+
+/*
+ * events_output_compact outputs the submit buffer with the compact header
+ * in place of context_t. size is the size of the record with context_t,
+ * and it's updated to the size that is output.
+ */
+static __always_inline int events_output_compact(event_data_t *data,
+                                                 __u32 *size)
+{
+    __u32 idx = 0;
+    __u32 parts = load_constant(CONST_INTERN_PARTS);
+    if (parts > 1)
+        idx = data->context.pid % parts;
+    idx &= HDR_STREAMS - 1;
+    header_state_t *s = bpf_map_lookup_elem(&header_state, &idx);
+    int zero = 0;
+    header_scratch_t *h = bpf_map_lookup_elem(&header_scratch, &zero);
+    if (s == NULL || h == NULL)
+        return -1;
+    __u32 hlen = compact_header(&data->context, s, h);
+    if (hlen > sizeof(context_t) || *size < sizeof(context_t))
+        return -1;
+    __u32 start = sizeof(context_t) - hlen;
+    bpf_probe_read(&data->submit_p->buf[start & 127], hlen & 127, h->buf);
+    *size -= start;
+    int ret = events_output(data->ctx, &data->submit_p->buf[start & 127],
+                            *size & (MAX_PERCPU_BUFSIZE - 1));
+    if (ret == 0)
+        compact_header_commit(&data->context, s, h->present);
+    return ret;
+}
+
+/*
+ * string interning
+ *
+ * comm, pcomm, nodename and the exe are the same in almost every event, so
+ * they are sent as 64-bit ids. The string is sent once in an INTERN_STRING
+ * record, right before the first event that refers to it. The record has
+ * the same output and the same pid as the event, so it's decoded by the
+ * same worker and before the event.
+ *
+ * Every worker keeps its own dictionary, so intern_sent is keyed by the
+ * worker too, which is pid % CONST_INTERN_PARTS just like the dispatch in
+ * userspace. An id evicted from the LRU is sent again, and an id that the
+ * userspace misses is deleted from intern_sent by the userspace.
+ *
+ * The perf_event_array keeps the order within a cpu only, the record and a
+ * later event on another cpu may be read in any order. Without the ringbuf,
+ * intern_sent is keyed by the cpu as well, so the string is always sent on
+ * the cpu of the event first.
+ *
+ * @structure of the record: [context][0][id][1][size][ ... string ... ]
+ * With the compact header, the context is the prefix only (HDR_NOSTATE).
+ */
+// the offset of the string in the record, after the id and the size
+#define INTERN_STR_OFF     (1 + sizeof(__u64) + 1 + sizeof(int))
+
+struct intern_key {
+    __u64 id;
+    __u32 part;
+    __u32 cpu; // perf_event_array only
+};
+
+typedef struct intern_record {
+    context_t context;
+    __u8 buf[INTERN_STR_OFF + MAX_STRING_SIZE];
+    // the zero padded comm to be hashed by words
+    __u64 words[TASK_COMM_LEN / sizeof(__u64)];
+} intern_record_t;
+
+// the value is the time that the string is sent
+BPF_LRU_HASH(intern_sent, struct intern_key, __u64, 16384);
+BPF_PERCPU_ARRAY(intern_scratch, intern_record_t, 1);
+
+static __always_inline intern_record_t *get_intern_record()
+{
+    int zero = 0;
+    return bpf_map_lookup_elem(&intern_scratch, &zero);
+}
+
+// n is a constant, the loop is unrolled
+static __always_inline __u64 intern_hash(__u64 *words, int n)
+{
+    __u64 h = INTERN_FNV_OFFSET;
+#pragma unroll
+    for (int i = 0; i < TASK_COMM_LEN / sizeof(__u64); i++) {
+        if (i == n)
+            break;
+        h = (h ^ words[i]) * INTERN_FNV_PRIME;
+    }
+    return h ? h : 1;
+}
+
+/*
+ * intern_send sends the string of the id if the worker does not have it,
+ * or it's sent more than ttl ago (0 for never). It returns 0 if the string
+ * is new and failed to send, then the id can not be resolved in userspace.
+ */
+static __always_inline int intern_send(event_data_t *data,
+                                       intern_record_t *r, __u64 id,
+                                       void *str, __u64 ttl)
+{
+    struct intern_key key = {};
+    key.id = id;
+    __u32 parts = load_constant(CONST_INTERN_PARTS);
+    if (parts > 1)
+        key.part = data->context.pid % parts;
+    if (!load_constant(CONST_RINGBUF))
+        key.cpu = bpf_get_smp_processor_id();
+    __u64 *sent = bpf_map_lookup_elem(&intern_sent, &key);
+    if (sent != NULL && (ttl == 0 || (__s64)(data->context.ts - *sent) < ttl))
+        return 1;
+    int sz = bpf_probe_read_str(&r->buf[INTERN_STR_OFF], MAX_STRING_SIZE, str);
+    if (sz <= 0 || sz > MAX_STRING_SIZE)
+        return 0;
+    __builtin_memcpy(&r->context, &data->context, sizeof(context_t));
+    r->context.type = INTERN_STRING;
+    r->context.argnum = 2;
+    r->buf[0] = 0;
+    __builtin_memcpy(&r->buf[1], &id, sizeof(__u64));
+    r->buf[1 + sizeof(__u64)] = 1;
+    __builtin_memcpy(&r->buf[2 + sizeof(__u64)], &sz, sizeof(int));
+    __u8 *start = (__u8 *)r;
+    __u32 size = sizeof(context_t) + INTERN_STR_OFF + sz;
+    if (load_constant(CONST_COMPACT_HEADER)) {
+        start += sizeof(context_t) - HDR_PREFIX_SIZE;
+        size -= sizeof(context_t) - HDR_PREFIX_SIZE;
+        compact_prefix(start, HDR_NOSTATE, INTERN_STRING, data->context.pid);
+    }
+    if (events_output(data->ctx, start, size) != 0) {
+        hook_stats_add(INTERN_STRING, output_failed, 1);
+        return 0;
+    }
+    hook_stats_add(INTERN_STRING, emitted, 1);
+    bpf_map_update_elem(&intern_sent, &key, &data->context.ts, BPF_ANY);
+    return 1;
+}
+
+// intern_words hashes the string in r->words and sends it if it's new
+static __always_inline __u64 intern_words(event_data_t *data,
+                                          intern_record_t *r, int n)
+{
+    __u64 id = intern_hash(r->words, n);
+    intern_send(data, r, id, r->words, 0);
+    __builtin_memset(r->words, 0, sizeof(r->words));
+    return id;
+}
+
+/*
+ * The nodename is per uts namespace, so the id is the inum of the namespace
+ * and the nodename is only read when it's sent. It's sent again after
+ * NODENAME_TTL, since sethostname changes it in place.
+ */
+#define NODENAME_ID_TAG (1ULL << 63)
+#define NODENAME_TTL    (60ULL * 1000000000ULL)
+
+/*
+ * output_context fills the fields that no filter depends on, the ids of
+ * comm, pcomm and nodename, pgid and sessionid. It's called on output, so
+ * nothing is read or hashed for the filtered events.
+ */
+static __always_inline void output_context(event_data_t *data)
+{
+    struct task_struct *task = data->task;
+    data->context.pgid = get_task_pgid(task);
+    bpf_probe_read(&data->context.sessionid, sizeof(data->context.sessionid),
+                   &task->sessionid);
+    intern_record_t *r = get_intern_record();
+    if (r == NULL)
+        return;
+    struct task_struct *realparent = READ_KERN(task->real_parent);
+    // words is zeroed after every use, and the strings are always NUL
+    // terminated within the size
+    bpf_get_current_comm(r->words, TASK_COMM_LEN);
+    data->context.comm_id = intern_words(data, r, TASK_COMM_LEN / sizeof(__u64));
+    bpf_probe_read_str(r->words, TASK_COMM_LEN, &realparent->comm);
+    data->context.pcomm_id = intern_words(data, r, TASK_COMM_LEN / sizeof(__u64));
+    struct nsproxy *nsp = READ_KERN(task->nsproxy);
+    struct uts_namespace *uts_ns = READ_KERN(nsp->uts_ns);
+    __u64 id = NODENAME_ID_TAG | READ_KERN(uts_ns->ns.inum);
+    if (intern_send(data, r, id, &uts_ns->name.nodename, NODENAME_TTL))
+        data->context.nodename_id = id;
+}
+
+/*
+ * intern_exe returns the intern id of the exe, or 0 if the exe path is not
+ * resolved or failed to send, then the exe should be sent as the string.
+ * It's called before the reservation in reserve/commit mode, or the record
+ * of the string would be behind the event.
+ */
+static __always_inline __u64 intern_exe(event_data_t *data,
+                                        struct task_struct *task, void **exe)
+{
+    __u64 id;
+    *exe = get_exe_path(task, &id, NULL);
+    if (id == 0 || *exe == NULL)
+        return 0;
+    intern_record_t *r = get_intern_record();
+    if (r == NULL || !intern_send(data, r, id, *exe, 0))
+        return 0;
+    return id;
+}
+
+/*
+ * @function: save the interned exe to buffer
+ * @structure: [index][id], followed by [index][size][ ... exe ... ] if the
+ * id is 0
+ */
+static __always_inline int save_exe_to_buf(event_data_t *data,
+                                           struct task_struct *task, u8 index)
+{
+    void *exe = NULL;
+    __u64 id = intern_exe(data, task, &exe);
+    if (!save_to_submit_buf(data, &id, sizeof(__u64), index))
+        return 0;
+    if (id == 0)
+        return save_str_to_buf(data, exe, index);
+    return 1;
+}
+
+// init the event without the submit buffer, used by the reserve/commit mode
+static __always_inline void init_event_context(event_data_t *data, void *ctx)
 {
     data->task = (struct task_struct *)bpf_get_current_task();
     init_context(&data->context, data->task);
     data->ctx = ctx;
     data->buf_off = sizeof(context_t);
+}
+
+static __always_inline int init_event_data(event_data_t *data, void *ctx)
+{
+    init_event_context(data, ctx);
     int buf_idx = SUBMIT_BUF_IDX;
     data->submit_p = bpf_map_lookup_elem(&bufs, &buf_idx);
     if (data->submit_p == NULL)
@@ -763,12 +1633,154 @@ static __always_inline int init_event_data(event_data_t *data, void *ctx)
 
 static __always_inline int events_perf_submit(event_data_t *data)
 {
-    bpf_probe_read(&(data->submit_p->buf[0]), sizeof(context_t),
-                   &data->context);
-    int size = data->buf_off & (MAX_PERCPU_BUFSIZE - 1);
-    void *output_data = data->submit_p->buf;
-    return bpf_perf_event_output(data->ctx, &exec_events, BPF_F_CURRENT_CPU,
-                                 output_data, size);
+    output_context(data);
+    __u32 size = data->buf_off & (MAX_PERCPU_BUFSIZE - 1);
+    int ret;
+    if (load_constant(CONST_COMPACT_HEADER)) {
+        ret = events_output_compact(data, &size);
+    } else {
+        bpf_probe_read(&(data->submit_p->buf[0]), sizeof(context_t),
+                       &data->context);
+        ret = events_output(data->ctx, data->submit_p->buf, size);
+    }
+    hook_stats_t *stats = get_hook_stats(data->context.type);
+    if (stats != NULL) {
+        if (ret != 0) {
+            stats->output_failed++;
+        } else {
+            stats->emitted++;
+            stats->bytes += size;
+        }
+    }
+    return ret;
 }
 
+#ifdef HAVE_RINGBUF
+/*
+ * Reserve/commit mode, only available when the ringbuf is enabled.
+ *
+ * Small events are built in place in the ringbuf record instead of the 32KB
+ * per-cpu submit buffer, so the fields are written once and there is no
+ * extra copy on output. The record size is fixed at compile time, it must be
+ * a power of 2 and large enough to hold all the fields of the event. The
+ * record is zeroed right after the reservation, the memory of the ringbuf is
+ * not initialized and the tail after the fields is sent as well.
+ * Since the record is fixed-size, it's not used with the compact header,
+ * the small events are output in the exact size instead.
+ */
+#define RESERVE_BUFSIZE (1 << 9)
+
+typedef struct reserve_buf {
+    __u8 buf[RESERVE_BUFSIZE];
+} reserve_buf_t;
+
+static __always_inline reserve_buf_t *events_reserve(event_data_t *data)
+{
+    // the records of the interned strings go before the reservation
+    output_context(data);
+    reserve_buf_t *r = bpf_ringbuf_reserve(&exec_events_ringbuf,
+                                           sizeof(reserve_buf_t), 0);
+    if (r == NULL) {
+        hook_stats_add(data->context.type, output_failed, 1);
+        return NULL;
+    }
+    // in words, the record is 8-byte aligned
+    __u64 *words = (__u64 *)r->buf;
+#pragma unroll
+    for (int i = 0; i < RESERVE_BUFSIZE / sizeof(__u64); i++)
+        words[i] = 0;
+    return r;
+}
+
+static __always_inline int events_reserve_submit(reserve_buf_t *r,
+                                                 event_data_t *data)
+{
+    bpf_probe_read(&r->buf[0], sizeof(context_t), &data->context);
+    bpf_ringbuf_submit(r, 0);
+    hook_stats_t *stats = get_hook_stats(data->context.type);
+    if (stats != NULL) {
+        stats->emitted++;
+        stats->bytes += sizeof(reserve_buf_t);
+    }
+    return 0;
+}
+
+static __always_inline int events_reserve_discard(reserve_buf_t *r)
+{
+    bpf_ringbuf_discard(r, 0);
+    return 0;
+}
+
+/*
+ * @function: save ptr(struct) to the reserved record
+ * @structure: [index][buffer]
+ * size should be a constant, so the verifier knows the bound of buf_off
+ */
+static __always_inline int reserve_save_to_buf(reserve_buf_t *r,
+                                               event_data_t *data, void *ptr,
+                                               __u32 size, u8 index)
+{
+    __u32 off = data->buf_off;
+    if (size == 0 || size >= RESERVE_BUFSIZE)
+        return 0;
+    if (off > RESERVE_BUFSIZE - 1 - size) {
+        hook_stats_add(data->context.type, truncated, 1);
+        return 0;
+    }
+    r->buf[off & (RESERVE_BUFSIZE - 1)] = index;
+    if (bpf_probe_read(&r->buf[off + 1], size, ptr) != 0)
+        return 0;
+    data->buf_off += size + 1;
+    data->context.argnum++;
+    return 1;
+}
+
+/*
+ * @function: save str to the reserved record
+ * @structure: [index][size][ ... string ... ]
+ */
+static __always_inline int reserve_save_str_to_buf(reserve_buf_t *r,
+                                                   event_data_t *data,
+                                                   void *ptr, u8 index)
+{
+    __u32 off = data->buf_off;
+    if (off > RESERVE_BUFSIZE - MAX_STRING_SIZE - sizeof(int) - 1) {
+        hook_stats_add(data->context.type, truncated, 1);
+        return 0;
+    }
+    r->buf[off & (RESERVE_BUFSIZE - 1)] = index;
+    int sz = bpf_probe_read_str(&r->buf[off + 1 + sizeof(int)],
+                                MAX_STRING_SIZE, ptr);
+    if (sz < 0) {
+        char nothing[] = "-1";
+        sz = bpf_probe_read_str(&r->buf[off + 1 + sizeof(int)],
+                                MAX_STRING_SIZE, nothing);
+    }
+    if (sz <= 0)
+        return 0;
+    __builtin_memcpy(&r->buf[off + 1], &sz, sizeof(int));
+    data->buf_off += sz + sizeof(int) + 1;
+    data->context.argnum++;
+    return 1;
+}
+
+/*
+ * @function: save the interned exe to the reserved record, the id is from
+ * intern_exe before the reservation
+ * @structure: [index][id], followed by [index][size][ ... exe ... ] if the
+ * id is 0
+ */
+static __always_inline int reserve_save_exe_to_buf(reserve_buf_t *r,
+                                                   event_data_t *data,
+                                                   __u64 id, void *exe,
+                                                   u8 index)
+{
+    if (!reserve_save_to_buf(r, data, &id, sizeof(__u64), index))
+        return 0;
+    if (id == 0)
+        return reserve_save_str_to_buf(r, data, exe, index);
+    return 1;
+}
+#endif
+
 #endif //__UTILS_BUF_H
@@ -32,8 +32,10 @@ save_str_arr_to_buf(event_data_t *data, const char __user *const __user *ptr,
         if (!argp)
             goto out;
         if (data->buf_off >
-            (MAX_PERCPU_BUFSIZE) - (MAX_STRING_SIZE) - sizeof(int))
+            (MAX_PERCPU_BUFSIZE) - (MAX_STRING_SIZE) - sizeof(int)) {
+            hook_stats_add(data->context.type, truncated, 1);
             goto out;
+        }
         int sz = bpf_probe_read_str(
                 &(data->submit_p->buf[data->buf_off + sizeof(int)]),
                 MAX_STRING_SIZE, argp);
@@ -109,8 +111,10 @@ static __always_inline int save_str_to_buf(event_data_t *data, void *ptr,
                                            u8 index)
 {
     // check the buf_off, to satisfy bpf verifier. And save index
-    if (data->buf_off > (MAX_PERCPU_BUFSIZE) - (MAX_STRING_SIZE) - sizeof(int))
+    if (data->buf_off > (MAX_PERCPU_BUFSIZE) - (MAX_STRING_SIZE) - sizeof(int)) {
+        hook_stats_add(data->context.type, truncated, 1);
         return 0;
+    }
     data->submit_p->buf[(data->buf_off) & (MAX_PERCPU_BUFSIZE - 1)] = index;
     // Satisfy validator for probe read
     if ((data->buf_off + 1) <=
@@ -139,6 +143,9 @@ static __always_inline int save_str_to_buf(event_data_t *data, void *ptr,
                 return 0;
             __builtin_memcpy(&(data->submit_p->buf[data->buf_off + 1]), &sz,
                              sizeof(int));
+            // the terminating null is counted, it's cut if it reaches max
+            if (sz == MAX_STRING_SIZE)
+                hook_stats_add(data->context.type, truncated, 1);
             data->buf_off += sz + sizeof(int) + 1;
             data->context.argnum++;
             return 1;
@@ -162,8 +169,10 @@ static __always_inline int save_to_submit_buf(event_data_t *data, void *ptr,
         return 0;
 
     // If we don't have enough space - return
-    if (data->buf_off > MAX_PERCPU_BUFSIZE - (size + 1))
+    if (data->buf_off > MAX_PERCPU_BUFSIZE - (size + 1)) {
+        hook_stats_add(data->context.type, truncated, 1);
         return 0;
+    }
 
     // Save argument index
     volatile int buf_off = data->buf_off;
@@ -231,6 +240,139 @@ typedef struct slim_cred {
     gid_t fsgid; // GID for VFS ops
 } slim_cred_t;
 
+// the privilege flag and the creds, shared by both modes of the pid tree
+static __always_inline void save_pid_tree_creds(event_data_t *data,
+                                                u8 privilege_flag,
+                                                struct cred *current_cred,
+                                                struct cred *parent_cred,
+                                                u8 index)
+{
+    // add the logic of privilege escalation
+    data->submit_p->buf[(data->buf_off) & (MAX_PERCPU_BUFSIZE - 1)] =
+            privilege_flag;
+    data->buf_off += 1;
+    if (privilege_flag) {
+        slim_cred_t slim = { 0 };
+        slim.uid = READ_KERN(current_cred->uid.val);
+        slim.gid = READ_KERN(current_cred->gid.val);
+        slim.suid = READ_KERN(current_cred->suid.val);
+        slim.sgid = READ_KERN(current_cred->sgid.val);
+        slim.euid = READ_KERN(current_cred->euid.val);
+        slim.egid = READ_KERN(current_cred->egid.val);
+        slim.fsuid = READ_KERN(current_cred->fsuid.val);
+        slim.fsgid = READ_KERN(current_cred->fsgid.val);
+        // this index maybe misleading...but anyway
+        save_to_submit_buf(data, (void *)&slim, sizeof(slim_cred_t), index);
+        slim.uid = READ_KERN(parent_cred->uid.val);
+        slim.gid = READ_KERN(parent_cred->gid.val);
+        slim.suid = READ_KERN(parent_cred->suid.val);
+        slim.sgid = READ_KERN(parent_cred->sgid.val);
+        slim.euid = READ_KERN(parent_cred->euid.val);
+        slim.egid = READ_KERN(parent_cred->egid.val);
+        slim.fsuid = READ_KERN(parent_cred->fsuid.val);
+        slim.fsgid = READ_KERN(parent_cred->fsgid.val);
+        save_to_submit_buf(data, (void *)&slim, sizeof(slim_cred_t), index);
+    }
+}
+
+/*
+ * Process tree, maintained by the sched_process_fork/exec/exit tracepoints
+ * in hades_exec.h and seeded from /proc by the userspace on start.
+ *
+ * With it, the pid tree can be sent as a list of ancestor pids only, and the
+ * userspace rebuilds the tree (with comm) from its own mirror. No comm is
+ * read in the kernel and the execve event is hundreds of bytes smaller.
+ */
+typedef struct proc_info {
+    __u32 ppid;
+    __u32 pad;
+    __u64 exec_id;
+    __u64 start_time;
+    char comm[TASK_COMM_LEN];
+} proc_info_t;
+
+BPF_LRU_HASH(proc_tree, __u32, proc_info_t, 10240);
+
+#define CONST_PID_TREE_COMPACT "hades_pid_tree_compact"
+// the high bit of the count marks the compact mode for the decoder
+#define PID_TREE_COMPACT_FLAG  0x80
+
+/*
+ * @function: save the ancestor pids to buffer
+ * @structure: [index][count | 0x80][pid1][pid2]...
+ * The privilege flag and the creds are the same as save_pid_tree_to_buf
+ */
+static __always_inline int save_pid_list_to_buf(event_data_t *data, int limit,
+                                                u8 index)
+{
+    u8 elem_num = 0;
+    u8 privilege_flag = 0;
+    __u32 pid;
+
+    struct task_struct *task = data->task;
+    struct cred *current_cred = (struct cred *)READ_KERN(task->real_cred);
+    struct cred *parent_cred = NULL;
+    // only the parent and the grandparent are checked, just like the full
+    // pid tree does
+    struct task_struct *parent = task;
+#pragma unroll
+    for (int i = 1; i < 3; i++) {
+        if (privilege_flag != 0)
+            break;
+        parent = READ_KERN(parent->real_parent);
+        if (parent == NULL)
+            break;
+        parent_cred = (struct cred *)READ_KERN(parent->real_cred);
+        privilege_flag = check_cred(current_cred, parent_cred);
+        current_cred = parent_cred;
+    }
+
+    data->submit_p->buf[(data->buf_off) & (MAX_PERCPU_BUFSIZE - 1)] = index;
+    __u32 orig_off = data->buf_off + 1;
+    data->buf_off += 2;
+    if (limit >= 12)
+        limit = 12;
+    pid = data->context.pid;
+#pragma unroll
+    for (int i = 0; i < 12; i++) {
+        if (i == limit || pid == 0)
+            break;
+        if (data->buf_off > (MAX_PERCPU_BUFSIZE) - sizeof(__u32))
+            break;
+        bpf_probe_read(&(data->submit_p->buf[data->buf_off]), sizeof(__u32),
+                       &pid);
+        data->buf_off += sizeof(__u32);
+        elem_num++;
+        // the parent of current is known, no lookup for this
+        if (i == 0) {
+            pid = data->context.ppid;
+            continue;
+        }
+        proc_info_t *info = bpf_map_lookup_elem(&proc_tree, &pid);
+        if (info == NULL)
+            break;
+        pid = info->ppid;
+    }
+    data->submit_p->buf[orig_off & ((MAX_PERCPU_BUFSIZE)-1)] =
+            elem_num | PID_TREE_COMPACT_FLAG;
+    data->context.argnum++;
+    save_pid_tree_creds(data, privilege_flag, current_cred, parent_cred, index);
+    return 1;
+}
+
+// the placeholder of an empty pid tree, [index][0][privilege_flag 0]
+static __always_inline void save_empty_pid_tree_to_buf(event_data_t *data,
+                                                       u8 index)
+{
+    if (data->buf_off > (MAX_PERCPU_BUFSIZE) - 3)
+        return;
+    data->submit_p->buf[(data->buf_off) & (MAX_PERCPU_BUFSIZE - 1)] = index;
+    data->submit_p->buf[(data->buf_off + 1) & (MAX_PERCPU_BUFSIZE - 1)] = 0;
+    data->submit_p->buf[(data->buf_off + 2) & (MAX_PERCPU_BUFSIZE - 1)] = 0;
+    data->buf_off += 3;
+    data->context.argnum++;
+}
+
 /*
  * @function: save pid_tree to buffer
  * @structure: [index][string count][pid1][str1 size][str1][pid2][str2
@@ -242,6 +384,8 @@ typedef struct slim_cred {
 static __always_inline int save_pid_tree_to_buf(event_data_t *data, int limit,
                                                 u8 index)
 {
+    if (load_constant(CONST_PID_TREE_COMPACT))
+        return save_pid_list_to_buf(data, limit, index);
     u8 elem_num = 0;
     u8 privilege_flag = 0;
     __u32 pid;
@@ -311,52 +455,74 @@ static __always_inline int save_pid_tree_to_buf(event_data_t *data, int limit,
 out:
     data->submit_p->buf[orig_off & ((MAX_PERCPU_BUFSIZE)-1)] = elem_num;
     data->context.argnum++;
-    // add the logic of privilege escalation
-    data->submit_p->buf[(data->buf_off) & (MAX_PERCPU_BUFSIZE - 1)] =
-            privilege_flag;
-    data->buf_off += 1;
-    if (privilege_flag) {
-        slim_cred_t slim = { 0 };
-        slim.uid = READ_KERN(current_cred->uid.val);
-        slim.gid = READ_KERN(current_cred->gid.val);
-        slim.suid = READ_KERN(current_cred->suid.val);
-        slim.sgid = READ_KERN(current_cred->sgid.val);
-        slim.euid = READ_KERN(current_cred->euid.val);
-        slim.egid = READ_KERN(current_cred->egid.val);
-        slim.fsuid = READ_KERN(current_cred->fsuid.val);
-        slim.fsgid = READ_KERN(current_cred->fsgid.val);
-        // this index maybe misleading...but anyway
-        save_to_submit_buf(data, (void *)&slim, sizeof(slim_cred_t), index);
-        slim.uid = READ_KERN(parent_cred->uid.val);
-        slim.gid = READ_KERN(parent_cred->gid.val);
-        slim.suid = READ_KERN(parent_cred->suid.val);
-        slim.sgid = READ_KERN(parent_cred->sgid.val);
-        slim.euid = READ_KERN(parent_cred->euid.val);
-        slim.egid = READ_KERN(parent_cred->egid.val);
-        slim.fsuid = READ_KERN(parent_cred->fsuid.val);
-        slim.fsgid = READ_KERN(parent_cred->fsgid.val);
-        save_to_submit_buf(data, (void *)&slim, sizeof(slim_cred_t), index);
-    }
+    save_pid_tree_creds(data, privilege_flag, current_cred, parent_cred, index);
     return 1;
 }
 
+
 // execve(at) used only
 /* SYSCALL_BUFFER related */
 #define MAX_DATA_PER_SYSCALL 4096
+// argv with the bpf_loop capture, the ceiling of ARGV_BYTES_BUDGET. An
+// element is read up to MAX_ARG_SIZE, the args are padded by it so that a
+// read at any cursor under the ceiling is in bounds for the verifier
+#define MAX_ARGV_PER_SYSCALL (1 << 13)
+#define MAX_ARG_SIZE         4096
 
 struct syscall_buffer {
-    char args[MAX_DATA_PER_SYSCALL];
+    char args[MAX_ARGV_PER_SYSCALL + MAX_ARG_SIZE + sizeof(int)];
     char envp[MAX_DATA_PER_SYSCALL];
     u16 cursor;
     u16 envp_cursor;
+    // of the whole argv for the argv window, 0 if it's not hashed
+    u64 argv_hash;
 };
 
 BPF_HASH(syscall_buffer_cache, u64, struct syscall_buffer, 512);
 struct syscall_buffer syscall_buffer_zero = {};
 
+/*
+ * Task-local storage staging, CO-RE only (kernel 5.11+, both the map and
+ * bpf_get_current_task_btf are required). The buffer lives with the task,
+ * so the memory scales with the live tasks rather than the 512 entries,
+ * and it's only zeroed once when created. The userspace turns the map into
+ * a tiny hash and sets the constant to 0 if it's not supported.
+ */
+#ifdef CORE
+#define CONST_TASK_STORAGE "hades_task_storage"
+
+struct {
+    __uint(type, BPF_MAP_TYPE_TASK_STORAGE);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, int);
+    __type(value, struct syscall_buffer);
+} syscall_buffer_storage SEC(".maps");
+
+static __always_inline struct syscall_buffer *
+get_syscall_buffer_storage(u64 flags)
+{
+    struct task_struct *task = bpf_get_current_task_btf();
+    return bpf_task_storage_get(&syscall_buffer_storage, task, NULL, flags);
+}
+#endif
+
 __attribute__((always_inline)) struct syscall_buffer *
 reset_syscall_buffer_cache(u64 id)
 {
+#ifdef CORE
+    if (load_constant(CONST_TASK_STORAGE)) {
+        struct syscall_buffer *buf =
+                get_syscall_buffer_storage(BPF_LOCAL_STORAGE_GET_F_CREATE);
+        if (buf == NULL)
+            return 0;
+        // no memset here, only the cursors are reset. Stale bytes after the
+        // cursor are never sent
+        buf->cursor = 0;
+        buf->envp_cursor = 0;
+        buf->argv_hash = 0;
+        return buf;
+    }
+#endif
     int ret = bpf_map_update_elem(&syscall_buffer_cache, &id,
                                   &syscall_buffer_zero, BPF_ANY);
     if (ret < 0) {
@@ -369,11 +535,29 @@ reset_syscall_buffer_cache(u64 id)
 __attribute__((always_inline)) struct syscall_buffer *
 get_syscall_buffer_cache(u64 id)
 {
+#ifdef CORE
+    if (load_constant(CONST_TASK_STORAGE)) {
+        struct syscall_buffer *buf = get_syscall_buffer_storage(0);
+        // cursor is at least 1 after it's saved, 0 means consumed
+        if (buf == NULL || buf->cursor == 0)
+            return 0;
+        return buf;
+    }
+#endif
     return bpf_map_lookup_elem(&syscall_buffer_cache, &id);
 }
 
 __attribute__((always_inline)) int delete_syscall_buffer_cache(u64 id)
 {
+#ifdef CORE
+    if (load_constant(CONST_TASK_STORAGE)) {
+        // it's freed with the task, just mark it as consumed
+        struct syscall_buffer *buf = get_syscall_buffer_storage(0);
+        if (buf != NULL)
+            buf->cursor = 0;
+        return 0;
+    }
+#endif
     return bpf_map_delete_elem(&syscall_buffer_cache, &id);
 }
 /* SYSCALL_BUFFER done */
@@ -472,18 +656,167 @@ out:
     return 1;
 }
 
+#ifdef CORE
+/*
+ * bpf_loop version of the argv/envp staging, for kernel 5.17+. The loop body
+ * is a callback which is verified once rather than unrolled 32 times, so the
+ * number of elements is not bounded by the unrolling. It's still bounded by
+ * the budgets in config_map, 4096 bytes and 127 elements if they are not
+ * set. The bytes budget of argv can be raised up to MAX_ARGV_PER_SYSCALL,
+ * and an element of argv is read up to MAX_ARG_SIZE or the rest of the
+ * budget, so the long classpaths are kept. envp only keeps two variables,
+ * it stays in MAX_DATA_PER_SYSCALL and MAX_STRING_SIZE for each element.
+ * The high bit of the count is set if anything is cut by these, or an
+ * element fails to be read.
+ *
+ * The callback is referenced by a BPF_PSEUDO_FUNC load which is rejected by
+ * old kernels even if the code is never reached, so it's only used by the
+ * *_loop programs in hades_exec.h, which are picked by the userspace.
+ */
+#define STR_ARR_TRUNCATED 0x80
+#define STR_ARR_MAX_ELEM  0x7f
+#define STR_ARR_MAX_LOOPS 1024
+
+struct str_arr_loop_ctx {
+    struct syscall_buffer *buf;
+    const char *const *ptr;
+    u32 max_bytes;
+    u32 max_elems;
+    u8 elem_num;
+    u8 truncated;
+    u8 ld_preload_flag;
+};
+
+static __always_inline void
+str_arr_loop_init(struct str_arr_loop_ctx *c, struct syscall_buffer *buf,
+                  const char *const *ptr, u32 max_bytes)
+{
+    c->buf = buf;
+    c->ptr = ptr;
+    c->max_bytes = get_config(ARGV_BYTES_BUDGET);
+    if (c->max_bytes == 0)
+        c->max_bytes = MAX_DATA_PER_SYSCALL;
+    // userspace warns about a budget over the ceiling
+    if (c->max_bytes > max_bytes)
+        c->max_bytes = max_bytes;
+    c->max_elems = get_config(ARGV_ELEMS_BUDGET);
+    if (c->max_elems == 0 || c->max_elems > STR_ARR_MAX_ELEM)
+        c->max_elems = STR_ARR_MAX_ELEM;
+}
+
+static long save_args_loop_cb(u32 i, void *_ctx)
+{
+    struct str_arr_loop_ctx *c = _ctx;
+    struct syscall_buffer *buf = c->buf;
+    const char *argp = NULL;
+    bpf_probe_read(&argp, sizeof(argp), &c->ptr[i]);
+    if (!argp)
+        return 1;
+    u32 cursor = buf->cursor;
+    if (c->elem_num >= c->max_elems || cursor + sizeof(int) >= c->max_bytes ||
+        cursor >= MAX_ARGV_PER_SYSCALL) {
+        c->truncated = 1;
+        return 1;
+    }
+    u32 size = c->max_bytes - cursor - sizeof(int);
+    if (size > MAX_ARG_SIZE)
+        size = MAX_ARG_SIZE;
+    int sz = bpf_probe_read_str(&(buf->args[cursor + sizeof(int)]), size, argp);
+    if (sz <= 0) {
+        c->truncated = 1;
+        return 1;
+    }
+    // a full read may be cut, an element which fits exactly is counted too
+    if (sz == size)
+        c->truncated = 1;
+    __builtin_memcpy(&(buf->args[cursor]), &sz, sizeof(int));
+    buf->cursor = cursor + sz + sizeof(int);
+    c->elem_num++;
+    return 0;
+}
+
+// only SSH_CONNECTION and LD_PRELOAD are kept, just like the unrolled one
+static long save_envp_loop_cb(u32 i, void *_ctx)
+{
+    char ld_preload[] = "LD_PRELO";
+    char ssh_connection[] = "SSH_CONN";
+    struct str_arr_loop_ctx *c = _ctx;
+    struct syscall_buffer *buf = c->buf;
+    const char *argp = NULL;
+    bpf_probe_read(&argp, sizeof(argp), &c->ptr[i]);
+    if (!argp)
+        return 1;
+    u32 cursor = buf->envp_cursor;
+    if (c->elem_num >= c->max_elems || cursor >= c->max_bytes ||
+        cursor > (MAX_DATA_PER_SYSCALL) - (MAX_STRING_SIZE) - sizeof(int)) {
+        c->truncated = 1;
+        return 1;
+    }
+    int sz = bpf_probe_read_str(&(buf->envp[cursor + sizeof(int)]),
+                                MAX_STRING_SIZE, argp);
+    if (sz <= 0) {
+        c->truncated = 1;
+        return 1;
+    }
+    char *env = (char *)&(buf->envp[cursor + sizeof(int)]);
+    if (has_prefix(ssh_connection, env, 9)) {
+        // keep it
+    } else if (c->ld_preload_flag == 0 && has_prefix(ld_preload, env, 9)) {
+        c->ld_preload_flag = 1;
+    } else {
+        return 0;
+    }
+    if (sz == MAX_STRING_SIZE)
+        c->truncated = 1;
+    __builtin_memcpy(&(buf->envp[cursor]), &sz, sizeof(int));
+    buf->envp_cursor = cursor + sz + sizeof(int);
+    c->elem_num++;
+    return 0;
+}
+
+static __always_inline int
+save_args_into_buffer_loop(struct syscall_buffer *buf, const char *const *ptr)
+{
+    struct str_arr_loop_ctx c = {};
+    buf->cursor += 1;
+    if (ptr != NULL) {
+        str_arr_loop_init(&c, buf, ptr, MAX_ARGV_PER_SYSCALL);
+        bpf_loop(STR_ARR_MAX_LOOPS, save_args_loop_cb, &c, 0);
+    }
+    buf->args[0] = c.elem_num | (c.truncated ? STR_ARR_TRUNCATED : 0);
+    return 1;
+}
+
+static __always_inline int
+save_envp_into_buffer_loop(struct syscall_buffer *buf, const char *const *ptr)
+{
+    struct str_arr_loop_ctx c = {};
+    buf->envp_cursor += 1;
+    if (ptr != NULL) {
+        str_arr_loop_init(&c, buf, ptr, MAX_DATA_PER_SYSCALL);
+        bpf_loop(STR_ARR_MAX_LOOPS, save_envp_loop_cb, &c, 0);
+    }
+    buf->envp[0] = c.elem_num | (c.truncated ? STR_ARR_TRUNCATED : 0);
+    return 1;
+}
+#endif
+
 // save argv to buf
 static __always_inline int
 save_argv_to_buf(event_data_t *data, struct syscall_buffer *buf, int index)
 {
-    // read argv str to buf
-    bpf_probe_read(&(data->submit_p->buf[(data->buf_off + 1) &
-                                         ((MAX_PERCPU_BUFSIZE) -
-                                          (MAX_DATA_PER_SYSCALL)-1)]),
-                   MAX_DATA_PER_SYSCALL, buf->args);
+    // the staged bytes only, argv may be up to MAX_ARGV_PER_SYSCALL
+    u32 size = buf->cursor;
+    u32 off = data->buf_off;
+    if (size == 0 || size > MAX_ARGV_PER_SYSCALL)
+        return 0;
     // exceed size
-    if (data->buf_off > MAX_PERCPU_BUFSIZE - 1)
+    if (off > MAX_PERCPU_BUFSIZE - MAX_ARGV_PER_SYSCALL - 1) {
+        hook_stats_add(data->context.type, truncated, 1);
         return 0;
+    }
+    // read argv str to buf
+    bpf_probe_read(&(data->submit_p->buf[off + 1]), size, buf->args);
     // save index
     data->submit_p->buf[data->buf_off] = index;
     data->buf_off += buf->cursor + 1;
@@ -494,12 +827,15 @@ save_argv_to_buf(event_data_t *data, struct syscall_buffer *buf, int index)
 static __always_inline int
 save_envp_to_buf(event_data_t *data, struct syscall_buffer *buf, int index)
 {
-    bpf_probe_read(&(data->submit_p->buf[(data->buf_off + 1) &
-                                         ((MAX_PERCPU_BUFSIZE) -
-                                          (MAX_DATA_PER_SYSCALL)-1)]),
-                   MAX_DATA_PER_SYSCALL, buf->envp);
-    if (data->buf_off > MAX_PERCPU_BUFSIZE - 1)
+    // bounded by the compare rather than the mask, the offset is after the
+    // argv which may be larger than MAX_DATA_PER_SYSCALL
+    u32 off = data->buf_off;
+    if (off > MAX_PERCPU_BUFSIZE - MAX_DATA_PER_SYSCALL - 1) {
+        hook_stats_add(data->context.type, truncated, 1);
         return 0;
+    }
+    bpf_probe_read(&(data->submit_p->buf[off + 1]), MAX_DATA_PER_SYSCALL,
+                   buf->envp);
     data->submit_p->buf[data->buf_off] = index;
     data->buf_off += buf->envp_cursor + 1;
     return 1;
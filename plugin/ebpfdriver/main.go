@@ -58,7 +58,7 @@ func main() {
 			return
 		}
 		// TODO: Dirty init jusr for now
-		cache.DefaultHashCache = sandbox.Hash
+		cache.DefaultHashCache = cache.NewLockedHashCache(sandbox.Hash)
 		// Better UI for command line usage
 		sandbox.Run(driver)
 	})
@@ -0,0 +1,281 @@
+// schemagen generates the Go decoders from kern/include/schema.h, so the
+// kern structs and the decoders share one definition. It's run by go
+// generate in user/decoder (the context) and user/event (the events).
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"flag"
+	"fmt"
+	"go/format"
+	"os"
+	"regexp"
+	"strconv"
+	"strings"
+)
+
+var (
+	defineRe  = regexp.MustCompile(`^#define\s+(SCHEMA_\w+)\(\w+\)`)
+	sizeRe    = regexp.MustCompile(`^#define\s+SCHEMA_CONTEXT_SIZE\s+(\d+)`)
+	contextRe = regexp.MustCompile(`F\((\w+),\s*(\w+),\s*(\w+),\s*(\d+),\s*(\d+)\)`)
+	eventRe   = regexp.MustCompile(`X\((\w+),\s*(\w+)\)`)
+	fieldRe   = regexp.MustCompile(`F\((\w+),\s*(\w+),\s*(\w+),\s*(\w+)\)`)
+)
+
+// the size of the fixed kinds, the index byte is not included
+var fixedSize = map[string]int{
+	"U8": 1, "U16": 2, "U32": 4, "U64": 8, "S32": 4, "S64": 8,
+}
+
+var varKinds = map[string]bool{
+	"STR": true, "STR_ARR": true, "EXE": true, "PID_TREE": true,
+}
+
+type contextField struct {
+	kind, field, goField string
+	offset, size         int
+}
+
+type eventField struct {
+	kind, field, goField string
+}
+
+type event struct {
+	name, goType string
+	fields       []eventField
+}
+
+type schema struct {
+	contextSize int
+	context     []contextField
+	events      []*event
+}
+
+func parse(path string) (*schema, error) {
+	file, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	defer file.Close()
+	s := &schema{}
+	blocks := make(map[string]*event)
+	var current string
+	var order []string
+	scanner := bufio.NewScanner(file)
+	for scanner.Scan() {
+		line := strings.TrimSpace(scanner.Text())
+		if m := sizeRe.FindStringSubmatch(line); m != nil {
+			s.contextSize, _ = strconv.Atoi(m[1])
+			continue
+		}
+		if m := defineRe.FindStringSubmatch(line); m != nil {
+			current = m[1]
+		}
+		switch {
+		case current == "SCHEMA_CONTEXT":
+			if m := contextRe.FindStringSubmatch(line); m != nil {
+				offset, _ := strconv.Atoi(m[4])
+				size, _ := strconv.Atoi(m[5])
+				s.context = append(s.context, contextField{m[1], m[2], m[3], offset, size})
+			}
+		case current == "SCHEMA_EVENTS":
+			if m := eventRe.FindStringSubmatch(line); m != nil {
+				order = append(order, m[1])
+				blocks[m[1]] = &event{name: m[1], goType: m[2]}
+			}
+		case strings.HasPrefix(current, "SCHEMA_"):
+			if m := fieldRe.FindStringSubmatch(line); m != nil {
+				e, ok := blocks[m[1]]
+				if !ok || "SCHEMA_"+m[1] != current {
+					return nil, fmt.Errorf("field %s is in %s, not of a listed event", m[3], current)
+				}
+				if _, fixed := fixedSize[m[2]]; !fixed && !varKinds[m[2]] {
+					return nil, fmt.Errorf("unknown kind %s of %s.%s", m[2], m[1], m[3])
+				}
+				e.fields = append(e.fields, eventField{m[2], m[3], m[4]})
+			}
+		}
+		if !strings.HasSuffix(line, `\`) {
+			current = ""
+		}
+	}
+	if err = scanner.Err(); err != nil {
+		return nil, err
+	}
+	for _, name := range order {
+		if len(blocks[name].fields) == 0 {
+			return nil, fmt.Errorf("event %s has no fields", name)
+		}
+		s.events = append(s.events, blocks[name])
+	}
+	end := 0
+	for _, f := range s.context {
+		if f.offset < end || f.offset+f.size > s.contextSize {
+			return nil, fmt.Errorf("context field %s overlaps or overflows", f.field)
+		}
+		end = f.offset + f.size
+	}
+	return s, nil
+}
+
+const header = "// Code generated by schemagen from kern/include/schema.h. DO NOT EDIT.\n\n"
+
+func genContext(s *schema) []byte {
+	var b bytes.Buffer
+	b.WriteString(header)
+	b.WriteString("package decoder\n\nimport (\n\"encoding/binary\"\n\"fmt\"\n)\n\n")
+	b.WriteString("// the layout of context_t, asserted in kern space\nconst (\n")
+	fmt.Fprintf(&b, "ContextSize = %d\n", s.contextSize)
+	for _, f := range s.context {
+		fmt.Fprintf(&b, "ContextOffset%s = %d\n", f.goField, f.offset)
+	}
+	b.WriteString(")\n\n")
+	b.WriteString("// decodeFull decodes the context_t at fixed offsets\n")
+	b.WriteString("func (ctx *Context) decodeFull(decoder *EbpfDecoder) error {\n")
+	b.WriteString("offset := decoder.cursor\n")
+	b.WriteString("if len(decoder.buffer[offset:]) < ContextSize {\n")
+	b.WriteString("return fmt.Errorf(\"can't read context from buffer: buffer too short\")\n}\n")
+	b.WriteString("b := decoder.buffer[offset : offset+ContextSize]\n")
+	for _, f := range s.context {
+		lo, hi := f.offset, f.offset+f.size
+		switch f.kind {
+		case "U8":
+			fmt.Fprintf(&b, "ctx.%s = b[%d]\n", f.goField, lo)
+		case "U32":
+			fmt.Fprintf(&b, "ctx.%s = binary.LittleEndian.Uint32(b[%d:%d])\n", f.goField, lo, hi)
+		case "U64":
+			fmt.Fprintf(&b, "ctx.%s = binary.LittleEndian.Uint64(b[%d:%d])\n", f.goField, lo, hi)
+		case "CHAR":
+			fmt.Fprintf(&b, "ctx.%s = decoder.cString(b[%d:%d])\n", f.goField, lo, hi)
+		}
+	}
+	b.WriteString("decoder.cursor += ContextSize\nreturn nil\n}\n")
+	return b.Bytes()
+}
+
+// genFixed reads a run of the fixed fields at once, the index bytes are
+// skipped by the offsets
+func genFixed(b *bytes.Buffer, recv string, run []eventField) {
+	total := 0
+	for _, f := range run {
+		total += 1 + fixedSize[f.kind]
+	}
+	fmt.Fprintf(b, "if b, err = e.DecodeFixed(%d); err != nil {\nreturn\n}\n", total)
+	off := 0
+	for _, f := range run {
+		lo := off + 1
+		hi := lo + fixedSize[f.kind]
+		dst := recv + "." + f.goField
+		switch f.kind {
+		case "U8":
+			fmt.Fprintf(b, "%s = b[%d]\n", dst, lo)
+		case "U16":
+			fmt.Fprintf(b, "%s = binary.LittleEndian.Uint16(b[%d:%d])\n", dst, lo, hi)
+		case "U32":
+			fmt.Fprintf(b, "%s = binary.LittleEndian.Uint32(b[%d:%d])\n", dst, lo, hi)
+		case "U64":
+			fmt.Fprintf(b, "%s = binary.LittleEndian.Uint64(b[%d:%d])\n", dst, lo, hi)
+		case "S32":
+			fmt.Fprintf(b, "%s = int32(binary.LittleEndian.Uint32(b[%d:%d]))\n", dst, lo, hi)
+		case "S64":
+			fmt.Fprintf(b, "%s = int64(binary.LittleEndian.Uint64(b[%d:%d]))\n", dst, lo, hi)
+		}
+		off = hi
+	}
+}
+
+func genEvents(s *schema) []byte {
+	var body bytes.Buffer
+	var useBinary, useStrings bool
+	for _, ev := range s.events {
+		recv := strings.ToLower(ev.goType[:1])
+		var hasFixed, hasArr bool
+		for _, f := range ev.fields {
+			if _, ok := fixedSize[f.kind]; ok {
+				hasFixed = true
+			}
+			hasArr = hasArr || f.kind == "STR_ARR"
+		}
+		useBinary = useBinary || hasFixed
+		useStrings = useStrings || hasArr
+		fmt.Fprintf(&body, "// decodeSchema decodes the fields of %s in the schema order\n", ev.name)
+		fmt.Fprintf(&body, "func (%s *%s) decodeSchema(e *decoder.EbpfDecoder) (err error) {\n", recv, ev.goType)
+		if hasFixed {
+			body.WriteString("var b []byte\n")
+		}
+		if hasArr {
+			body.WriteString("var arr []string\n")
+		}
+		var run []eventField
+		for _, f := range ev.fields {
+			if _, ok := fixedSize[f.kind]; ok {
+				run = append(run, f)
+				continue
+			}
+			if len(run) > 0 {
+				genFixed(&body, recv, run)
+				run = nil
+			}
+			dst := recv + "." + f.goField
+			switch f.kind {
+			case "STR":
+				fmt.Fprintf(&body, "if %s, err = e.DecodeString(); err != nil {\nreturn\n}\n", dst)
+			case "EXE":
+				fmt.Fprintf(&body, "if %s, err = e.DecodeExe(); err != nil {\nreturn\n}\n", dst)
+			case "STR_ARR":
+				body.WriteString("if arr, err = e.DecodeStrArray(); err != nil {\nreturn\n}\n")
+				fmt.Fprintf(&body, "%s = strings.Join(arr, \" \")\n", dst)
+			case "PID_TREE":
+				fmt.Fprintf(&body, "if %s, err = e.DecodePidTree(&%s.PrivEscalation); err != nil {\nreturn\n}\n", dst, recv)
+			}
+		}
+		if len(run) > 0 {
+			genFixed(&body, recv, run)
+		}
+		body.WriteString("return\n}\n\n")
+	}
+	var b bytes.Buffer
+	b.WriteString(header)
+	b.WriteString("package event\n\nimport (\n")
+	if useBinary {
+		b.WriteString("\"encoding/binary\"\n")
+	}
+	b.WriteString("\"hades-ebpf/user/decoder\"\n")
+	if useStrings {
+		b.WriteString("\"strings\"\n")
+	}
+	b.WriteString(")\n\n")
+	b.Write(body.Bytes())
+	return b.Bytes()
+}
+
+func main() {
+	path := flag.String("schema", "../../kern/include/schema.h", "path of schema.h")
+	mode := flag.String("mode", "events", "context or events")
+	out := flag.String("o", "", "output file")
+	flag.Parse()
+	s, err := parse(*path)
+	if err != nil {
+		fmt.Fprintln(os.Stderr, "schemagen:", err)
+		os.Exit(1)
+	}
+	var src []byte
+	switch *mode {
+	case "context":
+		src = genContext(s)
+	case "events":
+		src = genEvents(s)
+	default:
+		fmt.Fprintln(os.Stderr, "schemagen: unknown mode", *mode)
+		os.Exit(2)
+	}
+	if src, err = format.Source(src); err != nil {
+		fmt.Fprintln(os.Stderr, "schemagen:", err)
+		os.Exit(1)
+	}
+	if err = os.WriteFile(*out, src, 0644); err != nil {
+		fmt.Fprintln(os.Stderr, "schemagen:", err)
+		os.Exit(1)
+	}
+}
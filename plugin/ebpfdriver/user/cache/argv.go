@@ -3,6 +3,7 @@ package cache
 import (
 	"bytes"
 	"fmt"
+	"hades-ebpf/user/helper"
 	"os"
 	"strings"
 	"time"
@@ -65,7 +66,8 @@ func (a *ArgvCache) Get(pid uint32) string {
 
 // Set pid, argv to cache
 func (a *ArgvCache) Set(pid uint32, argv string) {
-	a.cache.Add(pid, argv)
+	// argv may be a view of the event buffer
+	a.cache.Add(pid, helper.CloneString(argv))
 }
 
 // convert /proc/<pid>/cmdline to readable string
@@ -1,7 +1,26 @@
 package cache
 
 import (
+	"sync"
+
 	"github.com/chriskaliX/SDK/util/hash"
 )
 
 var DefaultHashCache hash.IHashCache
+
+// lockedHashCache serializes the GetHash, the HashCache in SDK shares the
+// read buffer and the digest, and it's called by all the decode workers
+type lockedHashCache struct {
+	mu    sync.Mutex
+	cache hash.IHashCache
+}
+
+func NewLockedHashCache(cache hash.IHashCache) hash.IHashCache {
+	return &lockedHashCache{cache: cache}
+}
+
+func (l *lockedHashCache) GetHash(path string) string {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+	return l.cache.GetHash(path)
+}
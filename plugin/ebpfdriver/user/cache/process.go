@@ -0,0 +1,142 @@
+package cache
+
+import (
+	"bytes"
+	"fmt"
+	"hades-ebpf/user/helper"
+	"os"
+	"strconv"
+	"time"
+
+	"golang.org/x/time/rate"
+	"k8s.io/utils/lru"
+)
+
+const (
+	processCacheSize       = 10240
+	processLimiterBurst    = 100
+	processLimiterInterval = 2 * time.Millisecond
+	// USER_HZ, it's 100 for almost all the distributions
+	clockTicks = 100
+)
+
+// DefaultProcessCache is the userspace mirror of the kernel proc_tree. It
+// is learned from the event contexts, and /proc is the fallback. It's used
+// to rebuild the pid tree from the compact ancestor pid list.
+var DefaultProcessCache = NewProcessCache()
+
+type Process struct {
+	Pid       uint32
+	Ppid      uint32
+	Comm      string
+	StartTime uint64
+}
+
+type ProcessCache struct {
+	rlimiter *rate.Limiter
+	cache    *lru.Cache
+}
+
+func NewProcessCache() *ProcessCache {
+	return &ProcessCache{
+		rlimiter: rate.NewLimiter(
+			rate.Every(processLimiterInterval), processLimiterBurst,
+		),
+		cache: lru.New(processCacheSize),
+	}
+}
+
+// GetComm returns the comm of the pid
+func (p *ProcessCache) GetComm(pid uint32) string {
+	if pid == 0 {
+		return InVaild
+	}
+	if value, ok := p.cache.Get(pid); ok {
+		return value.(*Process).Comm
+	}
+	if p.rlimiter.Allow() {
+		proc, err := ReadProcess(pid)
+		if err != nil {
+			return InVaild
+		}
+		p.cache.Add(pid, proc)
+		return proc.Comm
+	}
+	return OverRate
+}
+
+// Set the process, comm is updated if the pid exists since the comm is
+// changed after execve
+func (p *ProcessCache) Set(pid, ppid uint32, comm string) {
+	if pid == 0 {
+		return
+	}
+	if value, ok := p.cache.Get(pid); ok {
+		proc := value.(*Process)
+		if proc.Comm == comm && (ppid == 0 || proc.Ppid == ppid) {
+			return
+		}
+		if ppid == 0 {
+			ppid = proc.Ppid
+		}
+	}
+	// comm may be a view of the event buffer
+	p.cache.Add(pid, &Process{Pid: pid, Ppid: ppid, Comm: helper.CloneString(comm)})
+}
+
+// ReadProcess parses the /proc/<pid>/stat
+func ReadProcess(pid uint32) (*Process, error) {
+	_byte, err := os.ReadFile(fmt.Sprintf("/proc/%d/stat", pid))
+	if err != nil {
+		return nil, err
+	}
+	// comm may contain spaces or brackets, find the last ')'
+	start := bytes.IndexByte(_byte, '(')
+	end := bytes.LastIndexByte(_byte, ')')
+	if start < 0 || end < start {
+		return nil, fmt.Errorf("invalid stat of pid %d", pid)
+	}
+	fields := bytes.Fields(_byte[end+1:])
+	// fields from state(3), ppid is 4 and starttime is 22
+	if len(fields) < 20 {
+		return nil, fmt.Errorf("invalid stat of pid %d", pid)
+	}
+	ppid, err := strconv.ParseUint(string(fields[1]), 10, 32)
+	if err != nil {
+		return nil, err
+	}
+	startTime, err := strconv.ParseUint(string(fields[19]), 10, 64)
+	if err != nil {
+		return nil, err
+	}
+	return &Process{
+		Pid:       pid,
+		Ppid:      uint32(ppid),
+		Comm:      string(_byte[start+1 : end]),
+		StartTime: startTime * uint64(time.Second) / clockTicks,
+	}, nil
+}
+
+// WalkProcfs calls fn with all the processes in /proc, the processes are
+// added into the cache as well.
+func (p *ProcessCache) WalkProcfs(fn func(*Process)) error {
+	entries, err := os.ReadDir("/proc")
+	if err != nil {
+		return err
+	}
+	for _, entry := range entries {
+		pid, err := strconv.ParseUint(entry.Name(), 10, 32)
+		if err != nil {
+			continue
+		}
+		proc, err := ReadProcess(uint32(pid))
+		if err != nil {
+			continue
+		}
+		p.cache.Add(proc.Pid, proc)
+		if fn != nil {
+			fn(proc)
+		}
+	}
+	return nil
+}
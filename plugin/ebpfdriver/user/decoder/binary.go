@@ -0,0 +1,70 @@
+package decoder
+
+import (
+	"reflect"
+	"strings"
+	"sync"
+
+	"github.com/chriskaliX/SDK/transport/batch"
+)
+
+// binaryField is a field of the event which is encoded, it's the same as
+// the json encoding, fields with json:"-" are skipped
+type binaryField struct {
+	name  string
+	index int
+	kind  reflect.Kind
+}
+
+// schemas of the events and the context by type, parsed once
+var schemas sync.Map
+
+func schemaOf(t reflect.Type) []binaryField {
+	if value, ok := schemas.Load(t); ok {
+		return value.([]binaryField)
+	}
+	fields := make([]binaryField, 0, t.NumField())
+	for i := 0; i < t.NumField(); i++ {
+		field := t.Field(i)
+		name := strings.Split(field.Tag.Get("json"), ",")[0]
+		if name == "-" || name == "" || field.PkgPath != "" {
+			continue
+		}
+		switch field.Type.Kind() {
+		case reflect.String, reflect.Bool,
+			reflect.Uint8, reflect.Uint16, reflect.Uint32, reflect.Uint64,
+			reflect.Int8, reflect.Int16, reflect.Int32, reflect.Int64:
+			fields = append(fields, binaryField{name: name, index: i, kind: field.Type.Kind()})
+		}
+	}
+	schemas.Store(t, fields)
+	return fields
+}
+
+// MarshalBinary appends the event with the context into the batch, the
+// fields are typed instead of the json strings
+func MarshalBinary(e *batch.Encoder, event Event) {
+	ctx := reflect.ValueOf(event.Context()).Elem()
+	value := reflect.ValueOf(event).Elem()
+	ctxFields := schemaOf(ctx.Type())
+	eventFields := schemaOf(value.Type())
+	e.Begin(event.ID(), len(ctxFields)+len(eventFields))
+	appendFields(e, ctx, ctxFields)
+	appendFields(e, value, eventFields)
+}
+
+func appendFields(e *batch.Encoder, value reflect.Value, fields []binaryField) {
+	for _, field := range fields {
+		v := value.Field(field.index)
+		switch field.kind {
+		case reflect.String:
+			e.AppendString(field.name, v.String())
+		case reflect.Bool:
+			e.AppendBool(field.name, v.Bool())
+		case reflect.Uint8, reflect.Uint16, reflect.Uint32, reflect.Uint64:
+			e.AppendUint(field.name, v.Uint())
+		default:
+			e.AppendInt(field.name, v.Int())
+		}
+	}
+}
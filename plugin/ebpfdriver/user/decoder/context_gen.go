@@ -0,0 +1,56 @@
+// Code generated by schemagen from kern/include/schema.h. DO NOT EDIT.
+
+package decoder
+
+import (
+	"encoding/binary"
+	"fmt"
+)
+
+// the layout of context_t, asserted in kern space
+const (
+	ContextSize             = 96
+	ContextOffsetStarttime  = 0
+	ContextOffsetCgroupID   = 8
+	ContextOffsetPns        = 16
+	ContextOffsetType       = 20
+	ContextOffsetPid        = 24
+	ContextOffsetTid        = 28
+	ContextOffsetUid        = 32
+	ContextOffsetGid        = 36
+	ContextOffsetPpid       = 40
+	ContextOffsetPgid       = 44
+	ContextOffsetSessionID  = 48
+	ContextOffsetCommID     = 56
+	ContextOffsetPCommID    = 64
+	ContextOffsetNodenameID = 72
+	ContextOffsetRetVal     = 80
+	ContextOffsetArgnum     = 88
+)
+
+// decodeFull decodes the context_t at fixed offsets
+func (ctx *Context) decodeFull(decoder *EbpfDecoder) error {
+	offset := decoder.cursor
+	if len(decoder.buffer[offset:]) < ContextSize {
+		return fmt.Errorf("can't read context from buffer: buffer too short")
+	}
+	b := decoder.buffer[offset : offset+ContextSize]
+	ctx.Starttime = binary.LittleEndian.Uint64(b[0:8])
+	ctx.CgroupID = binary.LittleEndian.Uint64(b[8:16])
+	ctx.Pns = binary.LittleEndian.Uint32(b[16:20])
+	ctx.Type = binary.LittleEndian.Uint32(b[20:24])
+	ctx.Pid = binary.LittleEndian.Uint32(b[24:28])
+	ctx.Tid = binary.LittleEndian.Uint32(b[28:32])
+	ctx.Uid = binary.LittleEndian.Uint32(b[32:36])
+	ctx.Gid = binary.LittleEndian.Uint32(b[36:40])
+	ctx.Ppid = binary.LittleEndian.Uint32(b[40:44])
+	ctx.Pgid = binary.LittleEndian.Uint32(b[44:48])
+	ctx.SessionID = binary.LittleEndian.Uint32(b[48:52])
+	ctx.CommID = binary.LittleEndian.Uint64(b[56:64])
+	ctx.PCommID = binary.LittleEndian.Uint64(b[64:72])
+	ctx.NodenameID = binary.LittleEndian.Uint64(b[72:80])
+	ctx.RetVal = binary.LittleEndian.Uint64(b[80:88])
+	ctx.Argnum = b[88]
+	decoder.cursor += ContextSize
+	return nil
+}
@@ -1,16 +1,17 @@
 package decoder
 
 import (
+	"bytes"
 	"encoding/binary"
 	"errors"
 	"fmt"
+	"hades-ebpf/user/cache"
 	"hades-ebpf/user/helper"
-	"hades-ebpf/user/share"
 	"strconv"
 	"strings"
-)
 
-var DefaultDecoder = NewEbpfDecoder(make([]byte, 0))
+	"k8s.io/utils/lru"
+)
 
 const (
 	sizeint8  = 1
@@ -19,10 +20,14 @@ const (
 	sizeint64 = 8
 )
 
-// dummy field for internal uses
-var dummy uint8
+// the high bit of the pid tree count, see PID_TREE_COMPACT_FLAG
+const pidTreeCompactFlag = 0x80
 
-// eBPF events decoder, functions in this struct is not thread-safe
+// the high bit of the string array count, see STR_ARR_TRUNCATED
+const strArrTruncatedFlag = 0x80
+
+// eBPF events decoder, functions in this struct is not thread-safe, every
+// decode worker owns one
 type EbpfDecoder struct {
 	// raw buffer which is read from kern perf(or ringbuf)
 	buffer []byte
@@ -30,22 +35,69 @@ type EbpfDecoder struct {
 	cursor int
 	// index of the event, for less alloc since it's internal
 	index uint8
+	// dummy field for internal uses
+	dummy uint8
+	// zeroCopy borrows the buffer instead of copying, and the strings are
+	// views of the buffer. The buffer must not be reused by the reader
+	// until Release, which is right for the perf and ringbuf readers since
+	// every record is a new allocation.
+	zeroCopy bool
+	// interned is the dictionary of the interned strings, see intern.go
+	interned *lru.Cache
+	missed   []uint64
+	// compact decodes the compact header, streams is the state by cpu,
+	// see header.go
+	compact bool
+	streams map[uint16]*headerState
 }
 
 func NewEbpfDecoder(rawBuffer []byte) *EbpfDecoder {
 	return &EbpfDecoder{
-		buffer: rawBuffer,
-		cursor: 0,
+		buffer:   rawBuffer,
+		cursor:   0,
+		interned: lru.New(internMaxSize),
 	}
 }
 
+// SetZeroCopy sets the zero-copy mode of the decoder
+func (decoder *EbpfDecoder) SetZeroCopy(zeroCopy bool) {
+	decoder.zeroCopy = zeroCopy
+}
+
 // ReInit the decoder by accepting a new event buffer
 func (decoder *EbpfDecoder) ReInit(_byte []byte) {
-	decoder.buffer = append([]byte(nil), _byte...)
+	if decoder.zeroCopy {
+		decoder.buffer = _byte
+	} else {
+		decoder.buffer = append([]byte(nil), _byte...)
+	}
 	decoder.cursor = 0
 	decoder.index = 0
 }
 
+// Release hands the buffer back, it's called after the event is encoded
+// since the decoded strings may still refer to the buffer
+func (decoder *EbpfDecoder) Release() {
+	decoder.buffer = nil
+	decoder.cursor = 0
+}
+
+// toString converts the bytes of the buffer, it's a view in zero-copy mode
+func (decoder *EbpfDecoder) toString(b []byte) string {
+	if decoder.zeroCopy {
+		return helper.ZeroCopyString(b)
+	}
+	return string(b)
+}
+
+// cString converts the NUL padded char array, it's cut at the first NUL
+func (decoder *EbpfDecoder) cString(b []byte) string {
+	if i := bytes.IndexByte(b, 0); i >= 0 {
+		b = b[:i]
+	}
+	return decoder.toString(b)
+}
+
 func (decoder *EbpfDecoder) BuffLen() int {
 	return len(decoder.buffer)
 }
@@ -156,6 +208,17 @@ func (decoder *EbpfDecoder) DecodeBytes(msg []byte, size uint32) error {
 	return nil
 }
 
+// DecodeFixed returns the next n bytes and moves the cursor. It's used by
+// the generated decoders for the fixed-size fields, with the index bytes
+func (decoder *EbpfDecoder) DecodeFixed(n int) ([]byte, error) {
+	offset := decoder.cursor
+	if len(decoder.buffer[offset:]) < n {
+		return nil, fmt.Errorf("read fixed failed, offset: %d, size: %d", offset, n)
+	}
+	decoder.cursor += n
+	return decoder.buffer[offset : offset+n], nil
+}
+
 func (decoder *EbpfDecoder) DecodeString() (s string, err error) {
 	var size int32
 	if err = decoder.DecodeUint8(&decoder.index); err != nil {
@@ -169,13 +232,14 @@ func (decoder *EbpfDecoder) DecodeString() (s string, err error) {
 		err = errors.New(fmt.Sprintf("string size too long, size: %d", size))
 		return
 	}
-	buf := share.BufferPool.Get()
-	defer buf.Free()
-	if err = decoder.DecodeBytes(buf.Bytes()[:size-1], uint32(size-1)); err != nil {
+	if size < 1 {
+		err = errors.New(fmt.Sprintf("string size invalid, size: %d", size))
 		return
 	}
-	decoder.DecodeUint8(&dummy)
-	s = string(buf.Bytes()[:size-1])
+	if s, err = decoder.decodeStr(uint32(size - 1)); err != nil {
+		return
+	}
+	decoder.DecodeUint8(&decoder.dummy)
 	return
 }
 
@@ -235,6 +299,17 @@ func (decoder *EbpfDecoder) DecodePidTree(privilege_flag *uint8) (pidtree string
 		return
 	}
 	strArr := make([]string, 0, 8)
+	// compact mode, only the pids are sent and the comm is from the mirror
+	if size&pidTreeCompactFlag != 0 {
+		size &^= pidTreeCompactFlag
+		for i := 0; i < int(size); i++ {
+			if err = decoder.DecodeUint32(&pid); err != nil {
+				break
+			}
+			strArr = append(strArr, strconv.FormatUint(uint64(pid), 10)+"."+cache.DefaultProcessCache.GetComm(pid))
+		}
+		size = 0
+	}
 	for i := 0; i < int(size); i++ {
 		if err = decoder.DecodeUint32(&pid); err != nil {
 			break
@@ -246,7 +321,7 @@ func (decoder *EbpfDecoder) DecodePidTree(privilege_flag *uint8) (pidtree string
 			break
 		}
 		strArr = append(strArr, strconv.FormatUint(uint64(pid), 10)+"."+str)
-		decoder.DecodeUint8(&dummy)
+		decoder.DecodeUint8(&decoder.dummy)
 	}
 	pidtree = strings.Join(strArr, "<")
 	// We add a cred check here...
@@ -295,6 +370,13 @@ func (decoder *EbpfDecoder) DeocdeSlimCred(slimCred *SlimCred) error {
 }
 
 func (decoder *EbpfDecoder) DecodeStrArray() (strArr []string, err error) {
+	strArr, _, err = decoder.DecodeStrArrayTruncated()
+	return
+}
+
+// DecodeStrArrayTruncated decodes the string array, and the truncated flag
+// which is the high bit of the count set by the bpf_loop capture
+func (decoder *EbpfDecoder) DecodeStrArrayTruncated() (strArr []string, truncated bool, err error) {
 	var (
 		size uint8
 		str  string
@@ -306,6 +388,8 @@ func (decoder *EbpfDecoder) DecodeStrArray() (strArr []string, err error) {
 	if err = decoder.DecodeUint8(&size); err != nil {
 		return
 	}
+	truncated = size&strArrTruncatedFlag != 0
+	size &^= strArrTruncatedFlag
 	strArr = make([]string, 0, 2)
 	for i := 0; i < int(size); i++ {
 		if err = decoder.DecodeUint32(&sz); err != nil {
@@ -315,7 +399,7 @@ func (decoder *EbpfDecoder) DecodeStrArray() (strArr []string, err error) {
 			return
 		}
 		strArr = append(strArr, str)
-		decoder.DecodeUint8(&dummy)
+		decoder.DecodeUint8(&decoder.dummy)
 	}
 	return
 }
@@ -337,7 +421,7 @@ func (decoder *EbpfDecoder) decodeStr(size uint32) (str string, err error) {
 		err = fmt.Errorf("read str failed, offset: %d, size: %d", offset, castedSize)
 		return
 	}
-	str = string(decoder.buffer[offset : offset+castedSize])
+	str = decoder.toString(decoder.buffer[offset : offset+castedSize])
 	decoder.cursor += castedSize
 	return
 }
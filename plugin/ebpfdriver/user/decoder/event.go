@@ -2,6 +2,8 @@ package decoder
 
 import (
 	"fmt"
+	"hades-ebpf/user/helper"
+	"reflect"
 
 	"github.com/bytedance/sonic"
 	"github.com/cilium/ebpf"
@@ -55,6 +57,17 @@ func RegistEvent(event Event) {
 	Events[event.ID()] = event
 }
 
+// CloneEvents returns new instances of the registered events, since the
+// events are decoded in place and are not thread-safe. The events are
+// registered as the zero values, so the clones are the same.
+func CloneEvents() map[uint32]Event {
+	events := make(map[uint32]Event, len(Events))
+	for id, event := range Events {
+		events[id] = reflect.New(reflect.TypeOf(event).Elem()).Interface().(Event)
+	}
+	return events
+}
+
 func MarshalJson(event Event) (result string, err error) {
 	var (
 		eventByte  []byte
@@ -67,10 +80,12 @@ func MarshalJson(event Event) (result string, err error) {
 	if ctxByte, err = event.Context().MarshalJson(); err != nil {
 		return
 	}
+	resultByte = make([]byte, 0, len(ctxByte)+len(eventByte))
 	resultByte = append(resultByte, ctxByte[:len(ctxByte)-2]...)
 	resultByte = append(resultByte, byte('"'), byte(','))
 	resultByte = append(resultByte, eventByte[1:]...)
-	result = string(resultByte)
+	// resultByte is not touched after, no copy is needed
+	result = helper.ZeroCopyString(resultByte)
 	return
 }
 
@@ -0,0 +1,161 @@
+package decoder
+
+import (
+	"encoding/binary"
+	"errors"
+)
+
+// The compact context header, see "compact context header" in
+// kern/include/utils.h. The fields in the bitmap follow the prefix in bit
+// order, and most of them are sent only if they differ from the previous
+// record of the stream, which is the records of one cpu to the worker.
+const (
+	hdrTsFull = 1 << iota
+	hdrTid
+	hdrCgroupID
+	hdrPns
+	hdrUid
+	hdrGid
+	hdrPpid
+	hdrPgid
+	hdrSessionID
+	hdrCommID
+	hdrPCommID
+	hdrNodenameID
+	hdrRetVal
+	hdrNoState = 1 << 15
+)
+
+// the prefix of the header, [u16 present][u16 type][u32 pid][u16 cpu]
+const (
+	CompactOffsetType = 2
+	CompactOffsetPid  = 4
+	compactPrefixSize = 10
+)
+
+// HeaderStreams is the max of the decode workers in compact mode
+const HeaderStreams = 256
+
+var errHeader = errors.New("can't read compact header from buffer: buffer too short")
+
+// headerState is the last values of the stream, header_state_t in kern
+type headerState struct {
+	ts         uint64
+	cgroupID   uint64
+	commID     uint64
+	pcommID    uint64
+	nodenameID uint64
+	pns        uint32
+	uid        uint32
+	gid        uint32
+	ppid       uint32
+	pgid       uint32
+	sessionID  uint32
+}
+
+// SetCompactHeader sets the decoder to decode the compact header instead
+// of the context_t
+func (decoder *EbpfDecoder) SetCompactHeader(compact bool) {
+	decoder.compact = compact
+	if compact && decoder.streams == nil {
+		decoder.streams = make(map[uint16]*headerState)
+	}
+}
+
+// decodeCompact decodes the compact header and updates the stream. The
+// fields not sent are from the stream, except tid which is the same as
+// pid, and retval which is 0.
+func (ctx *Context) decodeCompact(decoder *EbpfDecoder) (err error) {
+	b := decoder.buffer[decoder.cursor:]
+	if len(b) < compactPrefixSize {
+		return errHeader
+	}
+	present := binary.LittleEndian.Uint16(b[0:2])
+	ctx.Type = uint32(binary.LittleEndian.Uint16(b[2:4]))
+	ctx.Pid = binary.LittleEndian.Uint32(b[4:8])
+	cpu := binary.LittleEndian.Uint16(b[8:10])
+	decoder.cursor += compactPrefixSize
+	ctx.Tid = ctx.Pid
+	ctx.RetVal = 0
+	ctx.Argnum = 0
+	if present&hdrNoState != 0 {
+		return
+	}
+	s, ok := decoder.streams[cpu]
+	if !ok {
+		s = &headerState{}
+		decoder.streams[cpu] = s
+	}
+	if present&hdrTsFull != 0 {
+		if err = decoder.DecodeUint64(&s.ts); err != nil {
+			return
+		}
+		ctx.Starttime = s.ts
+	} else {
+		var delta uint32
+		if err = decoder.DecodeUint32(&delta); err != nil {
+			return
+		}
+		ctx.Starttime = s.ts + uint64(delta)
+	}
+	if err = decoder.decodeIf32(present, hdrTid, &ctx.Tid); err != nil {
+		return
+	}
+	if err = decoder.decodeIf64(present, hdrCgroupID, &s.cgroupID); err != nil {
+		return
+	}
+	for _, f := range [...]struct {
+		flag uint16
+		v    *uint32
+	}{
+		{hdrPns, &s.pns},
+		{hdrUid, &s.uid},
+		{hdrGid, &s.gid},
+		{hdrPpid, &s.ppid},
+		{hdrPgid, &s.pgid},
+		{hdrSessionID, &s.sessionID},
+	} {
+		if err = decoder.decodeIf32(present, f.flag, f.v); err != nil {
+			return
+		}
+	}
+	for _, f := range [...]struct {
+		flag uint16
+		v    *uint64
+	}{
+		{hdrCommID, &s.commID},
+		{hdrPCommID, &s.pcommID},
+		{hdrNodenameID, &s.nodenameID},
+		{hdrRetVal, &ctx.RetVal},
+	} {
+		if err = decoder.decodeIf64(present, f.flag, f.v); err != nil {
+			return
+		}
+	}
+	ctx.CgroupID = s.cgroupID
+	ctx.Pns = s.pns
+	ctx.Uid = s.uid
+	ctx.Gid = s.gid
+	ctx.Ppid = s.ppid
+	ctx.Pgid = s.pgid
+	ctx.SessionID = s.sessionID
+	ctx.CommID = s.commID
+	ctx.PCommID = s.pcommID
+	ctx.NodenameID = s.nodenameID
+	return
+}
+
+// decodeIf32 decodes the field if the flag is present, or it's unchanged
+func (decoder *EbpfDecoder) decodeIf32(present, flag uint16, v *uint32) error {
+	if present&flag == 0 {
+		return nil
+	}
+	return decoder.DecodeUint32(v)
+}
+
+func (decoder *EbpfDecoder) decodeIf64(present, flag uint16, v *uint64) error {
+	if present&flag == 0 {
+		return nil
+	}
+	return decoder.DecodeUint64(v)
+}
@@ -0,0 +1,169 @@
+package decoder
+
+import (
+	"encoding/binary"
+	"testing"
+)
+
+// compactRecord encodes a compact header like compact_header in kern, the
+// fields follow the prefix in bit order
+type compactRecord struct {
+	present uint16
+	typ     uint16
+	pid     uint32
+	cpu     uint16
+	ts      uint64 // the full ts, or the delta if hdrTsFull is not set
+	tid     uint32
+	cgroup  uint64
+	u32s    [6]uint32 // pns, uid, gid, ppid, pgid, sessionid
+	u64s    [4]uint64 // comm, pcomm, nodename, retval
+}
+
+func (r *compactRecord) encode() []byte {
+	b := make([]byte, compactPrefixSize)
+	binary.LittleEndian.PutUint16(b[0:2], r.present)
+	binary.LittleEndian.PutUint16(b[2:4], r.typ)
+	binary.LittleEndian.PutUint32(b[4:8], r.pid)
+	binary.LittleEndian.PutUint16(b[8:10], r.cpu)
+	if r.present&hdrNoState != 0 {
+		return b
+	}
+	if r.present&hdrTsFull != 0 {
+		b = appendUint64(b, r.ts)
+	} else {
+		b = appendUint32(b, uint32(r.ts))
+	}
+	if r.present&hdrTid != 0 {
+		b = appendUint32(b, r.tid)
+	}
+	if r.present&hdrCgroupID != 0 {
+		b = appendUint64(b, r.cgroup)
+	}
+	for i, v := range r.u32s {
+		if r.present&(uint16(hdrPns)<<i) != 0 {
+			b = appendUint32(b, v)
+		}
+	}
+	for i, v := range r.u64s {
+		if r.present&(uint16(hdrCommID)<<i) != 0 {
+			b = appendUint64(b, v)
+		}
+	}
+	return b
+}
+
+func appendUint32(b []byte, v uint32) []byte {
+	var buf [4]byte
+	binary.LittleEndian.PutUint32(buf[:], v)
+	return append(b, buf[:]...)
+}
+
+func appendUint64(b []byte, v uint64) []byte {
+	var buf [8]byte
+	binary.LittleEndian.PutUint64(buf[:], v)
+	return append(b, buf[:]...)
+}
+
+const hdrAllState = hdrCgroupID | hdrPns | hdrUid | hdrGid | hdrPpid |
+	hdrPgid | hdrSessionID | hdrCommID | hdrPCommID | hdrNodenameID
+
+func TestDecodeCompact(t *testing.T) {
+	// the records are decoded in order by one decoder, the streams of the
+	// cpus are kept across the records
+	tests := []struct {
+		name   string
+		record compactRecord
+		want   Context
+	}{
+		{
+			name: "full on cpu 0",
+			record: compactRecord{
+				present: hdrTsFull | hdrAllState, typ: 700, pid: 10, cpu: 0,
+				ts: 1000, cgroup: 7, u32s: [6]uint32{1, 2, 3, 4, 5, 6},
+				u64s: [4]uint64{11, 12, 13},
+			},
+			want: Context{
+				Starttime: 1000, CgroupID: 7, Pns: 1, Type: 700, Pid: 10,
+				Tid: 10, Uid: 2, Gid: 3, Ppid: 4, Pgid: 5, SessionID: 6,
+				CommID: 11, PCommID: 12, NodenameID: 13,
+			},
+		},
+		{
+			name: "delta on cpu 0",
+			record: compactRecord{
+				present: hdrTid | hdrUid | hdrRetVal, typ: 1022, pid: 10,
+				cpu: 0, ts: 50, tid: 99, u32s: [6]uint32{0, 20},
+				u64s: [4]uint64{0, 0, 0, 1 << 40},
+			},
+			want: Context{
+				Starttime: 1050, CgroupID: 7, Pns: 1, Type: 1022, Pid: 10,
+				Tid: 99, Uid: 20, Gid: 3, Ppid: 4, Pgid: 5, SessionID: 6,
+				CommID: 11, PCommID: 12, NodenameID: 13, RetVal: 1 << 40,
+			},
+		},
+		{
+			name: "full on cpu 1",
+			record: compactRecord{
+				present: hdrTsFull | hdrAllState, typ: 700, pid: 30, cpu: 1,
+				ts: 5000, cgroup: 8, u32s: [6]uint32{31, 32, 33, 34, 35, 36},
+				u64s: [4]uint64{41, 42, 43},
+			},
+			want: Context{
+				Starttime: 5000, CgroupID: 8, Pns: 31, Type: 700, Pid: 30,
+				Tid: 30, Uid: 32, Gid: 33, Ppid: 34, Pgid: 35, SessionID: 36,
+				CommID: 41, PCommID: 42, NodenameID: 43,
+			},
+		},
+		{
+			name: "delta against the last full ts",
+			record: compactRecord{
+				present: 0, typ: 700, pid: 10, cpu: 0, ts: 70,
+			},
+			want: Context{
+				Starttime: 1070, CgroupID: 7, Pns: 1, Type: 700, Pid: 10,
+				Tid: 10, Uid: 20, Gid: 3, Ppid: 4, Pgid: 5, SessionID: 6,
+				CommID: 11, PCommID: 12, NodenameID: 13,
+			},
+		},
+		{
+			name: "no state",
+			record: compactRecord{
+				present: hdrNoState | hdrAllState, typ: InternType, pid: 10,
+				cpu: 0,
+			},
+			want: Context{Type: InternType, Pid: 10, Tid: 10},
+		},
+		{
+			name: "stream untouched by no state",
+			record: compactRecord{
+				present: 0, typ: 700, pid: 30, cpu: 1, ts: 5,
+			},
+			want: Context{
+				Starttime: 5005, CgroupID: 8, Pns: 31, Type: 700, Pid: 30,
+				Tid: 30, Uid: 32, Gid: 33, Ppid: 34, Pgid: 35, SessionID: 36,
+				CommID: 41, PCommID: 42, NodenameID: 43,
+			},
+		},
+	}
+	decoder := NewEbpfDecoder(nil)
+	decoder.SetCompactHeader(true)
+	for _, tt := range tests {
+		data := tt.record.encode()
+		decoder.ReInit(data)
+		ctx := Context{}
+		if err := ctx.DecodeContext(decoder); err != nil {
+			t.Fatalf("%s: %v", tt.name, err)
+		}
+		if ctx != tt.want {
+			t.Errorf("%s: got %+v, want %+v", tt.name, ctx, tt.want)
+		}
+		if decoder.cursor != len(data) {
+			t.Errorf("%s: decoded %d bytes of %d", tt.name, decoder.cursor, len(data))
+		}
+	}
+	// a short record
+	decoder.ReInit([]byte{1, 0, 0})
+	if err := (&Context{}).DecodeContext(decoder); err != errHeader {
+		t.Error("short prefix should fail:", err)
+	}
+}
@@ -0,0 +1,91 @@
+package decoder
+
+import (
+	"hades-ebpf/user/helper"
+)
+
+// InternType is the type of the interned string records, INTERN_STRING in
+// kern/include/define.h. It's not an event, the record is consumed by the
+// decoder of the worker.
+const InternType = 1300
+
+// the types of the hooks without events, they are counted in the stats and
+// the latency only, see "hooks without events" in kern/include/define.h
+const (
+	SecurityInodeUnlinkType = 1301
+	SchedProcessForkType    = 1302
+	SchedProcessExecType    = 1303
+	SchedProcessExitType    = 1304
+	ExecArgvStagingType     = 1305
+	RawSysEnterType         = 1306
+	RawSysExitType          = 1307
+	SysBpfDenyType          = 1308
+)
+
+// the least recently used strings are evicted when the dictionary is full,
+// and they are sent again by the kern side after the ids are reported as
+// missed
+const internMaxSize = 1 << 16
+
+// DecodeIntern decodes the record of an interned string and keeps it in
+// the dictionary. The structure is [0][id][1][size][ ... string ... ]
+func (decoder *EbpfDecoder) DecodeIntern() (err error) {
+	var id uint64
+	if err = decoder.DecodeUint8(&decoder.index); err != nil {
+		return
+	}
+	if err = decoder.DecodeUint64(&id); err != nil {
+		return
+	}
+	s, err := decoder.DecodeString()
+	if err != nil {
+		return
+	}
+	// the buffer is released after the record, so it's always a copy
+	decoder.interned.Add(id, helper.CloneString(s))
+	return
+}
+
+// DecodeExe decodes the interned exe, [index][id], followed by the exe
+// string if the id is 0
+func (decoder *EbpfDecoder) DecodeExe() (exe string, err error) {
+	var id uint64
+	if err = decoder.DecodeUint8(&decoder.index); err != nil {
+		return
+	}
+	if err = decoder.DecodeUint64(&id); err != nil {
+		return
+	}
+	if id == 0 {
+		return decoder.DecodeString()
+	}
+	return decoder.lookup(id), nil
+}
+
+// ResolveContext fills comm, pcomm and nodename by the ids
+func (decoder *EbpfDecoder) ResolveContext(ctx *Context) {
+	ctx.Comm = decoder.lookup(ctx.CommID)
+	ctx.PComm = decoder.lookup(ctx.PCommID)
+	ctx.Nodename = decoder.lookup(ctx.NodenameID)
+}
+
+// Missed returns the ids which are not in the dictionary since the last
+// call, they should be deleted from intern_sent so the kern side sends the
+// strings again
+func (decoder *EbpfDecoder) Missed() []uint64 {
+	missed := decoder.missed
+	decoder.missed = decoder.missed[:0]
+	return missed
+}
+
+func (decoder *EbpfDecoder) lookup(id uint64) string {
+	if id == 0 {
+		return ""
+	}
+	s, ok := decoder.interned.Get(id)
+	if !ok {
+		decoder.missed = append(decoder.missed, id)
+		return ""
+	}
+	return s.(string)
+}
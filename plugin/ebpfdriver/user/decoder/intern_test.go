@@ -0,0 +1,107 @@
+package decoder
+
+import (
+	"bufio"
+	"encoding/binary"
+	"os"
+	"regexp"
+	"strconv"
+	"testing"
+)
+
+// internRecord encodes the body of INTERN_STRING, [0][id][1][size][string]
+func internRecord(id uint64, s string) []byte {
+	b := make([]byte, 0, 14+len(s)+1)
+	b = append(b, 0)
+	b = appendUint64(b, id)
+	b = append(b, 1)
+	var size [4]byte
+	binary.LittleEndian.PutUint32(size[:], uint32(len(s)+1))
+	b = append(b, size[:]...)
+	b = append(b, s...)
+	return append(b, 0)
+}
+
+func TestDecodeIntern(t *testing.T) {
+	decoder := NewEbpfDecoder(nil)
+	decoder.ReInit(internRecord(42, "bash"))
+	if err := decoder.DecodeIntern(); err != nil {
+		t.Fatal(err)
+	}
+	if s := decoder.lookup(42); s != "bash" {
+		t.Error("lookup failed:", s)
+	}
+	if s := decoder.lookup(0); s != "" {
+		t.Error("id 0 is not interned:", s)
+	}
+	if s := decoder.lookup(43); s != "" {
+		t.Error("unknown id:", s)
+	}
+	if missed := decoder.Missed(); len(missed) != 1 || missed[0] != 43 {
+		t.Error("missed failed:", missed)
+	}
+	if missed := decoder.Missed(); len(missed) != 0 {
+		t.Error("missed should be reset:", missed)
+	}
+	// the dictionary is full, only the least recently used id is evicted
+	for id := uint64(1000); id < 1000+internMaxSize-1; id++ {
+		decoder.ReInit(internRecord(id, "x"))
+		if err := decoder.DecodeIntern(); err != nil {
+			t.Fatal(err)
+		}
+	}
+	decoder.lookup(42)
+	decoder.ReInit(internRecord(7, "sshd"))
+	if err := decoder.DecodeIntern(); err != nil {
+		t.Fatal(err)
+	}
+	if s := decoder.lookup(42); s != "bash" {
+		t.Error("recently used id is evicted:", s)
+	}
+	if s := decoder.lookup(1000); s != "" {
+		t.Error("least recently used id is kept:", s)
+	}
+	if s := decoder.lookup(7); s != "sshd" {
+		t.Error("lookup failed:", s)
+	}
+}
+
+// the types in Go must be the same as the defines in kern
+func TestHookTypes(t *testing.T) {
+	types := map[string]int{
+		"INTERN_STRING":         InternType,
+		"SECURITY_INODE_UNLINK": SecurityInodeUnlinkType,
+		"SCHED_PROCESS_FORK":    SchedProcessForkType,
+		"SCHED_PROCESS_EXEC":    SchedProcessExecType,
+		"SCHED_PROCESS_EXIT":    SchedProcessExitType,
+		"EXEC_ARGV_STAGING":     ExecArgvStagingType,
+		"RAW_SYS_ENTER":         RawSysEnterType,
+		"RAW_SYS_EXIT":          RawSysExitType,
+		"SYS_BPF_DENY":          SysBpfDenyType,
+	}
+	file, err := os.Open("../../kern/include/define.h")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer file.Close()
+	defineRe := regexp.MustCompile(`^#define\s+(\w+)\s+(\d+)`)
+	found := 0
+	scanner := bufio.NewScanner(file)
+	for scanner.Scan() {
+		m := defineRe.FindStringSubmatch(scanner.Text())
+		if m == nil {
+			continue
+		}
+		want, ok := types[m[1]]
+		if !ok {
+			continue
+		}
+		found++
+		if v, _ := strconv.Atoi(m[2]); v != want {
+			t.Errorf("%s is %d in kern, %d in Go", m[1], v, want)
+		}
+	}
+	if found != len(types) {
+		t.Errorf("%d of %d types are found in define.h", found, len(types))
+	}
+}
@@ -1,9 +1,8 @@
 package decoder
 
+//go:generate go run ../../tools/schemagen -mode context -o context_gen.go
+
 import (
-	"bytes"
-	"encoding/binary"
-	"fmt"
 	"hades-ebpf/user/cache"
 	"sync"
 
@@ -46,17 +45,19 @@ type Context struct {
 	// SessionID is get from task->sessionid. It usually
 	// indicates the tty number
 	SessionID uint32 `json:"sessionid"`
+	// The intern ids of comm, pcomm and nodename, see intern.go
+	CommID     uint64 `json:"-"`
+	PCommID    uint64 `json:"-"`
+	NodenameID uint64 `json:"-"`
+	// Retval is the return value of the syscall
+	RetVal uint64 `json:"retval"`
+	Argnum uint8  `json:"-"`
 	// Comm is the task->comm
 	Comm string `json:"comm"`
 	// PComm is the parent task->comm
 	PComm string `json:"pcomm"`
 	// Nodename is the uts namespace nodename
 	Nodename string `json:"nodename"`
-	// Retval is the return value of the syscall
-	RetVal uint64 `json:"retval"`
-	Argnum uint8  `json:"-"`
-	// Padding field for memory align
-	_ [3]byte `json:"-"`
 	// Extra context value from event and user space
 	ExeHash  string `json:"exe_hash"`
 	Username string `json:"username"`
@@ -67,41 +68,27 @@ type Context struct {
 	PodName  string `json:"pod_name"`
 }
 
+// DecodeContext decodes the context_t, or the compact header if it's set
+func (ctx *Context) DecodeContext(decoder *EbpfDecoder) error {
+	if decoder.compact {
+		return ctx.decodeCompact(decoder)
+	}
+	return ctx.decodeFull(decoder)
+}
+
 // GetSizeBytes returns the bytes of the context in kern space
 // and padding of the struct is also included.
 func (Context) GetSizeBytes() int {
-	return 168
-}
-
-func (ctx *Context) DecodeContext(decoder *EbpfDecoder) error {
-	offset := decoder.cursor
-	if len(decoder.buffer[offset:]) < ctx.GetSizeBytes() {
-		return fmt.Errorf("can't read context from buffer: buffer too short")
-	}
-	ctx.Starttime = binary.LittleEndian.Uint64(decoder.buffer[offset : offset+8])
-	ctx.CgroupID = binary.LittleEndian.Uint64(decoder.buffer[offset+8 : offset+16])
-	ctx.Pns = binary.LittleEndian.Uint32(decoder.buffer[offset+16 : offset+20])
-	ctx.Type = binary.LittleEndian.Uint32(decoder.buffer[offset+20 : offset+24])
-	ctx.Pid = binary.LittleEndian.Uint32(decoder.buffer[offset+24 : offset+28])
-	ctx.Tid = binary.LittleEndian.Uint32(decoder.buffer[offset+28 : offset+32])
-	ctx.Uid = binary.LittleEndian.Uint32(decoder.buffer[offset+32 : offset+36])
-	ctx.Gid = binary.LittleEndian.Uint32(decoder.buffer[offset+36 : offset+40])
-	ctx.Ppid = binary.LittleEndian.Uint32(decoder.buffer[offset+40 : offset+44])
-	ctx.Pgid = binary.LittleEndian.Uint32(decoder.buffer[offset+44 : offset+48])
-	ctx.SessionID = binary.LittleEndian.Uint32(decoder.buffer[offset+48 : offset+52])
-	ctx.Comm = string(bytes.TrimRight(decoder.buffer[offset+52:offset+68], "\x00"))
-	ctx.PComm = string(bytes.TrimRight(decoder.buffer[offset+68:offset+84], "\x00"))
-	ctx.Nodename = string(bytes.Trim(decoder.buffer[offset+84:offset+148], "\x00"))
-	ctx.RetVal = uint64(binary.LittleEndian.Uint64(decoder.buffer[offset+148 : offset+156]))
-	ctx.Argnum = uint8(binary.LittleEndian.Uint16(decoder.buffer[offset+156 : offset+168]))
-	decoder.cursor += ctx.GetSizeBytes()
-	return nil
+	return ContextSize
 }
 
 // FillContext get some extra field from Event and userspace caches
 func (c *Context) FillContext(name, exe string) {
 	c.Syscall = name
 	c.Exe = exe
+	// learn the process tree mirror from the context
+	cache.DefaultProcessCache.Set(c.Pid, c.Ppid, c.Comm)
+	cache.DefaultProcessCache.Set(c.Ppid, 0, c.PComm)
 	c.PpidArgv = cache.DefaultArgvCache.Get(c.Ppid)
 	c.PgidArgv = cache.DefaultArgvCache.Get(c.Pgid)
 	c.PodName = cache.DefaultNsCache.Get(c.Pid, c.Pns)
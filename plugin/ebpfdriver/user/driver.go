@@ -4,19 +4,26 @@ import (
 	"bytes"
 	"context"
 	_ "embed"
+	"errors"
 	"fmt"
 	"hades-ebpf/user/decoder"
-	"hades-ebpf/user/event"
+	"hades-ebpf/user/filter"
+	"hades-ebpf/user/filter/window"
 	"hades-ebpf/user/helper"
 	"hades-ebpf/user/share"
 	"math"
 	"os"
 	"strconv"
+	"sync"
+	"sync/atomic"
 	"time"
 
 	"github.com/chriskaliX/SDK"
 	"github.com/chriskaliX/SDK/transport/protocol"
 	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/asm"
+	"github.com/cilium/ebpf/features"
+	"github.com/cilium/ebpf/ringbuf"
 	manager "github.com/ehids/ebpfmanager"
 	"github.com/robfig/cron/v3"
 	"go.uber.org/zap"
@@ -26,21 +33,60 @@ import (
 //go:embed hades_ebpf_driver.o
 var _bytecode []byte
 
+// spec of the bytecode, parsed once for the feature checks
+var (
+	spec     *ebpf.CollectionSpec
+	specErr  error
+	specOnce sync.Once
+)
+
 // config
 const configMap = "config_map"
 const conf_DENY_BPF uint32 = 0
 const conf_STEXT uint32 = 1
 const conf_ETEXT uint32 = 2
+const conf_ARGV_BYTES_BUDGET uint32 = 3
+const conf_ARGV_ELEMS_BUDGET uint32 = 4
+
+// the ceilings of the argv budgets, MAX_ARGV_PER_SYSCALL and STR_ARR_MAX_ELEM
+// in kern/include/utils_buf.h
+const (
+	maxArgvBytes = 8192
+	maxArgvElems = 127
+)
 const eventMap = "exec_events"
+const eventRingbufMap = "exec_events_ringbuf"
+
+// load-time constants, see LOAD_CONSTANT in define.h
+const constRingbuf = "hades_ringbuf"
+const constTaskStorage = "hades_task_storage"
+const constInternParts = "hades_intern_parts"
+const constCompactHeader = "hades_compact_header"
+
+// the ids of the interned strings sent to the workers, see intern.go
+const internSentMap = "intern_sent"
+
+// execve argv/envp staging
+const syscallBufferMap = "syscall_buffer_cache"
+const taskStorageMap = "syscall_buffer_storage"
+
+// bpf_loop flavours of the execve(at) enter programs
+var loopPrograms = map[string]string{
+	"sys_enter_execve":   "sys_enter_execve_loop",
+	"sys_enter_execveat": "sys_enter_execveat_loop",
+}
 
-// filters
-const filterPid = "pid_filter"
+// the tgid of the driver, it's always filtered in kern space
+const constSelfTgid = "hades_self_tgid"
 
 // Task
 const EnableDenyBPF = 10
 const DisableDenyBPF = 11
-
-var rawdata = make(map[string]string, 1)
+const SetExecStageDisable = 12
+const DumpStats = 13
+const SetLatency = 14
+const SetKernelFilter = 15
+const SetRateLimit = 16
 
 // Driver contains the ebpfmanager and eventDecoder. By default, Driver
 // is a singleton and it's not thread-safe
@@ -50,6 +96,18 @@ type Driver struct {
 	context context.Context
 	cancel  context.CancelFunc
 	cronM   *cron.Cron
+	// ringbuf is used instead of the perf_event_array if the kernel
+	// supports BPF_MAP_TYPE_RINGBUF (5.8+)
+	ringbuf *ringbuf.Reader
+	// syscalls routed in the raw_tracepoint dispatcher
+	rawSyscalls []uint32
+	// the events are partitioned to the workers by pid
+	workers []*decodeWorker
+	// compactHeader is whether the events start with the compact header
+	compactHeader bool
+	kernelFilter  filter.KernelFilter
+	// the last suppressed counters of the rate limit, see ratelimit.go
+	suppressed map[rateKey]uint64
 }
 
 type IDriver interface {
@@ -65,31 +123,27 @@ func NewDriver(s SDK.ISandbox) (*Driver, error) {
 	driver.Sandbox = s
 	// init ebpfmanager with maps and perf_events
 	driver.Manager = &manager.Manager{
-		PerfMaps: []*manager.PerfMap{
-			{
-				Map: manager.Map{Name: eventMap},
-				PerfMapOptions: manager.PerfMapOptions{
-					PerfRingBufferSize: 256 * os.Getpagesize(),
-					DataHandler:        driver.dataHandler,
-					LostHandler:        driver.lostHandler,
-				},
-			},
-		},
 		Maps: []*manager.Map{
 			{Name: configMap},
-			{Name: filterPid},
+			{Name: statsMap},
+			{Name: latencyMap},
+			{Name: internSentMap},
+			{Name: rateLimitMap},
 		},
 	}
+	for _, name := range append(filter.KernelMaps, window.KernelMaps...) {
+		driver.Manager.Maps = append(driver.Manager.Maps, &manager.Map{Name: name})
+	}
+	driver.Manager.Probes = append(driver.Manager.Probes, procTreeProbes...)
+	driver.Manager.Maps = append(driver.Manager.Maps, &manager.Map{Name: procTreeMap})
+	driver.Manager.Probes = append(driver.Manager.Probes, socketPeerProbes...)
+	driver.Manager.Maps = append(driver.Manager.Maps, &manager.Map{Name: socketPeerMap})
 	// Get all registed events probes and maps, add into the manager
 	for _, event := range decoder.Events {
 		driver.Manager.Probes = append(driver.Manager.Probes, event.GetProbes()...)
 		driver.Manager.Maps = append(driver.Manager.Maps, event.GetMaps()...)
 	}
-	// init manager with options
-	// TODO: High CPU performance here
-	// github.com/ehids/ebpfmanager.(*Probe).Init
-	// github.com/ehids/ebpfmanager.getSyscallFnNameWithKallsyms
-	err := driver.Manager.InitWithOptions(bytes.NewReader(_bytecode), manager.Options{
+	options := manager.Options{
 		DefaultKProbeMaxActive: 512,
 		VerifierOptions: ebpf.CollectionOptions{
 			Programs: ebpf.ProgramOptions{
@@ -101,21 +155,233 @@ func NewDriver(s SDK.ISandbox) (*Driver, error) {
 			Cur: math.MaxUint64,
 			Max: math.MaxUint64,
 		},
+	}
+	driver.setOutput(&options)
+	driver.setStaging(&options)
+	driver.setArgvCapture(&options)
+	driver.setTrampolines(&options)
+	driver.setRawSyscalls(&options)
+	driver.setHeader(&options)
+	var pidTreeCompact uint64
+	if share.PidTreeCompact {
+		pidTreeCompact = 1
+	}
+	options.ConstantEditors = append(options.ConstantEditors, manager.ConstantEditor{
+		Name:  constPidTreeCompact,
+		Value: pidTreeCompact,
+	})
+	options.ConstantEditors = append(options.ConstantEditors, manager.ConstantEditor{
+		Name:  constSelfTgid,
+		Value: uint64(os.Getpid()),
+	})
+	// the interned strings are sent to every worker once
+	options.ConstantEditors = append(options.ConstantEditors, manager.ConstantEditor{
+		Name:  constInternParts,
+		Value: uint64(workerCount()),
 	})
+	// init manager with options
+	// TODO: High CPU performance here
+	// github.com/ehids/ebpfmanager.(*Probe).Init
+	// github.com/ehids/ebpfmanager.getSyscallFnNameWithKallsyms
+	err := driver.Manager.InitWithOptions(bytes.NewReader(_bytecode), options)
 	driver.context, driver.cancel = context.WithCancel(s.Context())
 	return driver, err
 }
 
-func (d *Driver) Start() error {
-	return d.Manager.Start()
+// setOutput decides the way that events are sent to the userspace. The
+// ringbuf is preferred since it's shared across CPUs, keeps the events in
+// order and wastes less memory. If the ringbuf is not compiled in the
+// driver or not supported by the kernel, fallback to the perf_event_array.
+func (d *Driver) setOutput(options *manager.Options) {
+	useRingbuf := false
+	if haveMap(eventRingbufMap) {
+		if err := features.HaveMapType(ebpf.RingBuf); err == nil {
+			useRingbuf = true
+		} else {
+			// The map must be created even it's never used, change the
+			// type to the perf_event_array, so it can be loaded.
+			setMapSpecEditor(options, eventRingbufMap, manager.MapSpecEditor{
+				Type:       ebpf.PerfEventArray,
+				MaxEntries: 1,
+				EditorFlag: manager.EditType | manager.EditMaxEntries,
+			})
+		}
+	}
+	var ringbufEnabled uint64
+	if useRingbuf {
+		ringbufEnabled = 1
+		d.Manager.Maps = append(d.Manager.Maps, &manager.Map{Name: eventRingbufMap})
+	} else {
+		d.Manager.PerfMaps = append(d.Manager.PerfMaps, &manager.PerfMap{
+			Map: manager.Map{Name: eventMap},
+			PerfMapOptions: manager.PerfMapOptions{
+				PerfRingBufferSize: 256 * os.Getpagesize(),
+				DataHandler:        d.dataHandler,
+				LostHandler:        d.lostHandler,
+			},
+		})
+	}
+	// always rewrite the constant, or the value in the bytecode is undefined
+	options.ConstantEditors = append(options.ConstantEditors, manager.ConstantEditor{
+		Name:  constRingbuf,
+		Value: ringbufEnabled,
+	})
+	zap.S().Infof("event output with ringbuf: %t", useRingbuf)
+}
+
+// setHeader decides the header of the events. The compact header is sent
+// in place of the context_t if it's set, it keeps the state of a stream by
+// cpu and worker in kern space, so the workers are limited.
+func (d *Driver) setHeader(options *manager.Options) {
+	d.compactHeader = share.CompactHeader
+	if d.compactHeader && workerCount() > decoder.HeaderStreams {
+		zap.S().Warnf("compact header is disabled, decode workers more than %d", decoder.HeaderStreams)
+		d.compactHeader = false
+	}
+	var compactHeader uint64
+	if d.compactHeader {
+		compactHeader = 1
+	}
+	options.ConstantEditors = append(options.ConstantEditors, manager.ConstantEditor{
+		Name:  constCompactHeader,
+		Value: compactHeader,
+	})
+	zap.S().Infof("compact header: %t", d.compactHeader)
+}
+
+// setStaging decides where the argv/envp of execve are staged between the
+// enter and the exit. Task-local storage is used if it's compiled in (CO-RE)
+// and supported by the kernel (5.11+), or the fixed-size hash is used.
+func (d *Driver) setStaging(options *manager.Options) {
+	useTaskStorage := false
+	if haveMap(taskStorageMap) {
+		if features.HaveMapType(ebpf.TaskStorage) == nil &&
+			features.HaveProgramHelper(ebpf.TracePoint, asm.FnGetCurrentTaskBtf) == nil {
+			useTaskStorage = true
+		} else {
+			// Not supported, make it a hash so it can be loaded
+			setMapSpecEditor(options, taskStorageMap, manager.MapSpecEditor{
+				Type:       ebpf.Hash,
+				MaxEntries: 1,
+				EditorFlag: manager.EditType | manager.EditMaxEntries,
+			})
+		}
+	}
+	var taskStorageEnabled uint64
+	if useTaskStorage {
+		taskStorageEnabled = 1
+		// the hash is not used anymore, do not preallocate 512 * 8KB for it
+		setMapSpecEditor(options, syscallBufferMap, manager.MapSpecEditor{
+			MaxEntries: 1,
+			EditorFlag: manager.EditMaxEntries,
+		})
+	}
+	options.ConstantEditors = append(options.ConstantEditors, manager.ConstantEditor{
+		Name:  constTaskStorage,
+		Value: taskStorageEnabled,
+	})
+	zap.S().Infof("execve staging with task storage: %t", useTaskStorage)
+}
+
+// setArgvCapture picks the bpf_loop flavour of the execve(at) enter programs
+// if the kernel has the helper (5.17+ or backported), the unrolled one is
+// kept for the others. Programs not picked are excluded, or they'll fail the
+// whole loading.
+func (d *Driver) setArgvCapture(options *manager.Options) {
+	useLoop := features.HaveProgramHelper(ebpf.TracePoint, asm.FnLoop) == nil
+	for _, loop := range loopPrograms {
+		if !haveProgram(loop) {
+			useLoop = false
+		}
+	}
+	for origin, loop := range loopPrograms {
+		if !useLoop {
+			if haveProgram(loop) {
+				options.ExcludedFunctions = append(options.ExcludedFunctions, loop)
+			}
+			continue
+		}
+		for _, probe := range d.Manager.Probes {
+			if probe.EbpfFuncName == origin {
+				probe.EbpfFuncName = loop
+			}
+		}
+		options.ExcludedFunctions = append(options.ExcludedFunctions, origin)
+	}
+	zap.S().Infof("execve argv capture with bpf_loop: %t", useLoop)
+}
+
+func setMapSpecEditor(options *manager.Options, name string, editor manager.MapSpecEditor) {
+	if options.MapSpecEditors == nil {
+		options.MapSpecEditors = make(map[string]manager.MapSpecEditor)
+	}
+	options.MapSpecEditors[name] = editor
+}
+
+// haveProgram checks whether the program is compiled in the driver
+func haveProgram(name string) bool {
+	specOnce.Do(loadSpec)
+	if specErr != nil {
+		return false
+	}
+	_, ok := spec.Programs[name]
+	return ok
+}
+
+func loadSpec() {
+	spec, specErr = ebpf.LoadCollectionSpecFromReader(bytes.NewReader(_bytecode))
+}
+
+// haveMap checks whether the map is compiled in the driver. Some of the
+// maps are only compiled in CO-RE or with newer kernel headers.
+func haveMap(name string) bool {
+	specOnce.Do(loadSpec)
+	if specErr != nil {
+		return false
+	}
+	_, ok := spec.Maps[name]
+	return ok
+}
+
+func (d *Driver) Start() (err error) {
+	d.startWorkers()
+	if err = d.Manager.Start(); err != nil {
+		return
+	}
+	for _, m := range d.Manager.Maps {
+		if m.Name != eventRingbufMap {
+			continue
+		}
+		bpfmap, err := decoder.GetMap(d.Manager, eventRingbufMap)
+		if err != nil {
+			return err
+		}
+		if d.ringbuf, err = ringbuf.NewReader(bpfmap); err != nil {
+			return err
+		}
+		go d.ringbufResolve()
+	}
+	return
+}
+
+// ringbufResolve reads the events from the ringbuf, the records are handled
+// by the same dataHandler as the perf_event_array
+func (d *Driver) ringbufResolve() {
+	for {
+		record, err := d.ringbuf.Read()
+		if err != nil {
+			if errors.Is(err, ringbuf.ErrClosed) {
+				return
+			}
+			zap.S().Error(err)
+			continue
+		}
+		d.dataHandler(0, record.RawSample, nil, d.Manager)
+	}
 }
 
 // Init the driver with default value
 func (d *Driver) PostRun() (err error) {
-	// Get Pid filter
-	if err := helper.MapUpdate(d.Manager, filterPid, uint32(os.Getpid()), uint32(0)); err != nil {
-		zap.S().Error(err)
-	}
 	// STEXT ETEXT for rootkit detection
 	if _stext := helper.Ksyms.Get("_stext"); _stext != nil {
 		if err := helper.MapUpdate(d.Manager, configMap, conf_STEXT, _stext.Address); err != nil {
@@ -127,6 +393,36 @@ func (d *Driver) PostRun() (err error) {
 			zap.S().Error(err)
 		}
 	}
+	// budgets for the bpf_loop argv capture, 0 for the default
+	if share.ArgvBytesBudget > maxArgvBytes {
+		zap.S().Warnf("argv-bytes %d is over the ceiling, %d is used", share.ArgvBytesBudget, maxArgvBytes)
+		share.ArgvBytesBudget = maxArgvBytes
+	}
+	if share.ArgvElemsBudget > maxArgvElems {
+		zap.S().Warnf("argv-elems %d is over the ceiling, %d is used", share.ArgvElemsBudget, maxArgvElems)
+		share.ArgvElemsBudget = maxArgvElems
+	}
+	if err := helper.MapUpdate(d.Manager, configMap, conf_ARGV_BYTES_BUDGET, uint64(share.ArgvBytesBudget)); err != nil {
+		zap.S().Error(err)
+	}
+	if err := helper.MapUpdate(d.Manager, configMap, conf_ARGV_ELEMS_BUDGET, uint64(share.ArgvElemsBudget)); err != nil {
+		zap.S().Error(err)
+	}
+	if err := d.seedProcTree(); err != nil {
+		zap.S().Error(err)
+	}
+	if err := d.updateSyscallBitmap(); err != nil {
+		zap.S().Error(err)
+	}
+	if err := d.setLatency(strconv.FormatBool(share.Latency)); err != nil {
+		zap.S().Error(err)
+	}
+	if err := d.setRateLimit(share.RateLimit, share.RateBurst); err != nil {
+		zap.S().Error(err)
+	}
+	if err := window.LoadKernel(d.Manager); err != nil {
+		zap.S().Error(err)
+	}
 	zap.S().Info("init configuration has been loaded")
 	// By default, we do not ban BPF program unless you choose on this..
 	d.cronM = cron.New(cron.WithSeconds())
@@ -145,6 +441,12 @@ func (d *Driver) PostRun() (err error) {
 			zap.S().Error(err)
 		}
 	}
+	if _, err := d.cronM.AddFunc(statsInterval, d.sendStats); err != nil {
+		zap.S().Error(err)
+	}
+	if _, err := d.cronM.AddFunc(rateLimitInterval, d.sendSuppressed); err != nil {
+		zap.S().Error(err)
+	}
 	d.cronM.Start()
 
 	go d.taskResolve()
@@ -165,6 +467,9 @@ func (d *Driver) Close(UID string) (err error) {
 
 func (d *Driver) Stop() error {
 	d.cancel()
+	if d.ringbuf != nil {
+		d.ringbuf.Close()
+	}
 	return d.Manager.Stop(manager.CleanAll)
 }
 
@@ -182,60 +487,43 @@ func (d *Driver) taskResolve() {
 			if err := helper.MapUpdate(d.Manager, configMap, conf_DENY_BPF, uint64(0)); err != nil {
 				zap.S().Error(err)
 			}
+		case SetExecStageDisable:
+			if err := d.setExecStageDisable(task.Data); err != nil {
+				zap.S().Error(err)
+			}
+		case DumpStats:
+			d.dumpStats()
+		case SetLatency:
+			if err := d.setLatency(task.Data); err != nil {
+				zap.S().Error(err)
+			}
+		case SetKernelFilter:
+			config, err := filter.LoadKernelConfigFromTask(task)
+			if err != nil {
+				zap.S().Error(err)
+				break
+			}
+			if err = d.kernelFilter.Apply(d.Manager, config); err != nil {
+				zap.S().Error(err)
+			}
+		case SetRateLimit:
+			if err := d.setRateLimitTask(task.Data); err != nil {
+				zap.S().Error(err)
+			}
 		}
 		time.Sleep(time.Second)
 	}
 }
 
-// dataHandler handles the data from eBPF kernel space
+// dataHandler handles the data from eBPF kernel space, the data is decoded
+// by the workers
 func (d *Driver) dataHandler(cpu int, data []byte, perfmap *manager.PerfMap, manager *manager.Manager) {
-	// get and decode the context
-	ctx := decoder.NewContext()
-	decoder.DefaultDecoder.ReInit(data)
-	err := ctx.DecodeContext(decoder.DefaultDecoder)
-	if err != nil {
-		return
-	}
-	defer decoder.PutContext(ctx)
-	// get the event and set context into event
-	eventDecoder := decoder.Events[ctx.Type]
-	eventDecoder.SetContext(ctx)
-	err = eventDecoder.DecodeEvent(decoder.DefaultDecoder)
-	if err == event.ErrFilter {
-		// it's been filtered
-		return
-	}
-	if err != nil {
-		// Ignore
-		if err == event.ErrIgnore {
-			return
-		}
-		zap.S().Errorf("error: %s", err)
-		return
-	}
-	// Fillup the context by the values that Event offers
-	ctx.FillContext(eventDecoder.Name(), eventDecoder.GetExe())
-	// marshal the data
-	result, err := decoder.MarshalJson(eventDecoder)
-	if err != nil {
-		zap.S().Error(err)
-		return
-	}
-	rawdata["data"] = result
-	// send the record
-	rec := &protocol.Record{
-		DataType: 1000,
-		Data: &protocol.Payload{
-			Fields: rawdata,
-		},
-	}
-	if err = d.Sandbox.SendRecord(rec); err != nil {
-		zap.S().Error(err)
-	}
+	d.dispatch(data)
 }
 
 // lostHandler handles the data for errors
 func (d *Driver) lostHandler(CPU int, count uint64, perfMap *manager.PerfMap, manager *manager.Manager) {
+	atomic.AddUint64(&lostCount, count)
 	rawdata := make(map[string]string)
 	rawdata["data"] = strconv.FormatUint(count, 10)
 	rec := &protocol.Record{
@@ -29,18 +29,8 @@ func (ModuleScan) ID() uint32 {
 // In DecodeEvent, get the count of /proc/modules, and we do compare them
 func (m *ModuleScan) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
 	m.UserCount = 0
-	var index uint8
 	var file *os.File
-	if err = e.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = e.DecodeUint32(&m.IterCount); err != nil {
-		return
-	}
-	if err = e.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = e.DecodeUint32(&m.KernelCount); err != nil {
+	if err = m.decodeSchema(e); err != nil {
 		return
 	}
 	if file, err = os.Open("/proc/modules"); err != nil {
@@ -2,7 +2,6 @@ package event
 
 import (
 	"hades-ebpf/user/decoder"
-	"strings"
 
 	manager "github.com/ehids/ebpfmanager"
 )
@@ -31,28 +30,7 @@ func (CallUsermodeHelper) Name() string {
 }
 
 func (c *CallUsermodeHelper) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
-	if c.Path, err = e.DecodeString(); err != nil {
-		return
-	}
-	var Argv []string
-	var Envp []string
-	if Argv, err = e.DecodeStrArray(); err != nil {
-		return
-	}
-	c.Argv = strings.Join(Argv, " ")
-	if Envp, err = e.DecodeStrArray(); err != nil {
-		return
-	}
-	c.Envp = strings.Join(Envp, " ")
-	var index uint8
-	if err = e.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = e.DecodeInt32(&c.Wait); err != nil {
-		return
-	}
-	c.Exe, err = e.DecodeString()
-	return
+	return c.decodeSchema(e)
 }
 
 func (CallUsermodeHelper) GetProbes() []*manager.Probe {
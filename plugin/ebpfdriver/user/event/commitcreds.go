@@ -30,26 +30,7 @@ func (c *CommitCreds) GetExe() string {
 }
 
 func (c *CommitCreds) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
-	var index uint8
-	if err = e.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = e.DecodeUint32(&c.NewUid); err != nil {
-		return
-	}
-	if err = e.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = e.DecodeUint32(&c.OldUid); err != nil {
-		return
-	}
-	if c.Exe, err = e.DecodeString(); err != nil {
-		return
-	}
-	if c.PidTree, err = e.DecodePidTree(&c.PrivEscalation); err != nil {
-		return
-	}
-	return
+	return c.decodeSchema(e)
 }
 
 func (CommitCreds) GetProbes() []*manager.Probe {
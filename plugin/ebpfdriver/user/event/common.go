@@ -1,5 +1,7 @@
 package event
 
+//go:generate go run ../../tools/schemagen -mode events -o schema_gen.go
+
 import (
 	"bufio"
 	"errors"
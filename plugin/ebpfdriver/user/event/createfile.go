@@ -31,7 +31,7 @@ func (i *InodeCreate) GetExe() string {
 }
 
 func (i *InodeCreate) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
-	if i.Exe, err = e.DecodeString(); err != nil {
+	if i.Exe, err = e.DecodeExe(); err != nil {
 		return
 	}
 	if i.Filename, err = e.DecodeString(); err != nil {
@@ -30,19 +30,7 @@ func (d *DoInitModule) GetExe() string {
 }
 
 func (d *DoInitModule) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
-	if d.Modname, err = e.DecodeString(); err != nil {
-		return
-	}
-	if d.Exe, err = e.DecodeString(); err != nil {
-		return
-	}
-	if d.Pidtree, err = e.DecodePidTree(&d.PrivEscalation); err != nil {
-		return
-	}
-	if d.Cwd, err = e.DecodeString(); err != nil {
-		return
-	}
-	return
+	return d.decodeSchema(e)
 }
 
 func (d *DoInitModule) GetProbes() []*manager.Probe {
@@ -3,7 +3,6 @@ package event
 import (
 	"hades-ebpf/user/cache"
 	"hades-ebpf/user/decoder"
-	"hades-ebpf/user/filter/window"
 	"strings"
 
 	manager "github.com/ehids/ebpfmanager"
@@ -26,6 +25,7 @@ type ExecveAt struct {
 	SocketArgv         string `json:"socket_argv"`
 	PidTree            string `json:"pid_tree"`
 	Argv               string `json:"argv"`
+	ArgvTruncated      bool   `json:"argv_truncated"`
 	PrivEscalation     uint8  `json:"priv_esca"`
 	SSHConnection      string `json:"ssh_connection"`
 	LDPreload          string `json:"ld_preload"`
@@ -45,13 +45,7 @@ func (e *ExecveAt) GetExe() string {
 
 func (e *ExecveAt) DecodeEvent(decoder *decoder.EbpfDecoder) (err error) {
 	var dummy uint8
-	if e.Exe, err = decoder.DecodeString(); err != nil {
-		return
-	}
-	// Dynamic window for execve
-	// TODO: count for those ignored exe
-	if !window.WindowCheck(e.Exe, window.DefaultExeWindow) {
-		err = ErrFilter
+	if e.Exe, err = decoder.DecodeExe(); err != nil {
 		return
 	}
 	if e.Cwd, err = decoder.DecodeString(); err != nil {
@@ -79,15 +73,11 @@ func (e *ExecveAt) DecodeEvent(decoder *decoder.EbpfDecoder) (err error) {
 		return
 	}
 	var strArr []string
-	if strArr, err = decoder.DecodeStrArray(); err != nil {
+	if strArr, e.ArgvTruncated, err = decoder.DecodeStrArrayTruncated(); err != nil {
 		zap.S().Error("execveat cmdline error")
 		return
 	}
 	e.Argv = strings.Join(strArr, " ")
-	if !window.WindowCheck(e.Argv, window.DefaultArgvWindow) {
-		err = ErrFilter
-		return
-	}
 	var envs []string
 	if envs, err = decoder.DecodeStrArray(); err != nil {
 		return
@@ -29,13 +29,7 @@ func (i *InodeLink) GetExe() string {
 }
 
 func (i *InodeLink) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
-	if i.Old, err = e.DecodeString(); err != nil {
-		return
-	}
-	if i.New, err = e.DecodeString(); err != nil {
-		return
-	}
-	return
+	return i.decodeSchema(e)
 }
 
 func (InodeLink) GetProbes() []*manager.Probe {
@@ -29,13 +29,7 @@ func (i *InodeRename) GetExe() string {
 }
 
 func (i *InodeRename) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
-	if i.Old, err = e.DecodeString(); err != nil {
-		return
-	}
-	if i.New, err = e.DecodeString(); err != nil {
-		return
-	}
-	return
+	return i.decodeSchema(e)
 }
 
 func (InodeRename) GetProbes() []*manager.Probe {
@@ -46,6 +40,13 @@ func (InodeRename) GetProbes() []*manager.Probe {
 			EbpfFuncName:     "kprobe_security_inode_rename",
 			AttachToFuncName: "security_inode_rename",
 		},
+		// unlink emits nothing, it only invalidates the kernel exe path cache
+		{
+			UID:              "KprobeSecurityInodeUnlink",
+			Section:          "kprobe/security_inode_unlink",
+			EbpfFuncName:     "kprobe_security_inode_unlink",
+			AttachToFuncName: "security_inode_unlink",
+		},
 	}
 }
 
@@ -28,14 +28,8 @@ func (k *KernelReadFile) GetExe() string {
 	return k.Exe
 }
 
-func (k *KernelReadFile) DecodeEvent(decoder *decoder.EbpfDecoder) (err error) {
-	if k.Filename, err = decoder.DecodeString(); err != nil {
-		return
-	}
-	if err = decoder.DecodeInt32(&k.TypeId); err != nil {
-		return
-	}
-	return
+func (k *KernelReadFile) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
+	return k.decodeSchema(e)
 }
 
 func (KernelReadFile) GetProbes() []*manager.Probe {
@@ -27,21 +27,8 @@ func (m *MemfdCreate) GetExe() string {
 	return m.Exe
 }
 
-func (m *MemfdCreate) DecodeEvent(decoder *decoder.EbpfDecoder) (err error) {
-	var index uint8
-	if m.Exe, err = decoder.DecodeString(); err != nil {
-		return
-	}
-	if m.Uname, err = decoder.DecodeString(); err != nil {
-		return
-	}
-	if err = decoder.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = decoder.DecodeUint32(&m.Flags); err != nil {
-		return
-	}
-	return
+func (m *MemfdCreate) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
+	return m.decodeSchema(e)
 }
 
 func (m *MemfdCreate) GetProbes() []*manager.Probe {
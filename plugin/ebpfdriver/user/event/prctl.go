@@ -38,7 +38,7 @@ func (p *Prctl) DecodeEvent(decoder *decoder.EbpfDecoder) (err error) {
 	if err = decoder.DecodeInt32(&option); err != nil {
 		return
 	}
-	if p.Exe, err = decoder.DecodeString(); err != nil {
+	if p.Exe, err = decoder.DecodeExe(); err != nil {
 		return
 	}
 	switch option {
@@ -31,33 +31,8 @@ func (p *Ptrace) GetExe() string {
 	return p.Exe
 }
 
-func (p *Ptrace) DecodeEvent(decoder *decoder.EbpfDecoder) (err error) {
-	if p.Exe, err = decoder.DecodeString(); err != nil {
-		return
-	}
-	var index uint8
-	if err = decoder.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = decoder.DecodeInt64(&p.Requests); err != nil {
-		return
-	}
-	if err = decoder.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = decoder.DecodeInt64(&p.TargetPid); err != nil {
-		return
-	}
-	if err = decoder.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = decoder.DecodeUint64(&p.Addr); err != nil {
-		return
-	}
-	if p.PidTree, err = decoder.DecodePidTree(&p.PrivEscalation); err != nil {
-		return
-	}
-	return
+func (p *Ptrace) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
+	return p.decodeSchema(e)
 }
 
 func (Ptrace) GetProbes() []*manager.Probe {
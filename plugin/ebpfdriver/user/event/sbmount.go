@@ -31,30 +31,8 @@ func (s *SbMount) GetExe() string {
 	return s.Exe
 }
 
-func (s *SbMount) DecodeEvent(decoder *decoder.EbpfDecoder) (err error) {
-	var index uint8
-	if s.DevName, err = decoder.DecodeString(); err != nil {
-		return
-	}
-	if s.Path, err = decoder.DecodeString(); err != nil {
-		return
-	}
-	if s.Type, err = decoder.DecodeString(); err != nil {
-		return
-	}
-	if err = decoder.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = decoder.DecodeUint64(&s.Flags); err != nil {
-		return
-	}
-	if s.Exe, err = decoder.DecodeString(); err != nil {
-		return
-	}
-	if s.PidTree, err = decoder.DecodePidTree(&s.PrivEscalation); err != nil {
-		return
-	}
-	return
+func (s *SbMount) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
+	return s.decodeSchema(e)
 }
 
 func (SbMount) GetProbes() []*manager.Probe {
@@ -0,0 +1,193 @@
+// Code generated by schemagen from kern/include/schema.h. DO NOT EDIT.
+
+package event
+
+import (
+	"encoding/binary"
+	"hades-ebpf/user/decoder"
+	"strings"
+)
+
+// decodeSchema decodes the fields of commit_creds in the schema order
+func (c *CommitCreds) decodeSchema(e *decoder.EbpfDecoder) (err error) {
+	var b []byte
+	if b, err = e.DecodeFixed(10); err != nil {
+		return
+	}
+	c.NewUid = binary.LittleEndian.Uint32(b[1:5])
+	c.OldUid = binary.LittleEndian.Uint32(b[6:10])
+	if c.Exe, err = e.DecodeExe(); err != nil {
+		return
+	}
+	if c.PidTree, err = e.DecodePidTree(&c.PrivEscalation); err != nil {
+		return
+	}
+	return
+}
+
+// decodeSchema decodes the fields of do_init_module in the schema order
+func (d *DoInitModule) decodeSchema(e *decoder.EbpfDecoder) (err error) {
+	if d.Modname, err = e.DecodeString(); err != nil {
+		return
+	}
+	if d.Exe, err = e.DecodeExe(); err != nil {
+		return
+	}
+	if d.Pidtree, err = e.DecodePidTree(&d.PrivEscalation); err != nil {
+		return
+	}
+	if d.Cwd, err = e.DecodeString(); err != nil {
+		return
+	}
+	return
+}
+
+// decodeSchema decodes the fields of kernel_read_file in the schema order
+func (k *KernelReadFile) decodeSchema(e *decoder.EbpfDecoder) (err error) {
+	var b []byte
+	if k.Filename, err = e.DecodeString(); err != nil {
+		return
+	}
+	if b, err = e.DecodeFixed(5); err != nil {
+		return
+	}
+	k.TypeId = int32(binary.LittleEndian.Uint32(b[1:5]))
+	return
+}
+
+// decodeSchema decodes the fields of call_usermodehelper in the schema order
+func (c *CallUsermodeHelper) decodeSchema(e *decoder.EbpfDecoder) (err error) {
+	var b []byte
+	var arr []string
+	if c.Path, err = e.DecodeString(); err != nil {
+		return
+	}
+	if arr, err = e.DecodeStrArray(); err != nil {
+		return
+	}
+	c.Argv = strings.Join(arr, " ")
+	if arr, err = e.DecodeStrArray(); err != nil {
+		return
+	}
+	c.Envp = strings.Join(arr, " ")
+	if b, err = e.DecodeFixed(5); err != nil {
+		return
+	}
+	c.Wait = int32(binary.LittleEndian.Uint32(b[1:5]))
+	if c.Exe, err = e.DecodeExe(); err != nil {
+		return
+	}
+	return
+}
+
+// decodeSchema decodes the fields of security_bpf in the schema order
+func (s *SecurityBpf) decodeSchema(e *decoder.EbpfDecoder) (err error) {
+	var b []byte
+	if s.Exe, err = e.DecodeExe(); err != nil {
+		return
+	}
+	if b, err = e.DecodeFixed(5); err != nil {
+		return
+	}
+	s.Cmd = int32(binary.LittleEndian.Uint32(b[1:5]))
+	if s.ProgName, err = e.DecodeString(); err != nil {
+		return
+	}
+	if b, err = e.DecodeFixed(5); err != nil {
+		return
+	}
+	s.Type = binary.LittleEndian.Uint32(b[1:5])
+	return
+}
+
+// decodeSchema decodes the fields of anti_rkt_module in the schema order
+func (m *ModuleScan) decodeSchema(e *decoder.EbpfDecoder) (err error) {
+	var b []byte
+	if b, err = e.DecodeFixed(10); err != nil {
+		return
+	}
+	m.IterCount = binary.LittleEndian.Uint32(b[1:5])
+	m.KernelCount = binary.LittleEndian.Uint32(b[6:10])
+	return
+}
+
+// decodeSchema decodes the fields of sb_mount in the schema order
+func (s *SbMount) decodeSchema(e *decoder.EbpfDecoder) (err error) {
+	var b []byte
+	if s.DevName, err = e.DecodeString(); err != nil {
+		return
+	}
+	if s.Path, err = e.DecodeString(); err != nil {
+		return
+	}
+	if s.Type, err = e.DecodeString(); err != nil {
+		return
+	}
+	if b, err = e.DecodeFixed(9); err != nil {
+		return
+	}
+	s.Flags = binary.LittleEndian.Uint64(b[1:9])
+	if s.Exe, err = e.DecodeExe(); err != nil {
+		return
+	}
+	if s.PidTree, err = e.DecodePidTree(&s.PrivEscalation); err != nil {
+		return
+	}
+	return
+}
+
+// decodeSchema decodes the fields of inode_rename in the schema order
+func (i *InodeRename) decodeSchema(e *decoder.EbpfDecoder) (err error) {
+	if i.Old, err = e.DecodeString(); err != nil {
+		return
+	}
+	if i.New, err = e.DecodeString(); err != nil {
+		return
+	}
+	return
+}
+
+// decodeSchema decodes the fields of inode_link in the schema order
+func (i *InodeLink) decodeSchema(e *decoder.EbpfDecoder) (err error) {
+	if i.Old, err = e.DecodeString(); err != nil {
+		return
+	}
+	if i.New, err = e.DecodeString(); err != nil {
+		return
+	}
+	return
+}
+
+// decodeSchema decodes the fields of ptrace in the schema order
+func (p *Ptrace) decodeSchema(e *decoder.EbpfDecoder) (err error) {
+	var b []byte
+	if p.Exe, err = e.DecodeExe(); err != nil {
+		return
+	}
+	if b, err = e.DecodeFixed(27); err != nil {
+		return
+	}
+	p.Requests = int64(binary.LittleEndian.Uint64(b[1:9]))
+	p.TargetPid = int64(binary.LittleEndian.Uint64(b[10:18]))
+	p.Addr = binary.LittleEndian.Uint64(b[19:27])
+	if p.PidTree, err = e.DecodePidTree(&p.PrivEscalation); err != nil {
+		return
+	}
+	return
+}
+
+// decodeSchema decodes the fields of memfd_create in the schema order
+func (m *MemfdCreate) decodeSchema(e *decoder.EbpfDecoder) (err error) {
+	var b []byte
+	if m.Exe, err = e.DecodeExe(); err != nil {
+		return
+	}
+	if m.Uname, err = e.DecodeString(); err != nil {
+		return
+	}
+	if b, err = e.DecodeFixed(5); err != nil {
+		return
+	}
+	m.Flags = binary.LittleEndian.Uint32(b[1:5])
+	return
+}
@@ -27,26 +27,7 @@ func (s *SecurityBpf) GetExe() string {
 }
 
 func (s *SecurityBpf) DecodeEvent(e *decoder.EbpfDecoder) (err error) {
-	var index uint8
-	if s.Exe, err = e.DecodeString(); err != nil {
-		return
-	}
-	if err = e.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = e.DecodeInt32(&s.Cmd); err != nil {
-		return
-	}
-	if s.ProgName, err = e.DecodeString(); err != nil {
-		return
-	}
-	if err = e.DecodeUint8(&index); err != nil {
-		return
-	}
-	if err = e.DecodeUint32(&s.Type); err != nil {
-		return
-	}
-	return
+	return s.decodeSchema(e)
 }
 
 func (SecurityBpf) GetProbes() []*manager.Probe {
@@ -75,7 +75,7 @@ func (s *SocketBind) DecodeEvent(decoder *decoder.EbpfDecoder) (err error) {
 		// reuse
 		decoder.DecodeUint32BigEndian(&_flowinfo)
 	}
-	if s.Exe, err = decoder.DecodeString(); err != nil {
+	if s.Exe, err = decoder.DecodeExe(); err != nil {
 		return
 	}
 	if err = decoder.DecodeUint8(&index); err != nil {
@@ -77,7 +77,7 @@ func (s *SocketConnect) DecodeEvent(decoder *decoder.EbpfDecoder) (err error) {
 			return
 		}
 	}
-	s.Exe, err = decoder.DecodeString()
+	s.Exe, err = decoder.DecodeExe()
 	return
 }
 
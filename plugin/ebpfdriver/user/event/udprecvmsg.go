@@ -50,7 +50,7 @@ func (u *UdpRecvmsg) DecodeEvent(decoder *decoder.EbpfDecoder) (err error) {
 	if u.DnsData, err = decoder.DecodeString(); err != nil {
 		return
 	}
-	if u.Exe, err = decoder.DecodeString(); err != nil {
+	if u.Exe, err = decoder.DecodeExe(); err != nil {
 		return
 	}
 	return
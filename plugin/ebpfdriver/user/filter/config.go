@@ -24,3 +24,29 @@ func LoadConfigFromTask(t *protocol.Task) (*FilterConfig, error) {
 	}
 	return filterConfig, nil
 }
+
+// Kernel filter configuration received by the task, like
+// {"type": 0, "mode": {"cgroup": "allow"}, "add": {"cgroup": [1234]}}
+// type 0 is for all the event types, the modes are deny, allow and off,
+// and the filters are pid (tgid), uid, cgroup, pns, exe and file. The exe
+// and file filters share the path prefixes, like
+// {"mode": {"file": "off"}, "add_path": ["/opt/agent"]}
+type KernelFilterConfig struct {
+	Type uint32 `json:"type"`
+	// Reset makes the type back to the default modes
+	Reset      bool                `json:"reset"`
+	Mode       map[string]string   `json:"mode"`
+	Add        map[string][]uint64 `json:"add"`
+	Delete     map[string][]uint64 `json:"delete"`
+	AddPath    []string            `json:"add_path"`
+	DeletePath []string            `json:"delete_path"`
+}
+
+// Load the kernel filter configuration from task
+func LoadKernelConfigFromTask(t *protocol.Task) (*KernelFilterConfig, error) {
+	config := &KernelFilterConfig{}
+	if err := json.Unmarshal([]byte(t.GetData()), config); err != nil {
+		return nil, err
+	}
+	return config, nil
+}
@@ -1,45 +1,339 @@
 package filter
 
 import (
+	"errors"
+	"fmt"
 	"hades-ebpf/user/decoder"
-	"unsafe"
+	"hash/fnv"
+	"path"
 
 	"github.com/cilium/ebpf"
 	manager "github.com/ehids/ebpfmanager"
 )
 
+// The filters in kern space. The keys are in the filter maps, and the mode
+// of every filter is set by the event type in filter_scope, or for all the
+// types in filter_default. See "filters" in kern/include/define.h.
+const (
+	UidFilter     = "uid_filter"
+	PnsFilter     = "pns_filter"
+	PathFilter    = "path_filter"
+	ScopeMap      = "filter_scope"
+	ScopeDefault  = "filter_default"
+	KindPid       = "pid"
+	KindUid       = "uid"
+	KindCgroupID  = "cgroup"
+	KindPns       = "pns"
+	KindExe       = "exe"
+	KindFile      = "file"
+	ModeDeny      = 0
+	ModeAllow     = 1
+	ModeOff       = 2
+	scopeAllTypes = 0
+)
+
+// path_filter, see "path prefix filter" in kern/include/utils.h. The kern
+// side scans the first pathFilterScan bytes of the path, with the NUL.
+const (
+	pathFilterScan       = 64
+	configMap            = "config_map"
+	confPathFilterGen    = uint32(7)
+	confPathFilterActive = uint32(12)
+)
+
+// KernelMaps are the maps used by the KernelFilter
+var KernelMaps = []string{PidFilter, UidFilter, CgroupIdFilter, PnsFilter, PathFilter, ScopeMap, ScopeDefault}
+
+var modes = map[string]uint8{"deny": ModeDeny, "allow": ModeAllow, "off": ModeOff}
+
+// Scope is the mode of every filter, filter_scope_t in kern space
+type Scope struct {
+	Pid      uint8
+	Uid      uint8
+	CgroupID uint8
+	Pns      uint8
+	Exe      uint8
+	File     uint8
+}
+
+func (s *Scope) set(kind string, mode uint8) error {
+	switch kind {
+	case KindPid:
+		s.Pid = mode
+	case KindUid:
+		s.Uid = mode
+	case KindCgroupID:
+		s.CgroupID = mode
+	case KindPns:
+		s.Pns = mode
+	case KindExe:
+		s.Exe = mode
+	case KindFile:
+		s.File = mode
+	default:
+		return fmt.Errorf("unknown kernel filter %s", kind)
+	}
+	return nil
+}
+
 type KernelFilter struct{}
 
-func (filter *KernelFilter) Set(m *manager.Manager, name string, key interface{}) (err error) {
-	var _map *ebpf.Map
-	_map, err = decoder.GetMap(m, name)
+// mapOf returns the map of the filter, and the key in the type of the map.
+// pid is the tgid.
+func mapOf(kind string, value uint64) (name string, key interface{}, err error) {
+	switch kind {
+	case KindPid:
+		return PidFilter, uint32(value), nil
+	case KindUid:
+		return UidFilter, uint32(value), nil
+	case KindCgroupID:
+		return CgroupIdFilter, value, nil
+	case KindPns:
+		return PnsFilter, uint32(value), nil
+	}
+	return "", nil, fmt.Errorf("unknown kernel filter %s", kind)
+}
+
+func (filter *KernelFilter) Set(m *manager.Manager, kind string, value uint64) (err error) {
+	name, key, err := mapOf(kind, value)
+	if err != nil {
+		return
+	}
+	_map, err := decoder.GetMap(m, name)
+	if err != nil {
+		return
+	}
+	var zero uint32
+	return _map.Update(key, zero, ebpf.UpdateAny)
+}
+
+func (filter *KernelFilter) Delete(m *manager.Manager, kind string, value uint64) (err error) {
+	name, key, err := mapOf(kind, value)
 	if err != nil {
 		return
 	}
-	var value uint32 = 0
-	err = _map.Update(unsafe.Pointer(&key), unsafe.Pointer(&value), ebpf.UpdateAny)
+	_map, err := decoder.GetMap(m, name)
+	if err != nil {
+		return
+	}
+	if err = _map.Delete(key); errors.Is(err, ebpf.ErrKeyNotExist) {
+		err = nil
+	}
 	return
 }
 
-func (filter *KernelFilter) Delete(m *manager.Manager, name string, key interface{}) (err error) {
-	var _map *ebpf.Map
-	_map, err = decoder.GetMap(m, name)
+func (filter *KernelFilter) Get(m *manager.Manager, kind string) (results []uint64, err error) {
+	name, _, err := mapOf(kind, 0)
+	if err != nil {
+		return
+	}
+	_map, err := decoder.GetMap(m, name)
+	if err != nil {
+		return
+	}
+	var value uint32
+	iter := _map.Iterate()
+	if kind == KindCgroupID {
+		var key uint64
+		for iter.Next(&key, &value) {
+			results = append(results, key)
+		}
+	} else {
+		var key uint32
+		for iter.Next(&key, &value) {
+			results = append(results, uint64(key))
+		}
+	}
+	return results, iter.Err()
+}
+
+// PathKey is the key of the prefix in path_filter, the FNV-1a hash of the
+// prefix without the trailing '/'. A prefix always matches by components.
+// The other maps of the same scheme share it.
+func PathKey(prefix string) (key uint64, err error) {
+	cleaned := path.Clean(prefix)
+	if !path.IsAbs(cleaned) || cleaned == "/" {
+		return 0, fmt.Errorf("invalid path prefix %s", prefix)
+	}
+	// the path which is the prefix itself ends with the NUL in the scan
+	if len(cleaned) >= pathFilterScan-1 {
+		return 0, fmt.Errorf("path prefix %s is longer than %d", prefix, pathFilterScan-2)
+	}
+	h := fnv.New64a()
+	h.Write([]byte(cleaned))
+	return h.Sum64(), nil
+}
+
+// SetPath adds the path prefix to path_filter, it's used by the exe and
+// the file filters
+func (filter *KernelFilter) SetPath(m *manager.Manager, prefix string) (err error) {
+	key, err := PathKey(prefix)
+	if err != nil {
+		return
+	}
+	_map, err := decoder.GetMap(m, PathFilter)
+	if err != nil {
+		return
+	}
+	var zero uint32
+	if err = _map.Update(key, zero, ebpf.UpdateAny); err != nil {
+		return
+	}
+	return filter.bumpPathGen(m, _map)
+}
+
+func (filter *KernelFilter) DeletePath(m *manager.Manager, prefix string) (err error) {
+	key, err := PathKey(prefix)
+	if err != nil {
+		return
+	}
+	_map, err := decoder.GetMap(m, PathFilter)
+	if err != nil {
+		return
+	}
+	if err = _map.Delete(key); err != nil {
+		if errors.Is(err, ebpf.ErrKeyNotExist) {
+			err = nil
+		}
+		return
+	}
+	return filter.bumpPathGen(m, _map)
+}
+
+// bumpPathGen changes the generation of path_filter, so the verdicts cached
+// with the exe paths are checked again. The generation only goes forward, a
+// verdict cached before any change is never valid again. Whether the map is
+// empty is set apart, and the kern side skips the deny filters then.
+func (filter *KernelFilter) bumpPathGen(m *manager.Manager, pathMap *ebpf.Map) (err error) {
+	config, err := decoder.GetMap(m, configMap)
+	if err != nil {
+		return
+	}
+	var active uint64
+	var key uint64
+	var value uint32
+	iter := pathMap.Iterate()
+	if iter.Next(&key, &value) {
+		active = 1
+	} else if err = iter.Err(); err != nil {
+		return
+	}
+	var gen uint64
+	if err = config.Lookup(confPathFilterGen, &gen); err != nil && !errors.Is(err, ebpf.ErrKeyNotExist) {
+		return
+	}
+	// the kern side reads it as a u32, and 0 is the generation of the
+	// entries cached before any change
+	if gen = (gen + 1) & 0x7fffffff; gen == 0 {
+		gen = 1
+	}
+	if err = config.Update(confPathFilterGen, gen, ebpf.UpdateAny); err != nil {
+		return
+	}
+	return config.Update(confPathFilterActive, active, ebpf.UpdateAny)
+}
+
+// GetScope returns the modes of the event type, 0 for all the types. The
+// type without its own scope is the same as the default.
+func (filter *KernelFilter) GetScope(m *manager.Manager, eventType uint32) (scope Scope, err error) {
+	if eventType != scopeAllTypes {
+		var _map *ebpf.Map
+		if _map, err = decoder.GetMap(m, ScopeMap); err != nil {
+			return
+		}
+		if err = _map.Lookup(eventType, &scope); err == nil {
+			return
+		}
+		if !errors.Is(err, ebpf.ErrKeyNotExist) {
+			return
+		}
+	}
+	_map, err := decoder.GetMap(m, ScopeDefault)
 	if err != nil {
 		return
 	}
-	err = _map.Delete(unsafe.Pointer(&key))
+	err = _map.Lookup(uint32(0), &scope)
 	return
 }
 
-func (filter *KernelFilter) Get(m *manager.Manager, name string) (results []interface{}, err error) {
-	var _map *ebpf.Map
-	_map, err = decoder.GetMap(m, name)
+// SetScope sets the modes of the event type, 0 for all the types
+func (filter *KernelFilter) SetScope(m *manager.Manager, eventType uint32, scope Scope) (err error) {
+	name, key := ScopeMap, eventType
+	if eventType == scopeAllTypes {
+		name = ScopeDefault
+	}
+	_map, err := decoder.GetMap(m, name)
+	if err != nil {
+		return
+	}
+	return _map.Update(key, scope, ebpf.UpdateAny)
+}
+
+// DeleteScope makes the event type back to the default
+func (filter *KernelFilter) DeleteScope(m *manager.Manager, eventType uint32) (err error) {
+	if eventType == scopeAllTypes {
+		return filter.SetScope(m, eventType, Scope{})
+	}
+	_map, err := decoder.GetMap(m, ScopeMap)
 	if err != nil {
 		return
 	}
-	var key, value interface{}
-	for _map.Iterate().Next(key, value) {
-		results = append(results, key)
+	if err = _map.Delete(eventType); errors.Is(err, ebpf.ErrKeyNotExist) {
+		err = nil
+	}
+	return
+}
+
+// Apply applies the kernel filter configuration from the task. The modes
+// are applied before the keys, so an allow list is set with its keys in
+// one task.
+func (filter *KernelFilter) Apply(m *manager.Manager, config *KernelFilterConfig) (err error) {
+	if config.Reset {
+		if err = filter.DeleteScope(m, config.Type); err != nil {
+			return
+		}
+	}
+	if len(config.Mode) > 0 {
+		var scope Scope
+		if scope, err = filter.GetScope(m, config.Type); err != nil {
+			return
+		}
+		for kind, name := range config.Mode {
+			mode, ok := modes[name]
+			if !ok {
+				return fmt.Errorf("unknown kernel filter mode %s", name)
+			}
+			if err = scope.set(kind, mode); err != nil {
+				return
+			}
+		}
+		if err = filter.SetScope(m, config.Type, scope); err != nil {
+			return
+		}
+	}
+	for kind, values := range config.Add {
+		for _, value := range values {
+			if err = filter.Set(m, kind, value); err != nil {
+				return
+			}
+		}
+	}
+	for kind, values := range config.Delete {
+		for _, value := range values {
+			if err = filter.Delete(m, kind, value); err != nil {
+				return
+			}
+		}
+	}
+	for _, prefix := range config.AddPath {
+		if err = filter.SetPath(m, prefix); err != nil {
+			return
+		}
+	}
+	for _, prefix := range config.DeletePath {
+		if err = filter.DeletePath(m, prefix); err != nil {
+			return
+		}
 	}
 	return
 }
@@ -0,0 +1,59 @@
+package window
+
+import (
+	"hades-ebpf/user/decoder"
+	"hades-ebpf/user/filter"
+	"hades-ebpf/user/helper"
+
+	"github.com/cilium/ebpf"
+	manager "github.com/ehids/ebpfmanager"
+)
+
+// The exe and argv windows of execve in kern space, see "exec windows" in
+// kern/include/hades_exec.h. They replace the windows in userspace, with
+// the same quotas in 60 seconds, and the system binaries are exempted from
+// the exe window, just like elkeid.
+const (
+	ExeWindowExempt = "exe_window_exempt"
+	configMap       = "config_map"
+	confExeQuota    = uint32(10)
+	confArgvQuota   = uint32(11)
+	// limit tps=9000/60 = 150, just like elkeid
+	exeDynQuota  = 9000
+	argvDynQuota = 1500
+)
+
+// KernelMaps are the maps used by the windows in kern space
+var KernelMaps = []string{ExeWindowExempt}
+
+var exeExempt = []string{"/bin", "/sbin", "/usr/bin", "/usr/sbin"}
+
+// LoadKernel sets the windows in kern space
+func LoadKernel(m *manager.Manager) (err error) {
+	exempt, err := decoder.GetMap(m, ExeWindowExempt)
+	if err != nil {
+		return
+	}
+	var zero uint32
+	for _, prefix := range exeExempt {
+		var key uint64
+		if key, err = filter.PathKey(prefix); err != nil {
+			return
+		}
+		if err = exempt.Update(key, zero, ebpf.UpdateAny); err != nil {
+			return
+		}
+	}
+	if err = helper.MapUpdate(m, configMap, confExeQuota, uint64(exeDynQuota)); err != nil {
+		return
+	}
+	return helper.MapUpdate(m, configMap, confArgvQuota, uint64(argvDynQuota))
+}
+
+// Disable turns the windows in kern space off, by the quotas of 0
+func Disable(m *manager.Manager) (err error) {
+	if err = helper.MapUpdate(m, configMap, confExeQuota, uint64(0)); err != nil {
+		return
+	}
+	return helper.MapUpdate(m, configMap, confArgvQuota, uint64(0))
+}
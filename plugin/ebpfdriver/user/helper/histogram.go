@@ -0,0 +1,29 @@
+package helper
+
+// Log2Percentile returns the upper bound of the log2 histogram slot that
+// the percentile (0-100) falls in. Slot n is for [2^n, 2^(n+1)), so the
+// result is an estimate with at most 2x error. 0 if it's empty.
+func Log2Percentile(slots []uint64, percentile float64) uint64 {
+	var total uint64
+	for _, count := range slots {
+		total += count
+	}
+	if total == 0 {
+		return 0
+	}
+	target := uint64(float64(total) * percentile / 100)
+	if target == 0 {
+		target = 1
+	}
+	var cumulative uint64
+	for slot, count := range slots {
+		cumulative += count
+		if cumulative >= target {
+			if slot >= 63 {
+				return ^uint64(0)
+			}
+			return 1 << (slot + 1)
+		}
+	}
+	return ^uint64(0)
+}
@@ -0,0 +1,23 @@
+package helper
+
+import "testing"
+
+func TestLog2Percentile(t *testing.T) {
+	slots := make([]uint64, 64)
+	if Log2Percentile(slots, 50) != 0 {
+		t.Error("empty histogram should be 0")
+	}
+	// 90 in [1024, 2048), 9 in [4096, 8192), 1 in [1<<20, 1<<21)
+	slots[10] = 90
+	slots[12] = 9
+	slots[20] = 1
+	if p := Log2Percentile(slots, 50); p != 2048 {
+		t.Error("p50 failed:", p)
+	}
+	if p := Log2Percentile(slots, 99); p != 8192 {
+		t.Error("p99 failed:", p)
+	}
+	if p := Log2Percentile(slots, 100); p != 1<<21 {
+		t.Error("p100 failed:", p)
+	}
+}
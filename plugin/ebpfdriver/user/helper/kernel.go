@@ -0,0 +1,78 @@
+package helper
+
+import (
+	"os"
+	"runtime"
+	"strconv"
+	"strings"
+	"sync"
+
+	"golang.org/x/sys/unix"
+)
+
+var (
+	kernelVersion     uint32
+	kernelVersionOnce sync.Once
+)
+
+// KernelVersionCode is the same as KERNEL_VERSION in the kernel
+func KernelVersionCode(major, minor, patch uint32) uint32 {
+	if patch > 255 {
+		patch = 255
+	}
+	return major<<16 + minor<<8 + patch
+}
+
+// KernelVersion returns the version code of the running kernel by uname,
+// 0 if it can't be parsed
+func KernelVersion() uint32 {
+	kernelVersionOnce.Do(func() {
+		var uts unix.Utsname
+		if err := unix.Uname(&uts); err != nil {
+			return
+		}
+		kernelVersion = parseKernelRelease(unix.ByteSliceToString(uts.Release[:]))
+	})
+	return kernelVersion
+}
+
+// KernelVersionAtLeast checks the running kernel version
+func KernelVersionAtLeast(major, minor, patch uint32) bool {
+	return KernelVersion() >= KernelVersionCode(major, minor, patch)
+}
+
+// parse the release like 5.17.0-1-amd64 or 4.18.0-348.el8.x86_64
+func parseKernelRelease(release string) uint32 {
+	if i := strings.IndexAny(release, "-+ "); i >= 0 {
+		release = release[:i]
+	}
+	var version [3]uint32
+	for i, field := range strings.SplitN(release, ".", 3) {
+		value, err := strconv.ParseUint(field, 10, 32)
+		if err != nil {
+			break
+		}
+		version[i] = uint32(value)
+	}
+	return KernelVersionCode(version[0], version[1], version[2])
+}
+
+// PossibleCPUs returns the number of the possible cpus, which are the
+// indexes of the per-cpu maps and rings. It's like "0-7" in sysfs, and
+// runtime.NumCPU is returned if it can't be parsed.
+func PossibleCPUs() uint32 {
+	data, err := os.ReadFile("/sys/devices/system/cpu/possible")
+	if err != nil {
+		return uint32(runtime.NumCPU())
+	}
+	ranges := strings.Split(strings.TrimSpace(string(data)), ",")
+	last := ranges[len(ranges)-1]
+	if i := strings.LastIndexByte(last, '-'); i >= 0 {
+		last = last[i+1:]
+	}
+	n, err := strconv.ParseUint(last, 10, 32)
+	if err != nil {
+		return uint32(runtime.NumCPU())
+	}
+	return uint32(n) + 1
+}
@@ -18,3 +18,9 @@ func ZeroCopyString(b []byte) (s string) {
 	pstring.Len = pbytes.Len
 	return
 }
+
+// CloneString copies the string, it's for the strings which are from the
+// ZeroCopyString and are kept longer than the bytes, like the caches.
+func CloneString(s string) string {
+	return string(append([]byte(nil), s...))
+}
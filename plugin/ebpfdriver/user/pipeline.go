@@ -0,0 +1,79 @@
+package user
+
+import (
+	"hades-ebpf/user/helper"
+	"strconv"
+
+	manager "github.com/ehids/ebpfmanager"
+)
+
+// the execve(at) exit pipeline, see exec_stage in hades_exec.h
+const execPipelineMap = "exec_pipeline"
+const execPipelineRawMap = "exec_pipeline_raw"
+const rawPrefix = "raw_"
+const conf_EXEC_STAGE_DISABLE uint32 = 5
+
+const (
+	ExecStagePaths = iota
+	ExecStageFds
+	ExecStageSocket
+	ExecStagePidTree
+	ExecStageArgv
+)
+
+// stages that can be disabled by the SetExecStageDisable task
+const execStageSwitchable = 1<<ExecStageFds | 1<<ExecStageSocket | 1<<ExecStagePidTree
+
+var execStages = map[uint32]string{
+	ExecStagePaths:   "exec_stage_paths",
+	ExecStageFds:     "exec_stage_fds",
+	ExecStageSocket:  "exec_stage_socket",
+	ExecStagePidTree: "exec_stage_pid_tree",
+	ExecStageArgv:    "exec_stage_argv",
+}
+
+// execPipelineRoutes returns the routes of the stages, raw for the stages
+// of the raw_tracepoint dispatcher
+func execPipelineRoutes(raw bool) []manager.TailCallRoute {
+	progArray, prefix := execPipelineMap, ""
+	if raw {
+		progArray, prefix = execPipelineRawMap, rawPrefix
+	}
+	routes := make([]manager.TailCallRoute, 0, len(execStages))
+	for key, funcName := range execStages {
+		routes = append(routes, manager.TailCallRoute{
+			ProgArrayName: progArray,
+			Key:           key,
+			ProbeIdentificationPair: manager.ProbeIdentificationPair{
+				EbpfFuncName: prefix + funcName,
+			},
+		})
+	}
+	return routes
+}
+
+// execPipelineExcluded returns the stages of the flavour not in use
+func execPipelineExcluded(raw bool) []string {
+	prefix := rawPrefix
+	if raw {
+		prefix = ""
+	}
+	excluded := make([]string, 0, len(execStages))
+	for _, funcName := range execStages {
+		if haveProgram(prefix + funcName) {
+			excluded = append(excluded, prefix+funcName)
+		}
+	}
+	return excluded
+}
+
+// setExecStageDisable sets the bitmask (1 << stage) of the disabled stages,
+// the task data is the mask in decimal. Stages that can't be disabled are
+// ignored.
+func (d *Driver) setExecStageDisable(data string) error {
+	mask, err := strconv.ParseUint(data, 10, 32)
+	if err != nil {
+		return err
+	}
+	return helper.MapUpdate(d.Manager, configMap, conf_EXEC_STAGE_DISABLE, mask&execStageSwitchable)
+}
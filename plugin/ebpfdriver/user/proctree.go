@@ -0,0 +1,62 @@
+package user
+
+import (
+	"hades-ebpf/user/cache"
+	"hades-ebpf/user/decoder"
+
+	"github.com/cilium/ebpf"
+	manager "github.com/ehids/ebpfmanager"
+)
+
+// the kernel process tree, see proc_tree in utils_buf.h
+const procTreeMap = "proc_tree"
+const constPidTreeCompact = "hades_pid_tree_compact"
+
+// procInfo is the same as proc_info_t in kernel
+type procInfo struct {
+	Ppid      uint32
+	_         uint32
+	ExecID    uint64
+	StartTime uint64
+	Comm      [16]byte
+}
+
+// The process tree is maintained by tracepoints, no event is sent
+var procTreeProbes = []*manager.Probe{
+	{
+		UID:              "TracepointSchedProcessFork",
+		Section:          "tracepoint/sched/sched_process_fork",
+		EbpfFuncName:     "sched_process_fork",
+		AttachToFuncName: "sched_process_fork",
+	},
+	{
+		UID:              "TracepointSchedProcessExec",
+		Section:          "tracepoint/sched/sched_process_exec",
+		EbpfFuncName:     "sched_process_exec",
+		AttachToFuncName: "sched_process_exec",
+	},
+	{
+		UID:              "TracepointSchedProcessExit",
+		Section:          "tracepoint/sched/sched_process_exit",
+		EbpfFuncName:     "sched_process_exit",
+		AttachToFuncName: "sched_process_exit",
+	},
+}
+
+// seedProcTree fills the kernel process tree with the processes which
+// are started before the driver. Entries added by the tracepoints are
+// never overwritten.
+func (d *Driver) seedProcTree() error {
+	bpfmap, err := decoder.GetMap(d.Manager, procTreeMap)
+	if err != nil {
+		return err
+	}
+	return cache.DefaultProcessCache.WalkProcfs(func(proc *cache.Process) {
+		info := procInfo{
+			Ppid:      proc.Ppid,
+			StartTime: proc.StartTime,
+		}
+		copy(info.Comm[:], proc.Comm)
+		bpfmap.Update(proc.Pid, &info, ebpf.UpdateNoExist)
+	})
+}
@@ -0,0 +1,133 @@
+package user
+
+import (
+	"hades-ebpf/user/decoder"
+	"hades-ebpf/user/helper"
+	"hades-ebpf/user/share"
+	"strconv"
+	"strings"
+	"time"
+
+	"github.com/chriskaliX/SDK/transport/protocol"
+	"go.uber.org/zap"
+)
+
+// the token buckets of the rate limit by (event type, cgroup), see "rate
+// limit" in kern/include/utils.h
+const rateLimitMap = "rate_limit"
+const conf_RATE_LIMIT_RATE uint32 = 8
+const conf_RATE_LIMIT_BURST uint32 = 9
+const conf_RATE_LIMIT_REFILL uint32 = 13
+
+const nsecPerSec = uint64(time.Second)
+
+// the interval of the suppressed summary
+const rateLimitInterval = "*/30 * * * * *"
+
+// rateKey is the same as rate_key_t in kernel
+type rateKey struct {
+	CgroupID uint64
+	Type     uint32
+	Pad      uint32
+}
+
+// rateBucket is the same as rate_bucket_t in kernel
+type rateBucket struct {
+	Tokens     uint64
+	Ts         uint64
+	Suppressed uint64
+}
+
+// setRateLimit sets the rate and the burst of every (event type, cgroup),
+// the rate 0 is for off
+func (d *Driver) setRateLimit(rate, burst uint32) (err error) {
+	// the ns to refill a full bucket, it's set before the rate so the kern
+	// never refills by the new rate with an old cap
+	var refill uint64
+	if rate != 0 {
+		full := uint64(burst)
+		if full == 0 {
+			full = uint64(rate)
+		}
+		refill = full * nsecPerSec / uint64(rate)
+	}
+	if err = helper.MapUpdate(d.Manager, configMap, conf_RATE_LIMIT_REFILL, refill); err != nil {
+		return
+	}
+	if err = helper.MapUpdate(d.Manager, configMap, conf_RATE_LIMIT_BURST, uint64(burst)); err != nil {
+		return
+	}
+	if err = helper.MapUpdate(d.Manager, configMap, conf_RATE_LIMIT_RATE, uint64(rate)); err != nil {
+		return
+	}
+	share.RateLimit, share.RateBurst = rate, burst
+	return
+}
+
+// setRateLimitTask sets the rate limit by the task, data is "rate" or
+// "rate,burst"
+func (d *Driver) setRateLimitTask(data string) (err error) {
+	var rate, burst uint64
+	fields := strings.SplitN(data, ",", 2)
+	if rate, err = strconv.ParseUint(strings.TrimSpace(fields[0]), 10, 32); err != nil {
+		return
+	}
+	if len(fields) == 2 {
+		if burst, err = strconv.ParseUint(strings.TrimSpace(fields[1]), 10, 32); err != nil {
+			return
+		}
+	}
+	return d.setRateLimit(uint32(rate), uint32(burst))
+}
+
+// sendSuppressed sends the events suppressed by the rate limit since the
+// last call, one record for every (event type, cgroup), with DataType 996.
+// The counters in kern space are totals, the last ones are kept here. An
+// evicted bucket starts from 0 again.
+func (d *Driver) sendSuppressed() {
+	bpfmap, err := decoder.GetMap(d.Manager, rateLimitMap)
+	if err != nil {
+		zap.S().Error(err)
+		return
+	}
+	last := d.suppressed
+	d.suppressed = make(map[rateKey]uint64, len(last))
+	var (
+		key    rateKey
+		bucket rateBucket
+	)
+	iter := bpfmap.Iterate()
+	for iter.Next(&key, &bucket) {
+		d.suppressed[key] = bucket.Suppressed
+		n := bucket.Suppressed
+		if prev, ok := last[key]; ok && prev <= n {
+			n -= prev
+		}
+		if n == 0 {
+			continue
+		}
+		name := strconv.FormatUint(uint64(key.Type), 10)
+		if event, ok := decoder.Events[key.Type]; ok {
+			name = event.Name()
+		}
+		rec := &protocol.Record{
+			DataType: 996,
+			Data: &protocol.Payload{
+				Fields: map[string]string{
+					"event":      name,
+					"event_type": strconv.FormatUint(uint64(key.Type), 10),
+					"cgroup_id":  strconv.FormatUint(key.CgroupID, 10),
+					"suppressed": strconv.FormatUint(n, 10),
+					"rate":       strconv.FormatUint(uint64(share.RateLimit), 10),
+					"burst":      strconv.FormatUint(uint64(share.RateBurst), 10),
+				},
+			},
+		}
+		if err := d.Sandbox.SendRecord(rec); err != nil {
+			zap.S().Error(err)
+		}
+	}
+	if err = iter.Err(); err != nil {
+		zap.S().Error(err)
+	}
+}
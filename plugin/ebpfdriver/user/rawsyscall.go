@@ -0,0 +1,149 @@
+package user
+
+import (
+	"hades-ebpf/user/helper"
+	"hades-ebpf/user/share"
+
+	manager "github.com/ehids/ebpfmanager"
+	"go.uber.org/zap"
+	"golang.org/x/sys/unix"
+)
+
+// the raw_tracepoint dispatcher, see raw_sys_enter in hades_exec.h
+const sysEnterTailsMap = "sys_enter_tails"
+const sysExitTailsMap = "sys_exit_tails"
+const syscallBitmapMap = "syscall_bitmap"
+const rawSyscallMax = 512
+
+type rawSyscall struct {
+	nr uint32
+	// the tracepoint programs which are replaced
+	enter string
+	exit  string
+	// the handlers in the prog arrays, with the same arguments
+	rawEnter string
+	rawExit  string
+}
+
+// Syscalls hooked by the tracepoints. The numbers are from x/sys/unix, so
+// they are right for the arch that the agent is built for.
+var rawSyscalls = []rawSyscall{
+	{unix.SYS_EXECVE, "sys_enter_execve", "sys_exit_execve", "raw_sys_enter_execve", "raw_sys_exit_execve"},
+	{unix.SYS_EXECVEAT, "sys_enter_execveat", "sys_exit_execveat", "raw_sys_enter_execveat", "raw_sys_exit_execveat"},
+	{unix.SYS_PRCTL, "sys_enter_prctl", "", "raw_sys_enter_prctl", ""},
+	{unix.SYS_PTRACE, "sys_enter_ptrace", "", "raw_sys_enter_ptrace", ""},
+	{unix.SYS_MEMFD_CREATE, "sys_enter_memfd_create", "", "raw_sys_enter_memfd_create", ""},
+}
+
+// the raw flavour of the bpf_loop enter programs
+var rawLoopPrograms = map[string]string{
+	"raw_sys_enter_execve":   "raw_sys_enter_execve_loop",
+	"raw_sys_enter_execveat": "raw_sys_enter_execveat_loop",
+}
+
+var rawDispatchProbes = []*manager.Probe{
+	{
+		UID:              "RawTracepointSysEnter",
+		Section:          "raw_tracepoint/sys_enter",
+		EbpfFuncName:     "raw_sys_enter",
+		AttachToFuncName: "sys_enter",
+	},
+	{
+		UID:              "RawTracepointSysExit",
+		Section:          "raw_tracepoint/sys_exit",
+		EbpfFuncName:     "raw_sys_exit",
+		AttachToFuncName: "sys_exit",
+	},
+}
+
+// setRawSyscalls replaces the syscall tracepoints with the raw_tracepoint
+// dispatcher if it's enabled. Only the syscalls of the registered events
+// are routed and enabled. It must be called after setArgvCapture since the
+// bpf_loop flavour is followed.
+func (d *Driver) setRawSyscalls(options *manager.Options) {
+	useRaw := share.RawSyscall
+	for _, probe := range rawDispatchProbes {
+		if !haveProgram(probe.EbpfFuncName) {
+			useRaw = false
+		}
+	}
+	routed := make(map[string]bool)
+	if useRaw {
+		probes := d.Manager.Probes[:0]
+		for _, probe := range d.Manager.Probes {
+			route, ok := rawSyscallRoute(probe.EbpfFuncName)
+			if !ok {
+				probes = append(probes, probe)
+				continue
+			}
+			options.ExcludedFunctions = append(options.ExcludedFunctions, probe.EbpfFuncName)
+			options.TailCallRouter = append(options.TailCallRouter, route)
+			routed[route.ProbeIdentificationPair.EbpfFuncName] = true
+			d.rawSyscalls = append(d.rawSyscalls, route.Key)
+		}
+		d.Manager.Probes = append(probes, rawDispatchProbes...)
+	}
+	// exclude all the raw programs that are not routed
+	for _, probe := range rawDispatchProbes {
+		if !useRaw && haveProgram(probe.EbpfFuncName) {
+			options.ExcludedFunctions = append(options.ExcludedFunctions, probe.EbpfFuncName)
+		}
+	}
+	for _, syscall := range rawSyscalls {
+		for _, name := range []string{syscall.rawEnter, rawLoopPrograms[syscall.rawEnter], syscall.rawExit} {
+			if name != "" && !routed[name] && haveProgram(name) {
+				options.ExcludedFunctions = append(options.ExcludedFunctions, name)
+			}
+		}
+	}
+	options.TailCallRouter = append(options.TailCallRouter, execPipelineRoutes(useRaw)...)
+	options.ExcludedFunctions = append(options.ExcludedFunctions, execPipelineExcluded(useRaw)...)
+	zap.S().Infof("syscalls with raw_tracepoint dispatcher: %t", useRaw)
+}
+
+// rawSyscallRoute returns the route in the prog array for the tracepoint
+// program, ok is false if it's not a syscall tracepoint
+func rawSyscallRoute(funcName string) (route manager.TailCallRoute, ok bool) {
+	for _, syscall := range rawSyscalls {
+		var progArray, handler string
+		switch funcName {
+		case syscall.enter:
+			progArray, handler = sysEnterTailsMap, syscall.rawEnter
+		case loopPrograms[syscall.enter]:
+			progArray, handler = sysEnterTailsMap, rawLoopPrograms[syscall.rawEnter]
+		case syscall.exit:
+			progArray, handler = sysExitTailsMap, syscall.rawExit
+		}
+		if handler == "" {
+			continue
+		}
+		return manager.TailCallRoute{
+			ProgArrayName: progArray,
+			Key:           syscall.nr,
+			ProbeIdentificationPair: manager.ProbeIdentificationPair{
+				EbpfFuncName: handler,
+			},
+		}, true
+	}
+	return
+}
+
+// updateSyscallBitmap enables the routed syscalls in the dispatcher
+func (d *Driver) updateSyscallBitmap() error {
+	if len(d.rawSyscalls) == 0 {
+		return nil
+	}
+	var bitmap [rawSyscallMax / 64]uint64
+	for _, nr := range d.rawSyscalls {
+		if nr >= rawSyscallMax {
+			continue
+		}
+		bitmap[nr/64] |= 1 << (nr % 64)
+	}
+	for key, bits := range bitmap {
+		if err := helper.MapUpdate(d.Manager, syscallBitmapMap, uint32(key), bits); err != nil {
+			return err
+		}
+	}
+	return nil
+}
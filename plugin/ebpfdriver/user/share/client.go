@@ -4,4 +4,33 @@ var (
 	EventFilter []string
 	Env         string
 	Debug       bool
+	// PidTreeCompact sends the ancestor pids only, the pid tree is rebuilt
+	// in userspace
+	PidTreeCompact bool
+	// budgets of the bpf_loop argv/envp capture
+	ArgvBytesBudget uint32
+	ArgvElemsBudget uint32
+	// RawSyscall hooks the syscalls by the raw_tracepoint dispatcher
+	RawSyscall bool
+	// Latency records the latency histograms of the hooks
+	Latency bool
+	// DecodeWorkers is the number of the decode workers, 0 for GOMAXPROCS
+	DecodeWorkers int
+	// ZeroCopy decodes the strings as the views of the event buffer
+	ZeroCopy bool
+	// Encoding of the events, json or binary. The binary events are sent in
+	// batches of BatchSize with DataType 997
+	Encoding  string
+	BatchSize int
+	// CompactHeader sends the compact header in place of the context_t
+	CompactHeader bool
+	// RateLimit is the events per second of every (event type, cgroup) in
+	// kern space, 0 for off. RateBurst is 0 for the same as RateLimit
+	RateLimit uint32
+	RateBurst uint32
+)
+
+const (
+	EncodingJson   = "json"
+	EncodingBinary = "binary"
 )
@@ -0,0 +1,17 @@
+package user
+
+import manager "github.com/ehids/ebpfmanager"
+
+// the remote peers of the processes, see "socket peer index" in
+// kern/include/utils.h. It's updated by security_socket_connect of the
+// socket_connect event and by the accept probe here, no event is sent.
+const socketPeerMap = "socket_peer"
+
+var socketPeerProbes = []*manager.Probe{
+	{
+		UID:              "KretprobeInetCskAccept",
+		Section:          "kretprobe/inet_csk_accept",
+		EbpfFuncName:     "kretprobe_inet_csk_accept",
+		AttachToFuncName: "inet_csk_accept",
+	},
+}
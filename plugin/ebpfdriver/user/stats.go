@@ -0,0 +1,206 @@
+package user
+
+import (
+	"encoding/json"
+	"hades-ebpf/user/decoder"
+	"hades-ebpf/user/helper"
+	"strconv"
+	"sync/atomic"
+
+	"github.com/chriskaliX/SDK/transport/protocol"
+	"go.uber.org/zap"
+)
+
+// the per-cpu statistics of the hooks, see hook_stats_t in define.h
+const statsMap = "hades_stats"
+
+// the per-cpu latency histograms, see latency_hist_t in define.h
+const latencyMap = "hades_latency"
+const conf_LATENCY_ENABLE uint32 = 6
+
+// the interval of the stats heartbeat
+const statsInterval = "0 */1 * * * *"
+
+// the names of the types which are not events, see define.h
+var hookNames = map[uint32]string{
+	decoder.InternType:              "intern_string",
+	decoder.SecurityInodeUnlinkType: "security_inode_unlink",
+	decoder.SchedProcessForkType:    "sched_process_fork",
+	decoder.SchedProcessExecType:    "sched_process_exec",
+	decoder.SchedProcessExitType:    "sched_process_exit",
+	decoder.ExecArgvStagingType:     "exec_argv_staging",
+	decoder.RawSysEnterType:         "raw_sys_enter",
+	decoder.RawSysExitType:          "raw_sys_exit",
+	decoder.SysBpfDenyType:          "sys_bpf_deny",
+}
+
+func hookName(key uint32) string {
+	if event, ok := decoder.Events[key]; ok {
+		return event.Name()
+	}
+	if name, ok := hookNames[key]; ok {
+		return name
+	}
+	return strconv.FormatUint(uint64(key), 10)
+}
+
+// hookStats is the same as hook_stats_t in kernel
+type hookStats struct {
+	Entered      uint64 `json:"entered"`
+	Filtered     uint64 `json:"filtered"`
+	Limited      uint64 `json:"limited"`
+	Truncated    uint64 `json:"truncated"`
+	OutputFailed uint64 `json:"output_failed"`
+	Emitted      uint64 `json:"emitted"`
+	Bytes        uint64 `json:"bytes"`
+}
+
+func (h *hookStats) add(o *hookStats) {
+	h.Entered += o.Entered
+	h.Filtered += o.Filtered
+	h.Limited += o.Limited
+	h.Truncated += o.Truncated
+	h.OutputFailed += o.OutputFailed
+	h.Emitted += o.Emitted
+	h.Bytes += o.Bytes
+}
+
+// latencyHist is the same as latency_hist_t in kernel
+type latencyHist struct {
+	Slots [64]uint64
+}
+
+// hookLatency is the summary of the latency histogram, in ns
+type hookLatency struct {
+	Count uint64 `json:"count"`
+	P50   uint64 `json:"p50"`
+	P99   uint64 `json:"p99"`
+}
+
+// lost events reported by the perf_event_array, in total
+var lostCount uint64
+
+// Stats returns the accumulated statistics of all the cpus by the event
+// name. The values are counters since the driver is loaded.
+func (d *Driver) Stats() (map[string]*hookStats, error) {
+	bpfmap, err := decoder.GetMap(d.Manager, statsMap)
+	if err != nil {
+		return nil, err
+	}
+	result := make(map[string]*hookStats)
+	var (
+		key    uint32
+		values []hookStats
+	)
+	iter := bpfmap.Iterate()
+	for iter.Next(&key, &values) {
+		total := &hookStats{}
+		for i := range values {
+			total.add(&values[i])
+		}
+		result[hookName(key)] = total
+	}
+	return result, iter.Err()
+}
+
+// Latency returns the p50/p99 latency of the hooks by the event name, the
+// histograms are only recorded when the latency is enabled.
+func (d *Driver) Latency() (map[string]*hookLatency, error) {
+	bpfmap, err := decoder.GetMap(d.Manager, latencyMap)
+	if err != nil {
+		return nil, err
+	}
+	result := make(map[string]*hookLatency)
+	var (
+		key    uint32
+		values []latencyHist
+	)
+	iter := bpfmap.Iterate()
+	for iter.Next(&key, &values) {
+		slots := make([]uint64, 64)
+		var count uint64
+		for i := range values {
+			for slot, n := range values[i].Slots {
+				slots[slot] += n
+				count += n
+			}
+		}
+		result[hookName(key)] = &hookLatency{
+			Count: count,
+			P50:   helper.Log2Percentile(slots, 50),
+			P99:   helper.Log2Percentile(slots, 99),
+		}
+	}
+	return result, iter.Err()
+}
+
+// setLatency enables the latency histograms, data is "1" or "0"
+func (d *Driver) setLatency(data string) error {
+	enable, err := strconv.ParseBool(data)
+	if err != nil {
+		return err
+	}
+	var value uint64
+	if enable {
+		value = 1
+	}
+	return helper.MapUpdate(d.Manager, configMap, conf_LATENCY_ENABLE, value)
+}
+
+// sendStats sends the statistics as a heartbeat record
+func (d *Driver) sendStats() {
+	stats, err := d.Stats()
+	if err != nil {
+		zap.S().Error(err)
+		return
+	}
+	data, err := json.Marshal(stats)
+	if err != nil {
+		zap.S().Error(err)
+		return
+	}
+	fields := map[string]string{
+		"data": string(data),
+		"lost": strconv.FormatUint(atomic.LoadUint64(&lostCount), 10),
+	}
+	if latency, err := d.Latency(); err == nil && len(latency) > 0 {
+		if data, err := json.Marshal(latency); err == nil {
+			fields["latency"] = string(data)
+		}
+	}
+	rec := &protocol.Record{
+		DataType: 998,
+		Data: &protocol.Payload{
+			Fields: fields,
+		},
+	}
+	if err := d.Sandbox.SendRecord(rec); err != nil {
+		zap.S().Error(err)
+	}
+}
+
+// dumpStats logs the statistics for debugging
+func (d *Driver) dumpStats() {
+	stats, err := d.Stats()
+	if err != nil {
+		zap.S().Error(err)
+		return
+	}
+	for name, s := range stats {
+		zap.S().Infof("stats %s: %+v", name, *s)
+	}
+	zap.S().Infof("stats lost: %d", atomic.LoadUint64(&lostCount))
+	latency, err := d.Latency()
+	if err != nil {
+		zap.S().Error(err)
+		return
+	}
+	for name, l := range latency {
+		zap.S().Infof("latency %s: %+v", name, *l)
+	}
+}
+
+// Lost returns the lost events reported by the perf_event_array
+func (d *Driver) Lost() uint64 {
+	return atomic.LoadUint64(&lostCount)
+}
@@ -0,0 +1,113 @@
+package user
+
+import (
+	"hades-ebpf/user/helper"
+	"os"
+	"strings"
+
+	"github.com/cilium/ebpf"
+	"github.com/cilium/ebpf/asm"
+	"github.com/cilium/ebpf/link"
+	manager "github.com/ehids/ebpfmanager"
+	"go.uber.org/zap"
+)
+
+const btfVmlinux = "/sys/kernel/btf/vmlinux"
+
+// fentry/fexit flavours of the kprobes, only compiled in CO-RE. The
+// kprobe/bpf is not in the list since bpf_override_return is only for
+// kprobes.
+var trampolinePrograms = map[string]string{
+	"kprobe_security_socket_connect":   "fentry_security_socket_connect",
+	"kprobe_security_socket_bind":      "fentry_security_socket_bind",
+	"kprobe_security_inode_create":     "fentry_security_inode_create",
+	"kprobe_security_sb_mount":         "fentry_security_sb_mount",
+	"kprobe_security_inode_rename":     "fentry_security_inode_rename",
+	"kprobe_security_inode_unlink":     "fentry_security_inode_unlink",
+	"kprobe_security_inode_link":       "fentry_security_inode_link",
+	"kprobe_commit_creds":              "fentry_commit_creds",
+	"kprobe_do_init_module":            "fentry_do_init_module",
+	"kprobe_security_kernel_read_file": "fentry_security_kernel_read_file",
+	"kprobe_call_usermodehelper":       "fentry_call_usermodehelper",
+	"kprobe_security_file_permission":  "fentry_security_file_permission",
+	"kprobe_security_bpf":              "fentry_security_bpf",
+	// fexit gets the msghdr directly, the entry kprobe is dropped
+	"kretprobe_udp_recvmsg": "fexit_udp_recvmsg",
+}
+
+// the entry kprobes that are replaced by a fexit
+var trampolineDropped = map[string]bool{
+	"kprobe_udp_recvmsg": true,
+}
+
+// probeTrampoline attaches an empty fentry to a hooked function. BTF and
+// the version are not enough, the trampoline is arch specific (arm64 has it
+// since 6.0 only) and the attach fails without it.
+func probeTrampoline() error {
+	prog, err := ebpf.NewProgram(&ebpf.ProgramSpec{
+		Type:       ebpf.Tracing,
+		AttachType: ebpf.AttachTraceFEntry,
+		AttachTo:   "security_file_permission",
+		Instructions: asm.Instructions{
+			asm.Mov.Imm(asm.R0, 0),
+			asm.Return(),
+		},
+		License: "GPL",
+	})
+	if err != nil {
+		return err
+	}
+	defer prog.Close()
+	l, err := link.AttachTracing(link.TracingOptions{Program: prog})
+	if err != nil {
+		return err
+	}
+	return l.Close()
+}
+
+// setTrampolines replaces the kprobes with fentry/fexit if the kernel has
+// BTF and a fentry can be attached, otherwise the kprobes are kept. fentry
+// skips the int3 and the pt_regs setup, which matters for hot hooks like
+// security_file_permission. The unused flavour is excluded.
+func (d *Driver) setTrampolines(options *manager.Options) {
+	useTrampoline := helper.KernelVersionAtLeast(5, 5, 0)
+	if _, err := os.Stat(btfVmlinux); err != nil {
+		useTrampoline = false
+	}
+	for _, fentry := range trampolinePrograms {
+		if !haveProgram(fentry) {
+			useTrampoline = false
+		}
+	}
+	if useTrampoline {
+		if err := probeTrampoline(); err != nil {
+			zap.S().Infof("fentry is not supported: %s", err)
+			useTrampoline = false
+		}
+	}
+	if !useTrampoline {
+		for _, fentry := range trampolinePrograms {
+			if haveProgram(fentry) {
+				options.ExcludedFunctions = append(options.ExcludedFunctions, fentry)
+			}
+		}
+		zap.S().Infof("kprobes with fentry/fexit: %t", useTrampoline)
+		return
+	}
+	probes := d.Manager.Probes[:0]
+	for _, probe := range d.Manager.Probes {
+		if trampolineDropped[probe.EbpfFuncName] {
+			options.ExcludedFunctions = append(options.ExcludedFunctions, probe.EbpfFuncName)
+			continue
+		}
+		if fentry, ok := trampolinePrograms[probe.EbpfFuncName]; ok {
+			options.ExcludedFunctions = append(options.ExcludedFunctions, probe.EbpfFuncName)
+			// the section is like fentry/security_file_permission
+			probe.Section = strings.Replace(fentry, "_", "/", 1)
+			probe.EbpfFuncName = fentry
+		}
+		probes = append(probes, probe)
+	}
+	d.Manager.Probes = probes
+	zap.S().Infof("kprobes with fentry/fexit: %t", useTrampoline)
+}
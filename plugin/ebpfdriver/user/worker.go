@@ -0,0 +1,246 @@
+package user
+
+import (
+	"encoding/binary"
+	"errors"
+	"hades-ebpf/user/decoder"
+	"hades-ebpf/user/event"
+	"hades-ebpf/user/helper"
+	"hades-ebpf/user/share"
+	"runtime"
+	"strconv"
+	"time"
+
+	"github.com/chriskaliX/SDK/transport/batch"
+	"github.com/chriskaliX/SDK/transport/protocol"
+	"github.com/cilium/ebpf"
+	"go.uber.org/zap"
+)
+
+// the queue size of every decode worker
+const decodeQueueSize = 4096
+
+// the binary batches are flushed when full or every batchFlushInterval
+const batchFlushInterval = 100 * time.Millisecond
+
+// decodeWorker decodes, enriches, marshals and sends the events. Every
+// worker owns the decoder and the event instances, so the workers do not
+// share anything but the caches, which are thread-safe.
+type decodeWorker struct {
+	driver  *Driver
+	queue   chan []byte
+	decoder *decoder.EbpfDecoder
+	events  map[uint32]decoder.Event
+	fields  map[string]string
+	// batch is the binary encoder, it's nil for the json encoding
+	batch *batch.Encoder
+	// part is the index of the worker, the interned strings are sent to
+	// each part once, see intern_sent
+	part       uint32
+	internSent *ebpf.Map
+	// the strings are sent to each cpu once without the ringbuf
+	internCPUs uint32
+}
+
+// the key of intern_sent, struct intern_key in kern space
+type internKey struct {
+	ID   uint64
+	Part uint32
+	CPU  uint32
+}
+
+func newDecodeWorker(d *Driver, part int) *decodeWorker {
+	w := &decodeWorker{
+		driver:  d,
+		part:    uint32(part),
+		queue:   make(chan []byte, decodeQueueSize),
+		decoder: decoder.NewEbpfDecoder(nil),
+		events:  decoder.CloneEvents(),
+		fields:  make(map[string]string, 1),
+	}
+	w.decoder.SetZeroCopy(share.ZeroCopy)
+	w.decoder.SetCompactHeader(d.compactHeader)
+	if share.Encoding == share.EncodingBinary {
+		w.batch = batch.NewEncoder()
+	}
+	return w
+}
+
+// workerCount is the number of the decode workers, it's from the flag and
+// it's GOMAXPROCS by default
+func workerCount() int {
+	if share.DecodeWorkers > 0 {
+		return share.DecodeWorkers
+	}
+	return runtime.GOMAXPROCS(0)
+}
+
+// startWorkers starts the decode workers
+func (d *Driver) startWorkers() {
+	num := workerCount()
+	d.workers = make([]*decodeWorker, num)
+	for i := range d.workers {
+		d.workers[i] = newDecodeWorker(d, i)
+		go d.workers[i].run()
+	}
+	zap.S().Infof("decode workers: %d", num)
+}
+
+// dispatch partitions the events by pid, so the events of one process are
+// decoded by the same worker and keep in order. The ringbuf reports all
+// the events on cpu 0, the cpu is not used for this reason.
+func (d *Driver) dispatch(data []byte) {
+	var pid uint32
+	offset := decoder.ContextOffsetPid
+	if d.compactHeader {
+		offset = decoder.CompactOffsetPid
+	}
+	if len(data) >= offset+4 {
+		pid = binary.LittleEndian.Uint32(data[offset:])
+	}
+	worker := d.workers[pid%uint32(len(d.workers))]
+	select {
+	case worker.queue <- data:
+	case <-d.context.Done():
+	}
+}
+
+func (w *decodeWorker) run() {
+	// the ticker is only for the binary batches
+	var flush <-chan time.Time
+	if w.batch != nil {
+		ticker := time.NewTicker(batchFlushInterval)
+		defer ticker.Stop()
+		flush = ticker.C
+	}
+	for {
+		select {
+		case data := <-w.queue:
+			w.handle(data)
+		case <-flush:
+			w.flush()
+		case <-w.driver.context.Done():
+			if w.batch != nil {
+				w.flush()
+			}
+			return
+		}
+	}
+}
+
+func (w *decodeWorker) handle(data []byte) {
+	// get and decode the context
+	ctx := decoder.NewContext()
+	w.decoder.ReInit(data)
+	// the buffer is handed back after the record is sent
+	defer w.decoder.Release()
+	err := ctx.DecodeContext(w.decoder)
+	if err != nil {
+		return
+	}
+	defer decoder.PutContext(ctx)
+	// the interned string is always ahead of the events using it
+	if ctx.Type == decoder.InternType {
+		if err = w.decoder.DecodeIntern(); err != nil {
+			zap.S().Errorf("error: %s", err)
+		}
+		return
+	}
+	w.decoder.ResolveContext(ctx)
+	defer w.forget()
+	// get the event and set context into event
+	eventDecoder, ok := w.events[ctx.Type]
+	if !ok {
+		return
+	}
+	eventDecoder.SetContext(ctx)
+	err = eventDecoder.DecodeEvent(w.decoder)
+	if err == event.ErrFilter {
+		// it's been filtered
+		return
+	}
+	if err != nil {
+		// Ignore
+		if err == event.ErrIgnore {
+			return
+		}
+		zap.S().Errorf("error: %s", err)
+		return
+	}
+	// Fillup the context by the values that Event offers
+	ctx.FillContext(eventDecoder.Name(), eventDecoder.GetExe())
+	// binary encoding, the event is sent in batch
+	if w.batch != nil {
+		decoder.MarshalBinary(w.batch, eventDecoder)
+		if w.batch.Len() >= share.BatchSize {
+			w.flush()
+		}
+		return
+	}
+	// marshal the data
+	result, err := decoder.MarshalJson(eventDecoder)
+	if err != nil {
+		zap.S().Error(err)
+		return
+	}
+	w.fields["data"] = result
+	// send the record
+	rec := &protocol.Record{
+		DataType: 1000,
+		Data: &protocol.Payload{
+			Fields: w.fields,
+		},
+	}
+	if err = w.driver.Sandbox.SendRecord(rec); err != nil {
+		zap.S().Error(err)
+	}
+}
+
+// forget deletes the missed ids from intern_sent, so the strings are sent
+// again with the next events. The ids are missed if the records of the
+// strings are lost, or the dictionary has been reset.
+func (w *decodeWorker) forget() {
+	missed := w.decoder.Missed()
+	if len(missed) == 0 {
+		return
+	}
+	if w.internSent == nil {
+		var err error
+		if w.internSent, err = decoder.GetMap(w.driver.Manager, internSentMap); err != nil {
+			zap.S().Error(err)
+			return
+		}
+		w.internCPUs = 1
+		if w.driver.ringbuf == nil {
+			w.internCPUs = helper.PossibleCPUs()
+		}
+	}
+	for _, id := range missed {
+		for cpu := uint32(0); cpu < w.internCPUs; cpu++ {
+			key := internKey{ID: id, Part: w.part, CPU: cpu}
+			if err := w.internSent.Delete(&key); err != nil && !errors.Is(err, ebpf.ErrKeyNotExist) {
+				zap.S().Error(err)
+			}
+		}
+	}
+}
+
+// flush sends the events in the binary batch, with DataType 997
+func (w *decodeWorker) flush() {
+	if w.batch.Len() == 0 {
+		return
+	}
+	w.fields["data"] = w.batch.Text()
+	w.fields["count"] = strconv.Itoa(w.batch.Len())
+	w.batch.Reset()
+	rec := &protocol.Record{
+		DataType: 997,
+		Data: &protocol.Payload{
+			Fields: w.fields,
+		},
+	}
+	if err := w.driver.Sandbox.SendRecord(rec); err != nil {
+		zap.S().Error(err)
+	}
+	delete(w.fields, "count")
+}
@@ -2,7 +2,10 @@ module hboat
 
 go 1.18
 
+replace github.com/chriskaliX/SDK => ../SDK
+
 require (
+	github.com/chriskaliX/SDK v1.0.0
 	github.com/golang/protobuf v1.5.2
 	github.com/golang/snappy v0.0.4
 	github.com/spf13/cobra v1.5.0
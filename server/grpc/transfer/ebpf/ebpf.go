@@ -0,0 +1,36 @@
+// Package ebpf decodes the events of the ebpfdriver plugin. The json event
+// and the binary batch are decoded to the same maps, the batch format is
+// the one of SDK/transport/batch which the plugin encodes with.
+package ebpf
+
+import (
+	"encoding/json"
+
+	"github.com/chriskaliX/SDK/transport/batch"
+)
+
+// DataTypes of the ebpfdriver events
+const (
+	EventJson  = 1000
+	EventBatch = 997
+)
+
+// Parse decodes the events in the fields of a record of the DataType
+func Parse(dataType int32, fields map[string]string) ([]map[string]interface{}, error) {
+	if dataType == EventJson {
+		event := make(map[string]interface{})
+		if err := json.Unmarshal([]byte(fields["data"]), &event); err != nil {
+			return nil, err
+		}
+		return []map[string]interface{}{event}, nil
+	}
+	decoded, err := batch.DecodeText(fields["data"])
+	if err != nil {
+		return nil, err
+	}
+	events := make([]map[string]interface{}, 0, len(decoded))
+	for _, event := range decoded {
+		events = append(events, event.Fields)
+	}
+	return events, nil
+}
@@ -0,0 +1,46 @@
+package ebpf
+
+import (
+	"testing"
+
+	"github.com/chriskaliX/SDK/transport/batch"
+)
+
+func TestParseBatch(t *testing.T) {
+	e := batch.NewEncoder()
+	for i := 0; i < 2; i++ {
+		e.Begin(700, 4)
+		e.AppendString("exe", "/usr/bin/bash")
+		e.AppendUint("pid", uint64(100+i))
+		e.AppendInt("retval", -2)
+		e.AppendBool("argv_truncated", i == 1)
+	}
+	events, err := Parse(EventBatch, map[string]string{"data": e.Text()})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(events) != 2 {
+		t.Fatalf("events: %d", len(events))
+	}
+	for i, event := range events {
+		if event["exe"] != "/usr/bin/bash" ||
+			event["pid"] != uint64(100+i) ||
+			event["retval"] != int64(-2) ||
+			event["argv_truncated"] != (i == 1) {
+			t.Fatalf("event %d: %+v", i, event)
+		}
+	}
+	if _, err := Parse(EventBatch, map[string]string{"data": "not a batch"}); err == nil {
+		t.Fatal("invalid batch is decoded")
+	}
+}
+
+func TestParseJson(t *testing.T) {
+	events, err := Parse(EventJson, map[string]string{"data": `{"exe":"/usr/bin/bash","pid":100}`})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(events) != 1 || events[0]["exe"] != "/usr/bin/bash" || events[0]["pid"] != float64(100) {
+		t.Fatalf("events: %+v", events)
+	}
+}
@@ -0,0 +1,14 @@
+package handler
+
+import (
+	pb "hboat/grpc/transfer/proto"
+)
+
+// handleEbpfEvents fills the events with the agent fields
+func handleEbpfEvents(req *pb.RawData, events []map[string]interface{}) {
+	for _, event := range events {
+		event["agent_id"] = req.AgentID
+		event["hostname"] = req.Hostname
+	}
+	// TODO: kafka upload under dev
+}
@@ -10,6 +10,7 @@ import (
 	"strings"
 	"time"
 
+	"hboat/grpc/transfer/ebpf"
 	"hboat/grpc/transfer/pool"
 	pb "hboat/grpc/transfer/proto"
 
@@ -214,6 +215,13 @@ func handleData(req *pb.RawData, conn *pool.Connection) {
 		//
 		// TODO: kafka upload under dev
 
+		// ebpfdriver, the json event or the binary batch
+		case dataType == ebpf.EventJson, dataType == ebpf.EventBatch:
+			events, err := ebpf.Parse(dataType, value.Body.Fields)
+			if err != nil {
+				continue
+			}
+			handleEbpfEvents(req, events)
 		// windows
 		case dataType >= 100 && dataType <= 400:
 			for _, item := range req.Item {